@@ -5,6 +5,10 @@
 #include <artec/sdk/base/AlgorithmWorkset.h>
 #include <artec/sdk/algorithms/Algorithms.h>
 #include "artec_scanner_util.h" 
+#include "artec_scanner_generator.h"
+#include "artec_scanner_algorithm_util.h"
+#include "artec_scanner_progress.h"
+#include "artec_scanner_job_scheduler.h"
 
 #pragma once
 
@@ -12,13 +16,12 @@ namespace artec_scanner_robotraconteur_driver
 {
     class ArtecScannerImpl;
     class RRArtecModel;
-    class RunAlgorithms : public RobotRaconteur::Generator<experimental::artec_scanner::RunAlgorithmsStatusPtr,void>,
+    class RunAlgorithms : public ProgressGenerator<RunAlgorithms, experimental::artec_scanner::RunAlgorithmsStatusPtr>,
         public RR_ENABLE_SHARED_FROM_THIS<RunAlgorithms>
     {
         protected:
             boost::weak_ptr<ArtecScannerImpl> parent;
             boost::shared_ptr<ArtecScannerImpl> GetParent();
-            boost::mutex this_lock;
             bool started = false;
             bool closed = false;
             bool aborted = false;
@@ -34,21 +37,64 @@ namespace artec_scanner_robotraconteur_driver
             artec::sdk::base::TRef<artec::sdk::base::ICancellationTokenSource> ct_source;
 
             uint32_t current_algorithm = 0;
-            uint32_t last_algorithm_update = 0;
-            RobotRaconteur::TimerPtr next_timer;
 
             std::vector<artec::sdk::base::TRef<artec::sdk::algorithms::IAlgorithm> > artec_algorithms;
-
-            boost::function<void(const experimental::artec_scanner::RunAlgorithmsStatusPtr&,
-                const RobotRaconteur::RobotRaconteurExceptionPtr&)> next_handler;
+            // Requested threads_count of each algorithm, zero for the driver setting
+            std::vector<uint32_t> threads_counts;
+            // threadsCount of the running algorithm, held from the job scheduler
+            int current_threads = 0;
+
+            // Result cache key of the chain ending at each algorithm
+            std::vector<std::string> chain_keys;
+            AlgorithmResultCachePtr result_cache;
+
+            // Progress of the running algorithm, restarted for each algorithm
+            JobProgressSinkPtr progress_sink;
+            boost::chrono::steady_clock::time_point run_start;
+
+            // Job scheduler admission, held until the chain completes
+            JobTicketPtr ticket;
+            int32_t priority = 0;
+            // Set once the first algorithm job has been launched
+            bool launched = false;
+
+            int32_t input_model_handle = 0;
+            uint64_t input_model_id = 0;
+            // Keep only the models the running algorithm needs, intermediate results are not
+            // cached unless retained
+            bool release_intermediates = false;
+            // Free the input model handle once the first algorithm has completed successfully. A
+            // run that fails, is closed or is aborted before then leaves the handle valid.
+            bool release_input_model = false;
+            bool input_model_handle_freed = false;
+            // Algorithms whose output is returned as a model handle, and their outputs
+            std::vector<uint32_t> retain_intermediates;
+            std::vector<boost::shared_ptr<RRArtecModel> > retained_models;
+
+            // Fill retained_models from the result cache for the first count algorithms. Returns
+            // false if a retained result is not cached. Called with this_lock held.
+            bool load_cached_intermediates(uint32_t count);
+
+            // Free input_model_handle if release_input_model is set. Called with this_lock held.
+            void free_input_model_handle();
+
+            // Called with this_lock held
+            void fill_progress(const experimental::artec_scanner::RunAlgorithmsStatusPtr& status);
+
+            // Launch the algorithm at current_algorithm. Called with this_lock held.
+            void launch_first();
+
+            // Called from the worker pool when the job scheduler admits the chain
+            void scheduled_start();
 
         public:
             friend class RunAlgorithmsJobObserver;
 
             RunAlgorithms(boost::shared_ptr<ArtecScannerImpl> parent);
 
-            void Init(boost::shared_ptr<RRArtecModel> input_model, 
-                const RobotRaconteur::RRListPtr<RobotRaconteur::RRValue>& algorithms);
+            void Init(boost::shared_ptr<RRArtecModel> input_model, int32_t input_model_handle,
+                const RobotRaconteur::RRListPtr<RobotRaconteur::RRValue>& algorithms,
+                const experimental::artec_scanner::RunAlgorithmsOptionsPtr& options);
 
             void AsyncNext(boost::function<void(const experimental::artec_scanner::RunAlgorithmsStatusPtr&,
                 const RobotRaconteur::RobotRaconteurExceptionPtr&)> handler, int32_t timeout = RR_TIMEOUT_INFINITE )
@@ -70,7 +116,7 @@ namespace artec_scanner_robotraconteur_driver
             void complete_gen(boost::function<void(const experimental::artec_scanner::RunAlgorithmsStatusPtr&,
                 const RobotRaconteur::RobotRaconteurExceptionPtr&)> handler);
 
-            void next_timer_handler(const RobotRaconteur::TimerEvent& evt);
+            experimental::artec_scanner::RunAlgorithmsStatusPtr progress_status() override;
     };
 
     class RunAlgorithmsJobObserver : public artec::sdk::base::JobObserverBase
@@ -0,0 +1,121 @@
+#include "experimental__artec_scanner.h"
+#include "experimental__artec_scanner_stubskel.h"
+#include <artec/sdk/base/TRef.h>
+#include <artec/sdk/base/IJobObserver.h>
+#include <artec/sdk/base/AlgorithmWorkset.h>
+#include <artec/sdk/algorithms/Algorithms.h>
+#include "artec_scanner_util.h"
+#include "artec_scanner_generator.h"
+#include "artec_scanner_job_scheduler.h"
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    class ArtecScannerImpl;
+    class RRArtecModel;
+
+    // Runs algorithms arranged as a tree. Each node takes the output model of the node named
+    // by its input, or the graph input model if input is empty, and every node whose input is
+    // complete is launched immediately so independent branches run concurrently. The output
+    // models of nodes marked output, or of the leaf nodes if none are marked, are returned.
+    class RunAlgorithmGraph : public ProgressGenerator<RunAlgorithmGraph, experimental::artec_scanner::RunAlgorithmGraphStatusPtr>,
+        public RR_ENABLE_SHARED_FROM_THIS<RunAlgorithmGraph>
+    {
+        protected:
+            struct Node
+            {
+                std::string name;
+                // Index of the input node, -1 for the graph input model
+                int32_t input = -1;
+                bool output = false;
+                artec::sdk::base::TRef<artec::sdk::algorithms::IAlgorithm> algorithm;
+                // Requested threads_count, zero for the driver setting
+                uint32_t threads_count = 0;
+                // threadsCount of the running job, held from the job scheduler
+                int threads = 0;
+                // The workset must stay valid while the job runs
+                artec::sdk::base::AlgorithmWorkset workset;
+                boost::shared_ptr<RRArtecModel> output_model;
+                bool running = false;
+                bool done = false;
+            };
+
+            boost::weak_ptr<ArtecScannerImpl> parent;
+            boost::shared_ptr<ArtecScannerImpl> GetParent();
+            bool started = false;
+            bool closed = false;
+            bool aborted = false;
+            bool completed = false;
+
+            boost::shared_ptr<RRArtecModel> input_model;
+            std::vector<Node> nodes;
+            size_t running_count = 0;
+            size_t completed_count = 0;
+            // First failure, remaining nodes are cancelled
+            artec::sdk::base::ErrorCode failed_status = artec::sdk::base::ErrorCode_OK;
+            std::string failed_node;
+
+            artec::sdk::base::TRef<artec::sdk::base::ICancellationTokenSource> ct_source;
+
+            // Job scheduler admission of the whole graph, held until the graph completes
+            JobTicketPtr ticket;
+            // Set once the root nodes have been launched
+            bool launched = false;
+
+            // Called with this_lock held
+            void launch_roots();
+
+            // Called from the worker pool when the job scheduler admits the graph
+            void scheduled_start();
+
+            // Called with this_lock held
+            void launch_node(size_t index, boost::shared_ptr<RRArtecModel> node_input);
+
+            // Called with this_lock held
+            void launch_children(int32_t index, boost::shared_ptr<RRArtecModel> node_input);
+
+            bool graph_done();
+
+        public:
+            friend class RunAlgorithmGraphJobObserver;
+
+            RunAlgorithmGraph(boost::shared_ptr<ArtecScannerImpl> parent);
+
+            void Init(boost::shared_ptr<RRArtecModel> input_model,
+                const RobotRaconteur::RRListPtr<experimental::artec_scanner::AlgorithmGraphNode>& graph_nodes);
+
+            void AsyncNext(boost::function<void(const experimental::artec_scanner::RunAlgorithmGraphStatusPtr&,
+                const RobotRaconteur::RobotRaconteurExceptionPtr&)> handler, int32_t timeout = RR_TIMEOUT_INFINITE )
+                override;
+
+            void AsyncClose(boost::function<void(const RobotRaconteur::RobotRaconteurExceptionPtr& err)> handler,
+                            int32_t timeout = RR_TIMEOUT_INFINITE) override;
+
+            void AsyncAbort(boost::function<void(const RobotRaconteur::RobotRaconteurExceptionPtr& err)> handler,
+                            int32_t timeout = RR_TIMEOUT_INFINITE) override;
+
+            experimental::artec_scanner::RunAlgorithmGraphStatusPtr Next() override {return nullptr;}
+            void Close() override {}
+            void Abort() override {}
+
+        protected:
+            void node_job_complete(artec::sdk::base::ErrorCode result, uint32_t node_index);
+
+            void complete_gen(boost::function<void(const experimental::artec_scanner::RunAlgorithmGraphStatusPtr&,
+                const RobotRaconteur::RobotRaconteurExceptionPtr&)> handler);
+
+            experimental::artec_scanner::RunAlgorithmGraphStatusPtr progress_status() override;
+    };
+
+    class RunAlgorithmGraphJobObserver : public artec::sdk::base::JobObserverBase
+    {
+        boost::shared_ptr<RunAlgorithmGraph> parent;
+        uint32_t node_index;
+
+    public:
+        RunAlgorithmGraphJobObserver(boost::shared_ptr<RunAlgorithmGraph> parent, uint32_t node_index);
+
+        void completed (artec::sdk::base::ErrorCode result) override;
+    };
+}
@@ -2,11 +2,21 @@
 
 #include <artec/sdk/algorithms/IAlgorithm.h>
 #include <artec/sdk/base/ScannerType.h>
+#include <boost/thread.hpp>
+#include <boost/shared_ptr.hpp>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
 
 #pragma once
 
 namespace artec_scanner_robotraconteur_driver
 {
+    // Working memory of an algorithm job as a multiple of the input model size, used for
+    // job scheduler admission
+    const uint64_t ALGORITHM_JOB_MEMORY_FACTOR = 3;
+
     void create_fast_fusion_algorithm(artec::sdk::algorithms::IAlgorithm** alg, 
         const experimental::artec_scanner::FastFusionAlgorithmPtr& settings, 
         artec::sdk::base::ScannerType scanner_type);
@@ -51,8 +61,69 @@ namespace artec_scanner_robotraconteur_driver
         const experimental::artec_scanner::OutliersRemovalAlgorithmPtr& settings, 
         artec::sdk::base::ScannerType scanner_type);
 
+    // Create the algorithm described by one of the algorithm settings structures. If
+    // threads_count is not null it receives the threads_count from the extended map of the
+    // settings, zero if not set. Throws InvalidArgumentException for unknown structure types.
+    void create_algorithm(artec::sdk::algorithms::IAlgorithm** alg, const RobotRaconteur::RRValuePtr& settings,
+        artec::sdk::base::ScannerType scanner_type, uint32_t* threads_count = nullptr);
+
+    // Canonical key of an algorithm settings structure. Equal keys create identical algorithms
+    // for the same scanner type. Throws InvalidArgumentException for unknown structure types.
+    std::string algorithm_settings_key(const RobotRaconteur::RRValuePtr& settings);
+
     class RRArtecModel;
 
     RobotRaconteur::RRValuePtr util_initialize_algorithm(boost::shared_ptr<RRArtecModel> model, const std::string& algorithm);
 
+    // Output models of algorithm chains, keyed by the input model id and the settings keys of
+    // the chain. Models are not modified after creation, so a result stays valid for as long as
+    // it is cached. The least recently used entries are dropped beyond max_entries or once the
+    // estimated size of the cached models exceeds memory_budget. Zero max_entries disables the
+    // cache, zero memory_budget removes the size limit.
+    class AlgorithmResultCache
+    {
+        protected:
+            struct Entry
+            {
+                uint64_t input_model_id = 0;
+                boost::shared_ptr<RRArtecModel> output;
+                uint64_t bytes = 0;
+            };
+
+            boost::mutex this_lock;
+            std::map<std::string, Entry> entries;
+            // Most recently used first
+            std::list<std::string> lru;
+            size_t max_entries;
+            uint64_t memory_budget;
+            uint64_t total_bytes = 0;
+
+            // Called with this_lock held
+            void trim();
+
+            // Called with this_lock held
+            std::map<std::string, Entry>::iterator erase(std::map<std::string, Entry>::iterator e);
+
+        public:
+            AlgorithmResultCache(size_t max_entries = 0, uint64_t memory_budget = 0);
+
+            // Key of the chain made of the first count settings keys
+            static std::string chain_key(uint64_t input_model_id, const std::vector<std::string>& settings_keys,
+                size_t count);
+
+            // Returns null if the chain has not been run
+            boost::shared_ptr<RRArtecModel> get(const std::string& key);
+
+            void put(const std::string& key, uint64_t input_model_id, boost::shared_ptr<RRArtecModel> output);
+
+            // Drop the results computed from a freed model and the results that are the model
+            void remove_model(uint64_t model_id);
+
+            void set_limits(size_t max_entries, uint64_t memory_budget);
+
+            void clear();
+    };
+
+    using AlgorithmResultCachePtr = boost::shared_ptr<AlgorithmResultCache>;
+
 }
\ No newline at end of file
@@ -0,0 +1,48 @@
+#include <artec/sdk/capturing/IScanner.h>
+#include <artec/sdk/base/TRef.h>
+#include "artec_scanner_util.h"
+#include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include <vector>
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    struct RRDeferredCapture;
+
+    // Captures raw frames back to back on a dedicated thread into deferred captures allocated
+    // when the burst is created. Capturing ends once max_frames frames have been captured, no
+    // frame is dropped. A capture error also ends the burst, the frames captured before the
+    // error are kept. The burst holds the scanner until it is stopped either way.
+    class CaptureBurst
+    {
+        protected:
+            artec::sdk::base::TRef<artec::sdk::capturing::IScanner> scanner;
+            // Written only by the capture thread until it has been joined
+            std::vector<boost::shared_ptr<RRDeferredCapture> > frames;
+            boost::chrono::steady_clock::duration period;
+            boost::thread capture_thread;
+            boost::atomic<bool> stop_requested;
+            boost::atomic<uint64_t> captured_count;
+
+            void capture_thread_func();
+
+        public:
+            // rate is the maximum frames per second, zero captures as fast as the scanner allows
+            CaptureBurst(artec::sdk::capturing::IScanner* scanner, double rate, uint32_t max_frames);
+
+            void start();
+
+            // Stop the capture thread and return the captured frames in capture order. Handles
+            // are not assigned.
+            std::vector<boost::shared_ptr<RRDeferredCapture> > stop();
+
+            uint64_t get_captured_count();
+
+            ~CaptureBurst();
+    };
+
+    using CaptureBurstPtr = boost::shared_ptr<CaptureBurst>;
+}
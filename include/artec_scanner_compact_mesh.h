@@ -0,0 +1,49 @@
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    // Compact binary mesh transfer format, returned by the *_compact functions. All values are
+    // little endian.
+    //
+    //   header, 64 bytes
+    //     char[4]    magic "ACMF"
+    //     uint8      version, 1
+    //     uint8      flags, bit 0 normals present, bit 1 body is a raw deflate stream
+    //     uint8[2]   reserved
+    //     uint32     vertex count
+    //     uint32     triangle count
+    //     float64[3] position origin
+    //     float64[3] position step
+    //   body, deflated when flag bit 1 is set
+    //     uint16[3]  per vertex quantized position, position = origin + q * step
+    //     int16[2]   per vertex octahedral normal as snorm16, when flag bit 0 is set
+    //     varint[]   per triangle zigzag deltas, the first index relative to the first index
+    //                of the previous triangle and the other two relative to the first index
+    //
+    // Positions are quantized to 16 bits over the mesh bounding box. The encoder runs on the
+    // driver worker pool. The reference decoder only depends on the standard library and zlib
+    // so clients can copy it.
+
+    struct CompactMesh
+    {
+        // xyz per vertex
+        std::vector<float> vertices;
+        // xyz per vertex, empty if the encoded mesh has no normals
+        std::vector<float> normals;
+        // Three vertex indices per triangle
+        std::vector<uint32_t> triangles;
+    };
+
+    // Encode a mesh, scaling positions by scale. normals may be null. Throws
+    // std::invalid_argument if a triangle references an invalid vertex.
+    void EncodeCompactMesh(const float* points, size_t vertex_count, const float* normals,
+        const int32_t* triangles, size_t triangle_count, double scale, bool deflate, std::vector<uint8_t>& out);
+
+    // Reference decoder. Throws std::invalid_argument on malformed input, the counts in the
+    // header are checked against the payload before anything is allocated.
+    void DecodeCompactMesh(const uint8_t* data, size_t size, CompactMesh& mesh);
+}
@@ -0,0 +1,100 @@
+#include "experimental__artec_scanner.h"
+#include "experimental__artec_scanner_stubskel.h"
+#include "artec_scanner_worker_pool.h"
+#include <type_traits>
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    // Bulk conversion kernels for packed scalar arrays. Identical layouts are copied with memcpy,
+    // widening conversions use SSE2/AVX when the compiler targets them.
+    void BulkConvert(const float* src, double* dst, size_t count);
+
+    void BulkConvert(const float* src, float* dst, size_t count);
+
+    void BulkConvert(const int32_t* src, uint32_t* dst, size_t count);
+
+    void BulkConvert(const uint32_t* src, uint32_t* dst, size_t count);
+
+    // Widen packed float vectors of field_count fields to double, reading every stride-th
+    // vector and multiplying each scalar by scale. count is the number of vectors written.
+    void BulkConvertStrided(const float* src, double* dst, size_t count, size_t field_count, 
+        size_t stride, double scale);
+
+    // Arrays with at least this many elements are converted in chunks on the worker pool
+    const size_t PARALLEL_CONVERT_THRESHOLD = 262144;
+    const size_t PARALLEL_CONVERT_CHUNK = 65536;
+
+    // Convert a packed array of Artec elements (Point3F, IndexTriplet, UV coordinates) to an
+    // RR named array. src points to the first scalar of the first element, count is the number
+    // of elements. The Artec element must be packed with the same number of fields as T.
+    template<typename T, typename SrcScalar>
+    RobotRaconteur::RRNamedArrayPtr<T> ConvertPackedArrayToRR(const SrcScalar* src, size_t count)
+    {
+        typedef typename RobotRaconteur::RRPrimUtil<T>::ElementArrayType dst_scalar;
+        const size_t field_count = sizeof(T) / sizeof(dst_scalar);
+        static_assert(sizeof(T) == field_count * sizeof(dst_scalar), "Named array is not packed");
+
+        auto ret = RobotRaconteur::AllocateEmptyRRNamedArray<T>(count);
+        if (count == 0)
+        {
+            return ret;
+        }
+
+        dst_scalar* dst = ret->GetNumericArray()->data();
+        if (count < PARALLEL_CONVERT_THRESHOLD)
+        {
+            BulkConvert(src, dst, count * field_count);
+            return ret;
+        }
+
+        GetWorkerPool()->parallel_for(count, PARALLEL_CONVERT_CHUNK, [src, dst, field_count](size_t begin, size_t end)
+        {
+            BulkConvert(src + begin * field_count, dst + begin * field_count, (end - begin) * field_count);
+        });
+        return ret;
+    }
+
+    // Same as ConvertPackedArrayToRR but keeps only every stride-th of the count source elements
+    // and scales the values. Used for vertex decimation and unit conversion of float vectors.
+    template<typename T>
+    RobotRaconteur::RRNamedArrayPtr<T> ConvertStridedArrayToRR(const float* src, size_t count, size_t stride, double scale)
+    {
+        if (stride <= 1 && scale == 1.0)
+        {
+            return ConvertPackedArrayToRR<T>(src, count);
+        }
+
+        typedef typename RobotRaconteur::RRPrimUtil<T>::ElementArrayType dst_scalar;
+        static_assert(std::is_same<dst_scalar, double>::value, "Strided conversion requires double named array");
+        const size_t field_count = sizeof(T) / sizeof(dst_scalar);
+        static_assert(sizeof(T) == field_count * sizeof(dst_scalar), "Named array is not packed");
+
+        if (stride < 1)
+        {
+            stride = 1;
+        }
+        size_t out_count = (count + stride - 1) / stride;
+        auto ret = RobotRaconteur::AllocateEmptyRRNamedArray<T>(out_count);
+        if (out_count == 0)
+        {
+            return ret;
+        }
+
+        dst_scalar* dst = ret->GetNumericArray()->data();
+        if (out_count < PARALLEL_CONVERT_THRESHOLD)
+        {
+            BulkConvertStrided(src, dst, out_count, field_count, stride, scale);
+            return ret;
+        }
+
+        GetWorkerPool()->parallel_for(out_count, PARALLEL_CONVERT_CHUNK, 
+            [src, dst, field_count, stride, scale](size_t begin, size_t end)
+        {
+            BulkConvertStrided(src + begin * stride * field_count, dst + begin * field_count, end - begin, 
+                field_count, stride, scale);
+        });
+        return ret;
+    }
+}
@@ -0,0 +1,77 @@
+#include "artec_scanner_util.h"
+#include <boost/chrono.hpp>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    struct RRDeferredCapture;
+
+    // Memory accounting for the meshes and STL bytes cached on deferred captures. When the
+    // budget is exceeded, cached data is evicted in least recently used order and rebuilt from
+    // the frame on the next request. Handles that have not been accessed for the TTL are
+    // expired entirely. Not thread safe, called with the ArtecScannerImpl lock held.
+    class DeferredCaptureCache
+    {
+        protected:
+            struct Entry
+            {
+                boost::shared_ptr<RRDeferredCapture> capture;
+                std::list<int32_t>::iterator lru_position;
+                size_t cached_bytes = 0;
+                boost::chrono::steady_clock::time_point last_access;
+            };
+
+            std::unordered_map<int32_t, Entry> entries;
+            // All handles, most recently used first
+            std::list<int32_t> lru;
+            size_t cached_bytes = 0;
+
+            // Zero disables the budget and the TTL
+            size_t budget_bytes = 0;
+            boost::chrono::steady_clock::duration ttl = boost::chrono::steady_clock::duration::zero();
+
+            Entry* touch_entry(int32_t handle);
+
+            void update_cached_bytes(Entry& entry);
+
+            void evict(int32_t keep_handle);
+
+        public:
+            void set_limits(size_t budget_bytes, boost::chrono::steady_clock::duration ttl);
+
+            void add(const boost::shared_ptr<RRDeferredCapture>& capture);
+
+            void remove(int32_t handle);
+
+            void clear();
+
+            // Mark the handle as recently used
+            void touch(int32_t handle);
+
+            // Store converted data on the capture and evict other captures if over budget. Nothing
+            // is stored if the handle has been freed in the meantime.
+            void store_mesh(const boost::shared_ptr<RRDeferredCapture>& capture,
+                const com::robotraconteur::geometry::shapes::MeshPtr& mesh, const MeshConvertOptions& options);
+
+            void store_stl(const boost::shared_ptr<RRDeferredCapture>& capture,
+                const RobotRaconteur::RRArrayPtr<uint8_t>& stl_bytes);
+
+            // Captures that still hold their frame beyond the resident_limit most recently used
+            // ones, coldest first. Captures with a spill pending are skipped.
+            std::vector<boost::shared_ptr<RRDeferredCapture> > spill_candidates(size_t resident_limit);
+
+            // Remove handles not accessed within the TTL and return them
+            std::vector<int32_t> expire();
+
+            size_t get_cached_bytes();
+    };
+
+    using DeferredCaptureCachePtr = boost::shared_ptr<DeferredCaptureCache>;
+
+    // Approximate memory held by a converted mesh
+    size_t EstimateMeshBytes(const com::robotraconteur::geometry::shapes::MeshPtr& mesh);
+}
@@ -0,0 +1,70 @@
+#include <artec/sdk/capturing/IScanner.h>
+#include <artec/sdk/capturing/IFrameProcessor.h>
+#include <artec/sdk/base/TRef.h>
+#include <boost/thread.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <vector>
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    class FrameProcessorPool;
+
+    // Frame processor checked out of a FrameProcessorPool. The processor is returned to the
+    // pool when the lease is destroyed.
+    class FrameProcessorLease
+    {
+        protected:
+            boost::shared_ptr<FrameProcessorPool> pool;
+            artec::sdk::base::TRef<artec::sdk::capturing::IFrameProcessor> processor;
+
+        public:
+            FrameProcessorLease(boost::shared_ptr<FrameProcessorPool> pool,
+                artec::sdk::base::TRef<artec::sdk::capturing::IFrameProcessor> processor);
+
+            FrameProcessorLease(FrameProcessorLease&& other);
+
+            FrameProcessorLease(const FrameProcessorLease&) = delete;
+            FrameProcessorLease& operator=(const FrameProcessorLease&) = delete;
+
+            artec::sdk::capturing::IFrameProcessor* get() const;
+
+            artec::sdk::capturing::IFrameProcessor* operator->() const;
+
+            ~FrameProcessorLease();
+    };
+
+    // Pool of frame processors created from the scanner. Creating a processor is expensive,
+    // so processors are kept after use and handed to the next reconstruction. The pool grows
+    // to the peak number of concurrent reconstructions.
+    class FrameProcessorPool : public boost::enable_shared_from_this<FrameProcessorPool>
+    {
+        friend class FrameProcessorLease;
+
+        protected:
+            boost::mutex this_lock;
+            artec::sdk::base::TRef<artec::sdk::capturing::IScanner> scanner;
+            std::vector<artec::sdk::base::TRef<artec::sdk::capturing::IFrameProcessor> > idle;
+            size_t created_count = 0;
+
+            artec::sdk::base::TRef<artec::sdk::capturing::IFrameProcessor> create_processor();
+
+            void checkin(artec::sdk::base::TRef<artec::sdk::capturing::IFrameProcessor> processor);
+
+        public:
+            FrameProcessorPool(artec::sdk::capturing::IScanner* scanner);
+
+            // Create processors until at least count are idle
+            void warm_up(size_t count);
+
+            FrameProcessorLease checkout();
+
+            size_t get_created_count();
+
+            size_t get_idle_count();
+    };
+
+    using FrameProcessorPoolPtr = boost::shared_ptr<FrameProcessorPool>;
+}
@@ -0,0 +1,127 @@
+#include "experimental__artec_scanner.h"
+#include "experimental__artec_scanner_stubskel.h"
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    // Longest time a parked Next call waits for progress before a running status is returned
+    void SetGeneratorHeartbeatPeriod(const boost::posix_time::time_duration& period);
+
+    boost::posix_time::time_duration GetGeneratorHeartbeatPeriod();
+
+    // Base for the driver status generators. A Next call is parked until the generator reports
+    // progress with notify_progress(), or until the heartbeat period has elapsed. One timer is
+    // created per generator and restarted for each parked call. Derived is the generator class
+    // and must derive from RR_ENABLE_SHARED_FROM_THIS<Derived>.
+    template<typename Derived, typename T>
+    class ProgressGenerator : public RobotRaconteur::Generator<T,void>
+    {
+        public:
+            using next_handler_type = boost::function<void(const T&, const RobotRaconteur::RobotRaconteurExceptionPtr&)>;
+
+        protected:
+            boost::mutex this_lock;
+            next_handler_type next_handler;
+            // Progress reported while no Next call was parked
+            bool progress_pending = false;
+            RobotRaconteur::TimerPtr heartbeat_timer;
+
+            // Running status returned for progress and heartbeats, called with this_lock held
+            virtual T progress_status() = 0;
+
+            // Called from AsyncNext with this_lock held once the generator is running. Replies
+            // immediately if progress was reported since the last reply, otherwise parks handler.
+            void wait_progress(boost::mutex::scoped_lock& lock, next_handler_type handler)
+            {
+                if (next_handler)
+                {
+                    throw RobotRaconteur::InvalidOperationException("Next call already in progress");
+                }
+
+                if (progress_pending)
+                {
+                    progress_pending = false;
+                    T ret = progress_status();
+                    lock.unlock();
+                    handler(ret, nullptr);
+                    return;
+                }
+
+                next_handler = handler;
+                start_heartbeat();
+            }
+
+            // Complete a parked Next call with the current status. Must not be called with this_lock held.
+            void notify_progress()
+            {
+                boost::mutex::scoped_lock lock(this_lock);
+                if (!next_handler)
+                {
+                    progress_pending = true;
+                    return;
+                }
+                next_handler_type h = take_next_handler();
+                T ret = progress_status();
+                lock.unlock();
+                h(ret, nullptr);
+            }
+
+            // Remove the parked handler so the caller can complete it, called with this_lock held
+            next_handler_type take_next_handler()
+            {
+                stop_heartbeat();
+                next_handler_type h = next_handler;
+                next_handler.clear();
+                progress_pending = false;
+                return h;
+            }
+
+            void start_heartbeat()
+            {
+                if (!heartbeat_timer)
+                {
+                    boost::weak_ptr<Derived> weak_this = static_cast<Derived*>(this)->shared_from_this();
+                    heartbeat_timer = RobotRaconteur::RobotRaconteurNode::s()->CreateTimer(GetGeneratorHeartbeatPeriod(),
+                        [weak_this](const RobotRaconteur::TimerEvent& evt) {
+                            auto t = weak_this.lock();
+                            if (!t) return;
+                            t->heartbeat_timer_handler(evt);
+                    }, true);
+                }
+                heartbeat_timer->Start();
+            }
+
+            void stop_heartbeat()
+            {
+                if (!heartbeat_timer)
+                {
+                    return;
+                }
+                try
+                {
+                    heartbeat_timer->Stop();
+                }
+                catch (std::exception&) {}
+            }
+
+            void heartbeat_timer_handler(const RobotRaconteur::TimerEvent& evt)
+            {
+                if (evt.stopped)
+                {
+                    return;
+                }
+                boost::mutex::scoped_lock lock(this_lock);
+                if (!next_handler)
+                {
+                    return;
+                }
+                next_handler_type h = next_handler;
+                next_handler.clear();
+                T ret = progress_status();
+                lock.unlock();
+                h(ret, nullptr);
+            }
+    };
+}
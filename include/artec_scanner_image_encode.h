@@ -0,0 +1,23 @@
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    // Texture encoders that operate on tightly packed 8-bit RGB pixels.
+
+    // Baseline JPEG through libjpeg, 4:4:4 YCbCr. quality is 1 to 100 using the IJG quality
+    // scaling.
+    void EncodeJpeg(const uint8_t* rgb, size_t width, size_t height, int quality, std::vector<uint8_t>& out);
+
+    // PNG with the Sub filter, deflated by zlib at the fastest level. The image is split into
+    // independent row bands that are compressed concurrently on the worker pool. Compresses
+    // less than libpng defaults but scales with the worker threads.
+    void EncodePngFast(const uint8_t* rgb, size_t width, size_t height, std::vector<uint8_t>& out);
+
+    // Raw deflate stream (RFC 1951) of arbitrary bytes, appended to out. Uses the same band
+    // compressor as EncodePngFast.
+    void DeflateFast(const uint8_t* data, size_t size, std::vector<uint8_t>& out);
+}
@@ -3,13 +3,30 @@
 #include <artec/sdk/capturing/IScanner.h>
 #include <artec/sdk/base/TRef.h>
 #include "artec_scanner_util.h"
+#include "artec_scanner_frame_processor_pool.h"
+#include "artec_scanner_telemetry.h"
+#include "artec_scanner_preview.h"
+#include "artec_scanner_capture_burst.h"
+#include "artec_scanner_pipelined_capture.h"
+#include "artec_scanner_deferred_cache.h"
+#include "artec_scanner_spill_store.h"
+#include "artec_scanner_worker_pool.h"
+#include "artec_scanner_mesh_lod.h"
+#include "artec_scanner_algorithm_util.h"
+#include "artec_scanner_job_scheduler.h"
 
 namespace artec_scanner_robotraconteur_driver
 {
+    class ArtecScannerImpl;
+
     class RRArtecModel : public experimental::artec_scanner::Model_default_impl
     {
     public:
         artec::sdk::base::TRef<artec::sdk::base::IModel> model;
+        boost::weak_ptr<ArtecScannerImpl> parent;
+        MeshLodCachePtr lod_cache;
+        // Unique for the lifetime of the driver, identifies the model in algorithm result keys
+        uint64_t model_id;
 
         RRArtecModel();
 
@@ -27,15 +44,21 @@ namespace artec_scanner_robotraconteur_driver
     {  
     public:
         artec::sdk::base::IScan* scan;
+        boost::weak_ptr<ArtecScannerImpl> parent;
 
-        RRScan(artec::sdk::base::IScan* scan);
+        RRScan(artec::sdk::base::IScan* scan, boost::weak_ptr<ArtecScannerImpl> parent);
 
         com::robotraconteur::geometry::Transform get_scan_transform() override;
         uint32_t get_frame_count() override;
         com::robotraconteur::geometry::shapes::MeshPtr getf_frame_mesh(uint32_t ind) override;
 
+        com::robotraconteur::geometry::shapes::MeshPtr getf_frame_mesh_ex(uint32_t ind,
+            const experimental::artec_scanner::MeshExportOptionsPtr& options) override;
+
         RobotRaconteur::RRArrayPtr<uint8_t > getf_frame_mesh_stl(uint32_t ind) override;
 
+        RobotRaconteur::RRArrayPtr<uint8_t > getf_frame_mesh_compact(uint32_t ind, RobotRaconteur::rr_bool deflate) override;
+
         com::robotraconteur::geometry::Transform getf_frame_transform(uint32_t ind) override;
     };
 
@@ -43,15 +66,33 @@ namespace artec_scanner_robotraconteur_driver
     {
     public:
         artec::sdk::base::ICompositeContainer *container;
+        boost::weak_ptr<ArtecScannerImpl> parent;
+        MeshLodCachePtr lod_cache;
+
+        RRCompositeContainer(artec::sdk::base::ICompositeContainer *container, boost::weak_ptr<ArtecScannerImpl> parent,
+            MeshLodCachePtr lod_cache);
 
-        RRCompositeContainer(artec::sdk::base::ICompositeContainer *container);
+        // Null if the mesh already has no more than target_triangles triangles
+        LodMeshPtr composite_mesh_lod(uint32_t ind, uint32_t target_triangles);
 
         uint32_t get_composite_mesh_count() override;
         com::robotraconteur::geometry::Transform get_composite_container_transform() override;
         com::robotraconteur::geometry::shapes::MeshPtr getf_composite_mesh(uint32_t ind) override;
 
+        com::robotraconteur::geometry::shapes::MeshPtr getf_composite_mesh_ex(uint32_t ind,
+            const experimental::artec_scanner::MeshExportOptionsPtr& options) override;
+
         RobotRaconteur::RRArrayPtr<uint8_t> getf_composite_mesh_stl(uint32_t ind) override;
 
+        RobotRaconteur::RRArrayPtr<uint8_t> getf_composite_mesh_compact(uint32_t ind, RobotRaconteur::rr_bool deflate) override;
+
+        com::robotraconteur::geometry::shapes::MeshPtr getf_composite_mesh_lod(uint32_t ind, uint32_t target_triangles) override;
+
+        RobotRaconteur::RRArrayPtr<uint8_t> getf_composite_mesh_lod_stl(uint32_t ind, uint32_t target_triangles) override;
+
+        RobotRaconteur::GeneratorPtr<experimental::artec_scanner::CompositeMeshChunkPtr,void> 
+            composite_mesh_stream(uint32_t ind, uint32_t chunk_triangles) override;
+
         com::robotraconteur::geometry::Transform getf_composite_mesh_transform(uint32_t ind) override;
 
     };
@@ -59,13 +100,20 @@ namespace artec_scanner_robotraconteur_driver
 
     class ScanningProcedure;
     class RunAlgorithms;
+    class RunAlgorithmGraph;
     class DeferredCapturePrepare;
+    class DeferredCapturePrepareStream;
+    class DeferredCapturePrepareWorker;
 
     struct RRDeferredCapture
     {
         int32_t handle = -1;
         artec::sdk::base::TRef<artec::sdk::capturing::IFrame> frame;
+        // Set when the frame has been moved to the frame spill store and released
+        bool spilled = false;
+        bool spill_pending = false;
         com::robotraconteur::geometry::shapes::MeshPtr mesh;
+        MeshConvertOptions mesh_options;
         RobotRaconteur::RRArrayPtr<uint8_t> mesh_stl_bytes;
     };
 
@@ -77,41 +125,145 @@ namespace artec_scanner_robotraconteur_driver
 
         private:
             artec::sdk::base::TRef<artec::sdk::capturing::IScanner> scanner = nullptr;
-            artec::sdk::base::TRef<artec::sdk::capturing::IFrameProcessor> processor = nullptr;
+            FrameProcessorPoolPtr frame_processors;
+            FrameTelemetryPublisherPtr frame_telemetry_publisher;
+            ScanPreviewPublisherPtr scan_preview_publisher;
 
             int32_t add_model(RRArtecModelPtr model);
                         
             int32_t handle_cnt = 100;
             std::map<int32_t,RRArtecModelPtr> models;
             std::map<int32_t,RRDeferredCapturePtr> deferred_captures;
-
+            DeferredCaptureCachePtr deferred_cache;
+
+            // Frames beyond resident_frame_limit are spilled to disk in least recently used
+            // order. Spilling is disabled when spill_store is not set.
+            FrameSpillStorePtr spill_store;
+            size_t resident_frame_limit = 0;
+            WorkerQueuePtr spill_queue;
+
+            AlgorithmResultCachePtr algorithm_cache;
+
+            // Admission control shared by scanning procedures and algorithm runs
+            JobSchedulerPtr job_scheduler;
+
             boost::mutex this_lock;
 
-            boost::optional<boost::filesystem::path> save_path;
+            // Active capture burst or pipelined capture, the scanner is not available for other
+            // captures while either is set
+            CaptureBurstPtr capture_burst;
+            PipelinedCapturePtr pipelined_capture;
+            // Set by the caller that claimed stopping the capture burst, other callers fail
+            // instead of joining the capture thread again
+            bool capture_burst_stopping = false;
+            // Same for the pipelined capture
+            bool pipelined_capture_stopping = false;
+            RobotRaconteur::PipeBroadcasterPtr<experimental::artec_scanner::PipelinedCaptureResultPtr> pipelined_capture_broadcaster;
+
+            boost::optional<boost::filesystem::path> save_path;
+
+            MeshConvertOptions mesh_options;
 
             void deferred_capture_to_iframemesh(const RRDeferredCapturePtr& deferred_capture, artec::sdk::base::IFrameMesh** frame_mesh);
 
             RRDeferredCapturePtr get_deferred_capture(int32_t deferred_capture_handle);
+
+            // Called with this_lock held
+            void add_deferred_capture(const RRDeferredCapturePtr& capture);
+
+            // Called with this_lock held
+            void expire_deferred_captures();
+
+            // Called with this_lock held
+            void schedule_frame_spill();
+
+            void spill_deferred_frame(const RRDeferredCapturePtr& capture);
+
+            void check_scanner_idle();
+
+            com::robotraconteur::geometry::shapes::MeshPtr capture_mesh(bool with_texture, const MeshConvertOptions& options);
+
+            com::robotraconteur::geometry::shapes::MeshPtr deferred_capture_mesh(const RRDeferredCapturePtr& capture, 
+                const MeshConvertOptions& options);
 
         public:
             friend class ScanningProcedure;
             friend class RunAlgorithms;
+            friend class RunAlgorithmGraph;
             friend class DeferredCapturePrepare;
+            friend class DeferredCapturePrepareStream;
+            friend class DeferredCapturePrepareWorker;
 
             void Init(artec::sdk::capturing::IScanner* scanner);
 
             void set_save_path(boost::optional<boost::filesystem::path> save_path);
 
+            // Memory budget for cached deferred capture meshes and STL bytes, and the time after
+            // which unused deferred capture handles are freed. Zero disables either limit.
+            void set_deferred_capture_limits(size_t cache_budget_bytes, boost::chrono::steady_clock::duration ttl);
+
+            // Keep the frames of at most resident_frame_limit deferred captures in memory and
+            // spill colder frames to a file under the project save path. Zero disables spilling.
+            void set_deferred_frame_spill(size_t resident_frame_limit);
+
+            // Number and estimated memory of algorithm chain results kept for reuse by
+            // run_algorithms. Zero max_entries disables the cache, zero memory_budget removes the
+            // memory limit.
+            void set_algorithm_cache_limits(size_t max_entries, uint64_t memory_budget);
+
+            // Limit the number of algorithm jobs running at once and the estimated memory they
+            // use. Scanning procedures are always admitted. Zero disables either limit.
+            void set_job_limits(size_t max_concurrent, uint64_t memory_budget);
+
+            MeshConvertOptions get_mesh_convert_options();
+
+            experimental::artec_scanner::TextureEncoding::TextureEncoding get_texture_encoding() override;
+
+            void set_texture_encoding(experimental::artec_scanner::TextureEncoding::TextureEncoding value) override;
+
+            int32_t get_texture_jpeg_quality() override;
+
+            void set_texture_jpeg_quality(int32_t value) override;
+
+            RobotRaconteur::PipePtr<experimental::artec_scanner::FrameTelemetryPtr> get_frame_telemetry() override;
+
+            void set_frame_telemetry(const RobotRaconteur::PipePtr<experimental::artec_scanner::FrameTelemetryPtr>& value) override;
+
+            RobotRaconteur::PipePtr<experimental::artec_scanner::ScanPreviewPtr> get_scan_preview() override;
+
+            void set_scan_preview(const RobotRaconteur::PipePtr<experimental::artec_scanner::ScanPreviewPtr>& value) override;
+
             com::robotraconteur::geometry::shapes::MeshPtr capture(RobotRaconteur::rr_bool with_texture) override;
 
             RobotRaconteur::RRArrayPtr<uint8_t> capture_stl() override;
+
+            com::robotraconteur::geometry::shapes::MeshPtr capture_ex(RobotRaconteur::rr_bool with_texture,
+                const experimental::artec_scanner::MeshExportOptionsPtr& options) override;
 
             int32_t capture_deferred(RobotRaconteur::rr_bool with_texture) override;
 
+            void start_capture_burst(double rate, uint32_t max_frames) override;
+
+            RobotRaconteur::RRArrayPtr<int32_t> stop_capture_burst() override;
+
+            void start_pipelined_capture(RobotRaconteur::rr_bool with_texture, uint32_t max_frames) override;
+
+            void stop_pipelined_capture() override;
+
+            RobotRaconteur::PipePtr<experimental::artec_scanner::PipelinedCaptureResultPtr> get_pipelined_capture() override;
+
+            void set_pipelined_capture(const RobotRaconteur::PipePtr<experimental::artec_scanner::PipelinedCaptureResultPtr>& value) override;
+
             com::robotraconteur::geometry::shapes::MeshPtr getf_deferred_capture(int32_t deferred_capture_handle) override;
 
+            com::robotraconteur::geometry::shapes::MeshPtr getf_deferred_capture_ex(int32_t deferred_capture_handle,
+                const experimental::artec_scanner::MeshExportOptionsPtr& options) override;
+
             RobotRaconteur::RRArrayPtr<uint8_t > getf_deferred_capture_stl(int32_t deferred_capture_handle) override;
 
+            RobotRaconteur::RRArrayPtr<uint8_t > getf_deferred_capture_compact(int32_t deferred_capture_handle,
+                RobotRaconteur::rr_bool deflate) override;
+
             void deferred_capture_free(const RobotRaconteur::RRArrayPtr<int32_t>& deferred_capture_handle) override;
 
             RobotRaconteur::GeneratorPtr<experimental::artec_scanner::DeferredCapturePrepareStatusPtr,void> 
@@ -122,6 +274,14 @@ namespace artec_scanner_robotraconteur_driver
                 deferred_capture_prepare_stl(const RobotRaconteur::RRArrayPtr<int32_t >& deferred_capture_handles)
                 override;
 
+            RobotRaconteur::GeneratorPtr<experimental::artec_scanner::DeferredCaptureResultPtr,void> 
+                deferred_capture_prepare_stream(const RobotRaconteur::RRArrayPtr<int32_t >& deferred_capture_handles)
+                override;
+
+            RobotRaconteur::GeneratorPtr<experimental::artec_scanner::DeferredCaptureResultPtr,void> 
+                deferred_capture_prepare_stream_stl(const RobotRaconteur::RRArrayPtr<int32_t >& deferred_capture_handles)
+                override;
+
 
             RobotRaconteur::GeneratorPtr<experimental::artec_scanner::ScanningProcedureStatusPtr,void>
                 run_scanning_procedure(const experimental::artec_scanner::ScanningProcedureSettingsPtr& settings) 
@@ -139,6 +299,14 @@ namespace artec_scanner_robotraconteur_driver
             RobotRaconteur::GeneratorPtr<experimental::artec_scanner::RunAlgorithmsStatusPtr,void >
                 run_algorithms(int32_t input_model_handle, const RobotRaconteur::RRListPtr<RobotRaconteur::RRValue>& algorithms) override;
 
+            RobotRaconteur::GeneratorPtr<experimental::artec_scanner::RunAlgorithmsStatusPtr,void >
+                run_algorithms_ex(int32_t input_model_handle, const RobotRaconteur::RRListPtr<RobotRaconteur::RRValue>& algorithms,
+                    const experimental::artec_scanner::RunAlgorithmsOptionsPtr& options) override;
+
+            RobotRaconteur::GeneratorPtr<experimental::artec_scanner::RunAlgorithmGraphStatusPtr,void >
+                run_algorithm_graph(int32_t input_model_handle,
+                    const RobotRaconteur::RRListPtr<experimental::artec_scanner::AlgorithmGraphNode>& nodes) override;
+
             void free_all() override;
 
             virtual ~ArtecScannerImpl();
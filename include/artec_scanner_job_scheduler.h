@@ -0,0 +1,117 @@
+#include <boost/thread.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <set>
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    class JobScheduler;
+
+    // Admission of one job, held by the generator running it. Destroying the ticket releases
+    // the job's slot and memory, or removes it from the queue if it has not been admitted.
+    class JobTicket
+    {
+        friend class JobScheduler;
+
+        protected:
+            boost::weak_ptr<JobScheduler> scheduler;
+            uint64_t id = 0;
+
+        public:
+            JobTicket(boost::shared_ptr<JobScheduler> scheduler, uint64_t id);
+
+            // Zero once admitted, otherwise the position in the queue starting at one
+            int32_t get_queue_position();
+
+            // threadsCount for an algorithm job launched under this ticket, see
+            // AlgorithmJobThreadCount. The threads count against the budget shared by all running
+            // jobs until they are released or the ticket is destroyed.
+            int acquire_algorithm_threads(uint32_t requested);
+
+            void release_algorithm_threads(int count);
+
+            ~JobTicket();
+    };
+
+    using JobTicketPtr = boost::shared_ptr<JobTicket>;
+
+    // Driver wide admission control for Artec jobs. Jobs are admitted in priority order, first
+    // come first served within a priority, while fewer than max_concurrent jobs are running and
+    // the memory estimates of the running jobs stay within memory_budget. A job larger than the
+    // budget is admitted once nothing else runs. Only the head of the queue is admitted so large
+    // jobs are not starved by smaller ones. Zero disables either limit. Jobs admitted with
+    // admit_unlimited do not count against either limit.
+    class JobScheduler : public boost::enable_shared_from_this<JobScheduler>
+    {
+        friend class JobTicket;
+
+        protected:
+            struct QueuedJob
+            {
+                uint64_t id;
+                int32_t priority;
+                uint64_t memory_estimate;
+                boost::function<void()> start;
+            };
+
+            struct AdmittedJob
+            {
+                uint64_t memory_estimate = 0;
+                // Algorithm threads held by the job's running Artec jobs
+                uint32_t threads = 0;
+            };
+
+            boost::mutex this_lock;
+            std::list<QueuedJob> queue;
+            std::map<uint64_t, AdmittedJob> admitted;
+            // Admitted jobs that do not count against the limits
+            std::set<uint64_t> unlimited;
+            uint64_t memory_in_use = 0;
+            uint32_t threads_in_use = 0;
+            uint64_t next_id = 1;
+            size_t max_concurrent;
+            uint64_t memory_budget;
+
+            // Called with this_lock held
+            bool can_admit(uint64_t memory_estimate);
+
+            // Admit jobs from the head of the queue and post their start functions to the worker
+            // pool. Called with this_lock held.
+            void admit_queued();
+
+            // Called with this_lock held
+            void insert_admitted(uint64_t id, uint64_t memory_estimate);
+
+            void release(uint64_t id);
+
+            int32_t get_queue_position(uint64_t id);
+
+            int acquire_algorithm_threads(uint64_t id, uint32_t requested);
+
+            void release_algorithm_threads(uint64_t id, int count);
+
+        public:
+            JobScheduler(size_t max_concurrent = 0, uint64_t memory_budget = 0);
+
+            void set_limits(size_t max_concurrent, uint64_t memory_budget);
+
+            // Queue a job. If the job can run right away admitted_now is set and the caller starts
+            // the job itself, otherwise start is called from a worker thread once the job is
+            // admitted. start must not be called with locks held that the caller of submit holds.
+            JobTicketPtr submit(int32_t priority, uint64_t memory_estimate, boost::function<void()> start,
+                bool& admitted_now);
+
+            // Admit a job right away without counting it against max_concurrent or the memory
+            // budget. Used for scanning procedures, which have to keep up with the scanner and
+            // can not run more than one at a time anyway.
+            JobTicketPtr admit_unlimited();
+    };
+
+    using JobSchedulerPtr = boost::shared_ptr<JobScheduler>;
+}
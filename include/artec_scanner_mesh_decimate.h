@@ -0,0 +1,28 @@
+#include <boost/shared_ptr.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    // Reduced detail mesh in Artec units
+    struct LodMesh
+    {
+        // xyz per vertex
+        std::vector<float> points;
+        // Three vertex indices per triangle
+        std::vector<int32_t> triangles;
+    };
+
+    using LodMeshPtr = boost::shared_ptr<const LodMesh>;
+
+    // Vertex clustering decimation. Vertices are merged per cell of a uniform grid over the
+    // bounding box, placed at the mean of the merged vertices, and triangles that collapse or
+    // duplicate another triangle are dropped. The grid resolution is searched for the finest
+    // grid with at most target_triangles triangles. Meshes already within the target are copied.
+    // Throws std::invalid_argument if a triangle references a vertex out of range.
+    void ClusterDecimateMesh(const float* points, size_t vertex_count, const int32_t* triangles,
+        size_t triangle_count, size_t target_triangles, LodMesh& out);
+}
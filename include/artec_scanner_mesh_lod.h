@@ -0,0 +1,47 @@
+#include "experimental__artec_scanner.h"
+#include "experimental__artec_scanner_stubskel.h"
+#include "artec_scanner_util.h"
+#include "artec_scanner_mesh_decimate.h"
+#include <boost/thread.hpp>
+#include <boost/shared_ptr.hpp>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <vector>
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    com::robotraconteur::geometry::shapes::MeshPtr ConvertLodMeshToRR(const LodMesh& mesh, const MeshConvertOptions& options);
+
+    // Reduced detail composite meshes of one model, keyed by mesh index and target triangle
+    // count. Models are not modified after creation so entries stay valid for the model's
+    // lifetime. The least recently used entries are dropped beyond max_entries or once the
+    // entries hold more than max_bytes. A single entry larger than max_bytes is not cached.
+    class MeshLodCache
+    {
+        protected:
+            using key_type = std::pair<uint32_t, uint32_t>;
+
+            boost::mutex this_lock;
+            std::map<key_type, LodMeshPtr> lods;
+            // Most recently used first
+            std::list<key_type> lru;
+            size_t max_entries;
+            uint64_t max_bytes;
+            uint64_t bytes = 0;
+
+            static uint64_t lod_bytes(const LodMeshPtr& lod);
+
+        public:
+            MeshLodCache(size_t max_entries = 16, uint64_t max_bytes = 128ull * 1024 * 1024);
+
+            // Returns null if the level has not been built
+            LodMeshPtr get(uint32_t ind, uint32_t target_triangles);
+
+            void put(uint32_t ind, uint32_t target_triangles, LodMeshPtr lod);
+    };
+
+    using MeshLodCachePtr = boost::shared_ptr<MeshLodCache>;
+}
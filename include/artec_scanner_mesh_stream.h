@@ -0,0 +1,61 @@
+#include "experimental__artec_scanner.h"
+#include "experimental__artec_scanner_stubskel.h"
+#include <artec/sdk/base/ICompositeMesh.h>
+#include <artec/sdk/base/TArrayRef.h>
+#include <artec/sdk/base/TRef.h>
+#include "artec_scanner_util.h"
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    // Streams a composite mesh as chunks of up to chunk_triangles triangles. Each chunk carries
+    // only the vertices its triangles reference. Triangles index into the chunk vertices, and
+    // vertex_indices maps each chunk vertex back to its index in the full mesh so clients can
+    // weld the chunks. Only the chunk being sent is converted, so memory scales with the chunk
+    // size instead of the mesh size. Textures are not streamed.
+    class CompositeMeshStream : public RobotRaconteur::Generator<experimental::artec_scanner::CompositeMeshChunkPtr,void>,
+        public RR_ENABLE_SHARED_FROM_THIS<CompositeMeshStream>
+    {
+        protected:
+            boost::mutex this_lock;
+            artec::sdk::base::TRef<artec::sdk::base::ICompositeMesh> mesh;
+            // Keep the arrays alive, chunks read them through the pointers below
+            artec::sdk::base::TArrayPoint3F points;
+            artec::sdk::base::TArrayPoint3F points_normals;
+            artec::sdk::base::TArrayIndexTriplet triangles;
+            const artec::sdk::base::Point3F* points_p = nullptr;
+            const artec::sdk::base::Point3F* normals_p = nullptr;
+            const int32_t* triangles_p = nullptr;
+            size_t vertex_count = 0;
+            size_t triangle_count = 0;
+
+            MeshConvertOptions options;
+            uint32_t chunk_triangles;
+            uint32_t chunk_count;
+            uint32_t next_chunk = 0;
+            bool busy = false;
+            bool closed = false;
+            bool aborted = false;
+
+            experimental::artec_scanner::CompositeMeshChunkPtr build_chunk(uint32_t chunk_index);
+
+        public:
+            CompositeMeshStream(artec::sdk::base::ICompositeMesh* mesh, const MeshConvertOptions& options,
+                uint32_t chunk_triangles);
+
+            void AsyncNext(boost::function<void(const experimental::artec_scanner::CompositeMeshChunkPtr&,
+                const RobotRaconteur::RobotRaconteurExceptionPtr&)> handler, int32_t timeout = RR_TIMEOUT_INFINITE )
+                override;
+
+            void AsyncClose(boost::function<void(const RobotRaconteur::RobotRaconteurExceptionPtr& err)> handler,
+                            int32_t timeout = RR_TIMEOUT_INFINITE) override;
+
+            void AsyncAbort(boost::function<void(const RobotRaconteur::RobotRaconteurExceptionPtr& err)> handler,
+                            int32_t timeout = RR_TIMEOUT_INFINITE) override;
+
+            experimental::artec_scanner::CompositeMeshChunkPtr Next() override {return nullptr;}
+            void Close() override {}
+            void Abort() override {}
+    };
+}
@@ -0,0 +1,103 @@
+#include <boost/atomic.hpp>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    // Fixed capacity ring where producers never block and overwrite the oldest entries. Each
+    // slot is a seqlock, so a single consumer detects entries that were overwritten while it
+    // was reading them and skips them. T must be trivially copyable.
+    template<typename T>
+    class OverwriteRing
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "OverwriteRing requires trivially copyable entries");
+
+        protected:
+            struct Slot
+            {
+                // 2*index+1 while entry index is being written, 2*index+2 once complete
+                boost::atomic<uint64_t> seq;
+                T value;
+
+                Slot() : seq(0) {}
+            };
+
+            std::vector<Slot> slots;
+            uint64_t mask;
+            boost::atomic<uint64_t> write_index;
+
+        public:
+            // capacity is rounded up to a power of two
+            OverwriteRing(size_t capacity) : write_index(0)
+            {
+                size_t c = 1;
+                while (c < capacity)
+                {
+                    c <<= 1;
+                }
+                slots = std::vector<Slot>(c);
+                mask = c - 1;
+            }
+
+            size_t capacity() const
+            {
+                return slots.size();
+            }
+
+            // Safe to call from any number of threads
+            void push(const T& value)
+            {
+                uint64_t index = write_index.fetch_add(1, boost::memory_order_relaxed);
+                Slot& s = slots[index & mask];
+                s.seq.store(2 * index + 1, boost::memory_order_relaxed);
+                boost::atomic_thread_fence(boost::memory_order_release);
+                s.value = value;
+                s.seq.store(2 * index + 2, boost::memory_order_release);
+            }
+
+            // Consumer side. Reads the next entry at or after read_index into value and advances
+            // read_index past it. Entries that were overwritten are skipped and counted in dropped.
+            // Returns false if no complete entry is available yet.
+            bool pop(uint64_t& read_index, T& value, uint64_t& dropped)
+            {
+                while (true)
+                {
+                    uint64_t w = write_index.load(boost::memory_order_acquire);
+                    if (read_index >= w)
+                    {
+                        return false;
+                    }
+                    if (w - read_index > slots.size())
+                    {
+                        dropped += w - slots.size() - read_index;
+                        read_index = w - slots.size();
+                    }
+
+                    Slot& s = slots[read_index & mask];
+                    uint64_t expected = 2 * read_index + 2;
+                    uint64_t s1 = s.seq.load(boost::memory_order_acquire);
+                    if (s1 < expected)
+                    {
+                        // Producer has claimed the slot but not finished writing
+                        return false;
+                    }
+                    if (s1 == expected)
+                    {
+                        value = s.value;
+                        boost::atomic_thread_fence(boost::memory_order_acquire);
+                        if (s.seq.load(boost::memory_order_relaxed) == s1)
+                        {
+                            read_index++;
+                            return true;
+                        }
+                    }
+                    // Overwritten by a newer entry, skip it
+                    dropped++;
+                    read_index++;
+                }
+            }
+    };
+}
@@ -0,0 +1,66 @@
+#include "experimental__artec_scanner.h"
+#include "experimental__artec_scanner_stubskel.h"
+#include <artec/sdk/capturing/IScanner.h>
+#include <artec/sdk/capturing/IFrame.h>
+#include <artec/sdk/base/TRef.h>
+#include "artec_scanner_util.h"
+#include "artec_scanner_worker_pool.h"
+#include "artec_scanner_frame_processor_pool.h"
+#include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+#include <map>
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    // Captures frames on a dedicated thread while earlier frames are reconstructed and
+    // converted on the worker pool. Up to max_in_flight frames are reconstructed at once, the
+    // capture thread waits for a free slot before acquiring the next frame. Results are
+    // reordered and sent on the pipelined_capture pipe in capture order.
+    class PipelinedCapture : public RR_ENABLE_SHARED_FROM_THIS<PipelinedCapture>
+    {
+        protected:
+            artec::sdk::base::TRef<artec::sdk::capturing::IScanner> scanner;
+            FrameProcessorPoolPtr frame_processors;
+            RobotRaconteur::PipeBroadcasterPtr<experimental::artec_scanner::PipelinedCaptureResultPtr> broadcaster;
+            MeshConvertOptions mesh_options;
+            bool with_texture;
+            uint32_t max_frames;
+            size_t max_in_flight;
+
+            WorkerQueuePtr queue;
+            boost::thread capture_thread;
+            boost::atomic<bool> stop_requested;
+
+            boost::mutex this_lock;
+            boost::condition_variable in_flight_cv;
+            size_t in_flight = 0;
+            // Results that completed ahead of an earlier frame, keyed by sequence number
+            std::map<uint64_t, experimental::artec_scanner::PipelinedCaptureResultPtr> completed;
+            uint64_t next_send = 0;
+
+            void capture_thread_func();
+
+            void process_frame(uint64_t sequence_number, artec::sdk::base::TRef<artec::sdk::capturing::IFrame> frame);
+
+            void complete_frame(const experimental::artec_scanner::PipelinedCaptureResultPtr& result);
+
+        public:
+            // max_frames of zero captures until stopped
+            PipelinedCapture(artec::sdk::capturing::IScanner* scanner, FrameProcessorPoolPtr frame_processors,
+                RobotRaconteur::PipeBroadcasterPtr<experimental::artec_scanner::PipelinedCaptureResultPtr> broadcaster,
+                const MeshConvertOptions& mesh_options, bool with_texture, uint32_t max_frames, size_t max_in_flight);
+
+            void start();
+
+            // Stop capturing and wait for the frames in flight to be sent. Must be called to
+            // release the capture, the capture thread holds a reference until it exits. Only
+            // the first call stops the capture, later calls return immediately.
+            void stop();
+
+            ~PipelinedCapture();
+    };
+
+    using PipelinedCapturePtr = boost::shared_ptr<PipelinedCapture>;
+}
@@ -0,0 +1,111 @@
+#include "experimental__artec_scanner.h"
+#include "experimental__artec_scanner_stubskel.h"
+#include <artec/sdk/scanning/IScanningProcedureObserver.h>
+#include "artec_scanner_worker_pool.h"
+#include <boost/chrono.hpp>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    struct ScanPreviewSettings
+    {
+        // Maximum previews per second, zero disables the preview
+        double rate = 0.0;
+        uint32_t point_budget = 5000;
+        // Initial voxel edge length in meters, grown until the point budget is met
+        double voxel_size = 0.005;
+    };
+
+    // Read preview_rate, preview_point_budget and preview_voxel_size from the
+    // ScanningProcedureSettings extended map
+    ScanPreviewSettings GetScanPreviewSettings(const RobotRaconteur::RRMapPtr<std::string,RobotRaconteur::RRValue>& extended);
+
+    // Voxel set of points accumulated over many frames. Each voxel keeps the mean of the points
+    // added to it. When the set grows beyond point_budget voxels the voxel size is increased and
+    // the existing voxels are merged into the coarser grid.
+    class VoxelAccumulator
+    {
+        protected:
+            struct Voxel
+            {
+                double sum[3];
+                uint64_t count;
+            };
+
+            std::unordered_map<uint64_t, Voxel> voxels;
+            double voxel_size = 0.005;
+            size_t point_budget = 0;
+            uint64_t source_count = 0;
+
+            void regrid(double new_voxel_size);
+
+        public:
+            void reset(double voxel_size, size_t point_budget);
+
+            void add(const std::vector<float>& points);
+
+            // Voxel means as packed xyz triples, at most point_budget points
+            void get_points(std::vector<float>& out) const;
+
+            double get_voxel_size() const;
+
+            // Number of points added since the last reset
+            uint64_t get_source_count() const;
+    };
+
+    // Publishes the points of the registered frames of a scanning procedure on the scan_preview
+    // pipe, accumulated in scan coordinates and decimated to the point budget. The observer
+    // callback only copies the frame points of rate accepted frames. Accumulation runs on the
+    // worker pool, frames that arrive meanwhile are queued up to a small limit.
+    class ScanPreviewPublisher : public RR_ENABLE_SHARED_FROM_THIS<ScanPreviewPublisher>
+    {
+        protected:
+            struct PendingFrame
+            {
+                // Scanner coordinates
+                std::vector<float> points;
+                double transform[16];
+                int32_t frame_number;
+                uint32_t frame_count;
+                ScanPreviewSettings settings;
+            };
+
+            boost::mutex this_lock;
+            RobotRaconteur::PipeBroadcasterPtr<experimental::artec_scanner::ScanPreviewPtr> broadcaster;
+            WorkerQueuePtr queue;
+
+            // Guarded by this_lock
+            std::deque<PendingFrame> pending;
+            bool reset_pending = true;
+            bool work_posted = false;
+            bool accepted_any = false;
+            boost::chrono::steady_clock::time_point last_accepted;
+
+            // Only accessed by the posted work, which runs one at a time
+            std::deque<PendingFrame> work_frames;
+            VoxelAccumulator accumulator;
+            std::vector<float> preview_points;
+            uint64_t sequence_number = 0;
+
+            void post_work();
+
+            void work();
+
+        public:
+            void Init(const RobotRaconteur::PipePtr<experimental::artec_scanner::ScanPreviewPtr>& pipe);
+
+            // Called when a scanning procedure starts, drops the points of the previous scan
+            void begin_scan();
+
+            // Called from the scanning procedure observer for each scanned frame, frames that
+            // failed registration are skipped
+            void submit_frame(const ScanPreviewSettings& settings, const artec::sdk::scanning::RegistrationInfo* info,
+                uint32_t frame_count);
+    };
+
+    using ScanPreviewPublisherPtr = boost::shared_ptr<ScanPreviewPublisher>;
+}
@@ -0,0 +1,63 @@
+#include <artec/sdk/base/IProgressInfo.h>
+#include <artec/sdk/base/RefBase.h>
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <cstdint>
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    struct JobProgress
+    {
+        // Percent complete of the current step, -1 if the job has not reported progress
+        double percent = -1.0;
+        // Seconds since the current step started
+        double elapsed_time = 0.0;
+        // Estimated seconds until the current step completes, -1 if unknown
+        double remaining_time = -1.0;
+    };
+
+    // Progress sink passed to Artec jobs in AlgorithmWorkset::progress. The SDK reports from
+    // its job threads, so the values are kept in atomics and read without locking. The
+    // remaining time is extrapolated linearly from the elapsed time and percent complete.
+    class JobProgressSink : public artec::sdk::base::TRefBase<artec::sdk::base::IProgressInfo>
+    {
+        protected:
+            boost::atomic<int32_t> current;
+            boost::atomic<int32_t> total;
+            // Steady clock time the step started, in microseconds
+            boost::atomic<int64_t> start_us;
+            // Last whole percent passed to the changed handler
+            boost::atomic<int32_t> notified_percent;
+
+            boost::mutex changed_lock;
+            boost::function<void()> changed;
+
+            static int64_t now_us();
+
+        public:
+            JobProgressSink();
+
+            // Called from the job thread each time the whole percent complete changes. Must not
+            // be called with locks held that the handler acquires.
+            void set_changed_handler(boost::function<void()> handler);
+
+            // Start a new step, called before the job is launched
+            void restart();
+
+            void report(int current, int total) override;
+
+            void pulse() override;
+
+            JobProgress get_progress();
+
+            // Progress of a job that does not report through the sink, fraction is the share of
+            // the work done as known to the caller
+            JobProgress get_progress(double fraction);
+    };
+
+    using JobProgressSinkPtr = boost::shared_ptr<JobProgressSink>;
+}
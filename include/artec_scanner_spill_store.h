@@ -0,0 +1,74 @@
+#include <artec/sdk/base/IFrameMesh.h>
+#include <artec/sdk/base/TRef.h>
+#include "artec_scanner_util.h"
+#include "artec_scanner_frame_processor_pool.h"
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/thread.hpp>
+#include <unordered_map>
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    struct RRDeferredCapture;
+
+    // Append-only file of deferred capture frames moved out of memory. The Artec SDK cannot
+    // serialize a raw frame, so frames are reconstructed and textured before they are spilled
+    // and are read back as frame meshes. Records are located through an index keyed by the
+    // deferred capture handle and are memory mapped when read. The file is truncated once
+    // every record has been removed, and compacted by rewriting the live records once removed
+    // records take up more space than the live ones.
+    class FrameSpillStore
+    {
+        protected:
+            struct Record
+            {
+                uint64_t offset = 0;
+                uint64_t size = 0;
+            };
+
+            // Appends and truncation are exclusive, reads are shared
+            boost::shared_mutex this_lock;
+            boost::filesystem::path path;
+            boost::filesystem::ofstream file;
+            uint64_t file_size = 0;
+            // Bytes of the records in index, the rest of the file is removed records
+            uint64_t live_bytes = 0;
+            std::unordered_map<int32_t, Record> index;
+
+            void truncate();
+
+            // Rewrite the live records into a new file that replaces the store file. Called with
+            // this_lock held exclusively. The store is left unchanged if compaction fails.
+            void compact();
+
+            void reopen();
+
+        public:
+            // Creates or truncates the store file
+            FrameSpillStore(const boost::filesystem::path& path);
+
+            void append(int32_t handle, artec::sdk::base::IFrameMesh* frame_mesh);
+
+            // Read back the frame mesh stored for handle
+            void load(int32_t handle, artec::sdk::base::IFrameMesh** frame_mesh);
+
+            void remove(int32_t handle);
+
+            void clear();
+
+            size_t get_record_count();
+
+            uint64_t get_file_size();
+
+            ~FrameSpillStore();
+    };
+
+    using FrameSpillStorePtr = boost::shared_ptr<FrameSpillStore>;
+
+    // Reconstruct the frame mesh of a deferred capture, from the frame if it is in memory or
+    // from the spill store if it has been spilled. data_lock guards the capture.
+    void DeferredCaptureToFrameMesh(const boost::shared_ptr<RRDeferredCapture>& capture, boost::mutex& data_lock,
+        FrameProcessorPool* frame_processors, FrameSpillStore* spill_store, artec::sdk::base::IFrameMesh** frame_mesh);
+}
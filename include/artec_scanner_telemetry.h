@@ -0,0 +1,65 @@
+#include "experimental__artec_scanner.h"
+#include "experimental__artec_scanner_stubskel.h"
+#include <artec/sdk/scanning/IScanningProcedureObserver.h>
+#include <artec/sdk/base/IFrameMesh.h>
+#include "artec_scanner_overwrite_ring.h"
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    // Plain copy of the RegistrationInfo fields published as telemetry
+    struct FrameTelemetrySample
+    {
+        experimental::artec_scanner::FrameTelemetryEvent::FrameTelemetryEvent event;
+        int32_t frame_number;
+        int32_t scanner_index;
+        int32_t registration_error;
+        bool geometry_key_frame;
+        bool texture_key_frame;
+        double transform[16];
+    };
+
+    // All access to the Artec RegistrationInfo fields is kept in these two helpers
+    void RegistrationInfoToTelemetrySample(const artec::sdk::scanning::RegistrationInfo* info, 
+        FrameTelemetrySample& sample);
+
+    // Frame mesh of the registered frame in scanner coordinates, may be null
+    artec::sdk::base::IFrameMesh* RegistrationInfoFrameMesh(const artec::sdk::scanning::RegistrationInfo* info);
+
+    // Publishes scanning procedure frame events on the frame_telemetry pipe. Artec observer
+    // callbacks only push into a lock free overwrite ring. A drain task posted to the
+    // Robot Raconteur thread pool converts the entries and sends them to the connected
+    // clients. Slow clients drop packets once the pipe backlog is full.
+    class FrameTelemetryPublisher : public RR_ENABLE_SHARED_FROM_THIS<FrameTelemetryPublisher>
+    {
+        protected:
+            OverwriteRing<FrameTelemetrySample> ring;
+            boost::atomic<bool> drain_posted;
+
+            // Held by the drain task, so the ring only ever has one consumer
+            boost::mutex drain_lock;
+            uint64_t read_index = 0;
+            uint64_t dropped_count = 0;
+            uint64_t sequence_number = 0;
+
+            boost::mutex this_lock;
+            RobotRaconteur::PipeBroadcasterPtr<experimental::artec_scanner::FrameTelemetryPtr> broadcaster;
+
+            void post_drain();
+
+            void drain();
+
+        public:
+            FrameTelemetryPublisher(size_t ring_capacity = 256);
+
+            void Init(const RobotRaconteur::PipePtr<experimental::artec_scanner::FrameTelemetryPtr>& pipe);
+
+            // Called from Artec observer callbacks, never blocks. info may be null for events
+            // without registration info, scanner_index is only used in that case.
+            void publish(experimental::artec_scanner::FrameTelemetryEvent::FrameTelemetryEvent event,
+                const artec::sdk::scanning::RegistrationInfo* info, int32_t scanner_index);
+    };
+
+    using FrameTelemetryPublisherPtr = boost::shared_ptr<FrameTelemetryPublisher>;
+}
@@ -0,0 +1,43 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    // Driver wide thread budget for the jobs launched with the Artec SDK. The SDK creates its
+    // own job threads, so jobs are bounded through AlgorithmWorkset::threadsCount.
+    struct ThreadBudgetSettings
+    {
+        // threadsCount of algorithm jobs that do not request a count, zero for all available threads
+        uint32_t algorithm_threads = 0;
+        // Hardware threads algorithm jobs leave free so a running scanning procedure keeps up
+        // with the scanner
+        uint32_t scanning_reserved_threads = 0;
+        // threadsCount of scanning procedure jobs that do not request a count, zero for the
+        // SDK default
+        uint32_t scanning_threads = 0;
+    };
+
+    void SetThreadBudget(const ThreadBudgetSettings& settings);
+
+    ThreadBudgetSettings GetThreadBudget();
+
+    // threadsCount for an algorithm job. requested is the threads_count of the job, zero to use
+    // the driver setting. threads_in_use is the threadsCount already given to the other running
+    // algorithm jobs. With a scanning reserve the running jobs together stay within the threads
+    // left after the reserve, except that every job gets at least one thread. The job scheduler
+    // tracks threads_in_use, see JobTicket::acquire_algorithm_threads.
+    int AlgorithmJobThreadCount(uint32_t requested, uint32_t threads_in_use);
+
+    // threadsCount for a scanning procedure job, requested as for AlgorithmJobThreadCount
+    int ScanningJobThreadCount(uint32_t requested);
+
+    // Parse a CPU list such as "0-3,6". Throws std::invalid_argument on malformed input.
+    std::vector<uint32_t> ParseCpuList(const std::string& cpus);
+
+    // Restrict the calling thread to the listed CPUs. Returns false if the platform does not
+    // support thread affinity or the call failed. An empty list leaves the affinity unchanged.
+    bool SetCurrentThreadAffinity(const std::vector<uint32_t>& cpus);
+}
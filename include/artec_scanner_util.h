@@ -34,14 +34,62 @@
 
 namespace artec_scanner_robotraconteur_driver
 {
-    com::robotraconteur::geometry::shapes::MeshPtr ConvertArtecFrameMeshToRR(artec::sdk::base::IFrameMesh* mesh);
+    struct MeshConvertOptions
+    {
+        experimental::artec_scanner::TextureEncoding::TextureEncoding texture_encoding = 
+            experimental::artec_scanner::TextureEncoding::png;
+        int32_t jpeg_quality = 90;
+        bool include_normals = true;
+        bool include_textures = true;
+        bool include_uvs = true;
+        // Keep every vertex_stride-th vertex. Values above one return a point cloud without
+        // triangles or textures since the remaining vertices no longer form the triangles.
+        uint32_t vertex_stride = 1;
+        experimental::artec_scanner::MeshUnits::MeshUnits units = 
+            experimental::artec_scanner::MeshUnits::millimeters;
+    };
 
-    com::robotraconteur::geometry::shapes::MeshPtr ConvertArtecCompositeMeshToRR(artec::sdk::base::ICompositeMesh* mesh);
+    bool operator==(const MeshConvertOptions& a, const MeshConvertOptions& b);
+    bool operator!=(const MeshConvertOptions& a, const MeshConvertOptions& b);
+
+    // Apply client supplied export options on top of the driver wide conversion options. The
+    // texture_encoding and texture_jpeg_quality properties only provide the defaults for calls
+    // without export options, and for a jpeg_quality of zero.
+    MeshConvertOptions ApplyMeshExportOptions(const MeshConvertOptions& base, 
+        const experimental::artec_scanner::MeshExportOptionsPtr& export_options);
+
+    // Read a numeric scalar from a structure extended map. Returns false if the key is not present.
+    bool TryGetExtendedNumber(const RobotRaconteur::RRMapPtr<std::string,RobotRaconteur::RRValue>& extended,
+        const std::string& key, double& value);
+
+    // threads_count requested for an Artec job in a structure extended map, zero if not present
+    uint32_t GetExtendedThreadsCount(const RobotRaconteur::RRMapPtr<std::string,RobotRaconteur::RRValue>& extended);
+
+    com::robotraconteur::geometry::shapes::MeshPtr ConvertArtecFrameMeshToRR(artec::sdk::base::IFrameMesh* mesh, 
+        const MeshConvertOptions& options);
+
+    com::robotraconteur::geometry::shapes::MeshPtr ConvertArtecCompositeMeshToRR(artec::sdk::base::ICompositeMesh* mesh,
+        const MeshConvertOptions& options);
 
     RobotRaconteur::RRArrayPtr<uint8_t> ConvertArtecMeshToStlBytes(artec::sdk::base::IMesh* mesh);
 
+    // Same as above for xyz float points and three int32 indices per triangle
+    RobotRaconteur::RRArrayPtr<uint8_t> ConvertTrianglesToStlBytes(const float* points, size_t points_count,
+        const int32_t* triangles, size_t triangle_count);
+
+    // Encode in the compact quantized format, see artec_scanner_compact_mesh.h. Uses the units
+    // and include_normals options, textures are not included.
+    RobotRaconteur::RRArrayPtr<uint8_t> ConvertArtecMeshToCompactBytes(artec::sdk::base::IMesh* mesh,
+        const MeshConvertOptions& options, bool deflate);
+
+    // Approximate memory held by the frame meshes, textures and composite meshes of a model
+    uint64_t EstimateModelBytes(artec::sdk::base::IModel* model);
+
     com::robotraconteur::geometry::Transform ConvertArtecTransformToRR(const artec::sdk::base::Matrix4x4D& transform);
 
+    // Same as above for a copy of the 16 matrix elements in Matrix4x4D storage order
+    com::robotraconteur::geometry::Transform ConvertArtecTransformToRR(const double* transform_data);
+
     void ThrowArtecErrorCode(artec::sdk::base::ErrorCode ec, const std::string& user_msg);
 
     RobotRaconteur::RobotRaconteurExceptionPtr ArtecErrorToExceptionPtr(artec::sdk::base::ErrorCode ec, const std::string& user_msg);
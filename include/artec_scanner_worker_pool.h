@@ -0,0 +1,102 @@
+#include <boost/thread.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    class WorkerPool;
+
+    // Bounded per client queue on the shared worker pool, created with WorkerPool::create_queue().
+    // Queues with pending work are served round robin, one task at a time, so a client
+    // submitting many long tasks cannot starve other clients.
+    class WorkerQueue : public boost::enable_shared_from_this<WorkerQueue>
+    {
+        friend class WorkerPool;
+
+        protected:
+            boost::shared_ptr<WorkerPool> pool;
+            // Guarded by the pool lock
+            std::deque<boost::function<void()> > pending;
+            size_t max_pending = 0;
+            bool scheduled = false;
+
+        public:
+            WorkerQueue(boost::shared_ptr<WorkerPool> pool, size_t max_pending);
+
+            // Returns false without queueing fn if max_pending tasks are already waiting
+            bool try_post(boost::function<void()> fn);
+
+            size_t get_pending_count();
+    };
+
+    using WorkerQueuePtr = boost::shared_ptr<WorkerQueue>;
+
+    // Fixed size pool of worker threads shared by the driver. Unqueued work posted with post()
+    // is short conversion work and runs ahead of the client queues.
+    class WorkerPool : public boost::enable_shared_from_this<WorkerPool>
+    {
+        friend class WorkerQueue;
+
+        protected:
+            boost::mutex this_lock;
+            boost::condition_variable work_cv;
+            std::deque<boost::function<void()> > work;
+            std::deque<WorkerQueuePtr> ready_queues;
+            boost::thread_group threads;
+            size_t thread_count = 0;
+            bool stopped = false;
+            boost::function<void(const std::string&)> error_handler;
+
+            void worker_thread();
+
+        public:
+            // Worker threads are restricted to cpus, an empty list leaves the affinity unchanged
+            WorkerPool(size_t thread_count, const std::vector<uint32_t>& cpus = std::vector<uint32_t>());
+
+            size_t get_thread_count() const;
+
+            // Called on the worker thread with the message of an exception that escaped posted
+            // or queued work. The pool has no logger of its own so it stays usable without Robot
+            // Raconteur, the driver installs one that logs the error.
+            void set_error_handler(boost::function<void(const std::string&)> handler);
+
+            void post(boost::function<void()> fn);
+
+            WorkerQueuePtr create_queue(size_t max_pending);
+
+            // Run fn(begin, end) over [0, count) split into chunks of chunk_size. The calling
+            // thread also executes chunks, so nested calls from pool threads cannot deadlock.
+            // The first exception thrown by fn is rethrown once all chunks have finished.
+            void parallel_for(size_t count, size_t chunk_size, boost::function<void(size_t, size_t)> fn);
+
+            // Run independent tasks concurrently, calling thread participates
+            void parallel_invoke(const std::vector<boost::function<void()> >& tasks);
+
+            // Run caller_task on the calling thread while the pool starts on tasks, then help
+            // with the remaining tasks. For work that has to stay on the calling thread, like
+            // Artec SDK calls. caller_task's exception takes precedence over the tasks'.
+            void parallel_invoke(const std::vector<boost::function<void()> >& tasks,
+                const boost::function<void()>& caller_task);
+
+            void shutdown();
+
+            virtual ~WorkerPool();
+    };
+
+    using WorkerPoolPtr = boost::shared_ptr<WorkerPool>;
+
+    // Create the driver wide worker pool with thread_count threads, zero selects
+    // hardware_concurrency(). The threads are restricted to cpus if it is not empty. Must be
+    // called before the first GetWorkerPool() to take effect.
+    WorkerPoolPtr InitWorkerPool(size_t thread_count, const std::vector<uint32_t>& cpus = std::vector<uint32_t>());
+
+    // Driver wide worker pool, created with hardware_concurrency() threads on first use
+    WorkerPoolPtr GetWorkerPool();
+}
@@ -7,9 +7,15 @@
 #include <artec/sdk/base/IJobObserver.h>
 #include <artec/sdk/base/AlgorithmWorkset.h>
 #include "artec_scanner_util.h" 
+#include "artec_scanner_worker_pool.h"
+#include "artec_scanner_frame_processor_pool.h"
+#include "artec_scanner_deferred_cache.h"
+#include "artec_scanner_spill_store.h"
+#include "artec_scanner_generator.h"
 
-#include <boost/thread/thread_pool.hpp>
-#include <list>
+#include <boost/atomic.hpp>
+#include <deque>
+#include <vector>
 
 #pragma once
 
@@ -18,41 +24,109 @@ namespace artec_scanner_robotraconteur_driver
     class ArtecScannerImpl;
     struct RRDeferredCapture;
 
-    class DeferredCapturePrepare : public RobotRaconteur::Generator<experimental::artec_scanner::DeferredCapturePrepareStatusPtr,void >,
-        public RR_ENABLE_SHARED_FROM_THIS<DeferredCapturePrepare>
+    // Prepares a batch of deferred captures on the shared worker pool. Used by the deferred
+    // capture prepare generators, which receive each capture as it completes through
+    // capture_handler and are notified through done_handler once all workers have finished.
+    class DeferredCapturePrepareWorker : public RR_ENABLE_SHARED_FROM_THIS<DeferredCapturePrepareWorker>
     {
+        public:
+            // Called from a worker thread with the capture, the converted mesh and stl bytes
+            // when requested, and whether the capture was prepared successfully
+            using capture_handler_type = boost::function<void(const boost::shared_ptr<RRDeferredCapture>&,
+                const com::robotraconteur::geometry::shapes::MeshPtr&, const RobotRaconteur::RRArrayPtr<uint8_t>&, bool)>;
+
         protected:
-            boost::weak_ptr<ArtecScannerImpl> parent;
-            boost::shared_ptr<ArtecScannerImpl> GetParent();
             boost::mutex& data_lock;
-            boost::mutex this_lock;
 
-            RobotRaconteur::TimerPtr next_timer;
-            std::list<boost::shared_ptr<RRDeferredCapture> > input_data;
+            // Workers claim captures by index, input_data is not modified after construction
+            std::vector<boost::shared_ptr<RRDeferredCapture> > input_data;
+            boost::atomic<size_t> next_input;
 
-            boost::atomic<int32_t> completed_count = 0;
-            boost::atomic<int32_t> failed_count = 0;
+            boost::atomic<int32_t> completed_count;
+            boost::atomic<int32_t> failed_count;
 
             bool mesh = false;
             bool stl = false;
+            MeshConvertOptions mesh_options;
+
+            // Set by cancel, read by the workers without taking a lock
+            boost::atomic<bool> cancel_requested;
+            // Worker tasks that have not finished. Each task prepares one capture and then
+            // posts itself again while captures remain.
+            boost::atomic<size_t> active_task_count;
+
+            // Captures at or above claim_limit are not prepared until the limit is raised. Tasks
+            // that run out of claimable captures park until set_claim_limit or cancel reposts
+            // them. claim_limit is written and parked_task_count accessed under park_lock.
+            boost::mutex park_lock;
+            boost::atomic<size_t> claim_limit;
+            size_t parked_task_count = 0;
+
+            capture_handler_type capture_handler;
+            boost::function<void()> done_handler;
+
+            WorkerQueuePtr work_queue;
+            FrameProcessorPoolPtr frame_processors;
+            // Guarded by data_lock
+            DeferredCaptureCachePtr deferred_cache;
+            FrameSpillStorePtr spill_store;
+
+            void prepare_next();
+
+            void prepare_task_done();
+
+            // Claim the next capture below the claim limit
+            bool claim_input(size_t& index);
+
+            // Returns true if the calling task parked because the claim limit is reached
+            bool park_task();
+
+            void repost_parked_tasks();
+
+            bool prepare_capture(const boost::shared_ptr<RRDeferredCapture>& work, 
+                com::robotraconteur::geometry::shapes::MeshPtr& rr_mesh, RobotRaconteur::RRArrayPtr<uint8_t>& stl_bytes);
+
+        public:
+            DeferredCapturePrepareWorker(boost::shared_ptr<ArtecScannerImpl> parent, 
+                std::vector<boost::shared_ptr<RRDeferredCapture> >&& input_data, bool mesh, bool stl);
+
+            // Returns false without calling done_handler if there is nothing to prepare
+            bool start(capture_handler_type capture_handler, boost::function<void()> done_handler);
+
+            void cancel();
+
+            // Only prepare captures with an index below limit. Unlimited by default.
+            void set_claim_limit(size_t limit);
+
+            int32_t get_completed_count();
+
+            int32_t get_failed_count();
+
+            size_t get_input_count();
+    };
+
+    using DeferredCapturePrepareWorkerPtr = boost::shared_ptr<DeferredCapturePrepareWorker>;
+
+    class DeferredCapturePrepare : public ProgressGenerator<DeferredCapturePrepare, experimental::artec_scanner::DeferredCapturePrepareStatusPtr>,
+        public RR_ENABLE_SHARED_FROM_THIS<DeferredCapturePrepare>
+    {
+        protected:
+            boost::weak_ptr<ArtecScannerImpl> parent;
+            boost::shared_ptr<ArtecScannerImpl> GetParent();
+
             bool started = false;
             bool closed = false;
             bool aborted = false;
             bool completed = false;
             bool prepare_completed = false;
-            size_t active_thread_count = 0;
-
-            boost::function<void(const experimental::artec_scanner::DeferredCapturePrepareStatusPtr&,
-                const RobotRaconteur::RobotRaconteurExceptionPtr&)> next_handler;
 
-            boost::thread_group thread_pool;
-            artec::sdk::base::TRef<artec::sdk::capturing::IScanner> scanner;
+            DeferredCapturePrepareWorkerPtr worker;
 
         public:
 
             DeferredCapturePrepare(boost::shared_ptr<ArtecScannerImpl> parent);
 
-            void Init(std::list<boost::shared_ptr<RRDeferredCapture> >&& input_data, bool mesh, bool stl);
+            void Init(std::vector<boost::shared_ptr<RRDeferredCapture> >&& input_data, bool mesh, bool stl);
 
             void AsyncNext(boost::function<void(const experimental::artec_scanner::DeferredCapturePrepareStatusPtr&,
                 const RobotRaconteur::RobotRaconteurExceptionPtr&)> handler, int32_t timeout = RR_TIMEOUT_INFINITE )
@@ -73,8 +147,66 @@ namespace artec_scanner_robotraconteur_driver
             void complete_gen(boost::function<void(const experimental::artec_scanner::DeferredCapturePrepareStatusPtr&,
                 const RobotRaconteur::RobotRaconteurExceptionPtr&)> handler);
 
-            void next_timer_handler(const RobotRaconteur::TimerEvent& evt);
+            experimental::artec_scanner::DeferredCapturePrepareStatusPtr progress_status() override;
+
+            void prepare_done();
+    };
+
+    // Captures a DeferredCapturePrepareStream prepares ahead of the client. Bounds the prepared
+    // meshes held for a client that calls Next slowly.
+    const size_t DEFERRED_PREPARE_STREAM_WINDOW = 8;
+
+    // Yields each deferred capture as soon as it has been prepared, in completion order
+    class DeferredCapturePrepareStream : public RobotRaconteur::Generator<experimental::artec_scanner::DeferredCaptureResultPtr,void >,
+        public RR_ENABLE_SHARED_FROM_THIS<DeferredCapturePrepareStream>
+    {
+        protected:
+            boost::weak_ptr<ArtecScannerImpl> parent;
+            boost::mutex this_lock;
+
+            bool started = false;
+            bool closed = false;
+            bool aborted = false;
+            bool prepare_completed = false;
+            std::deque<experimental::artec_scanner::DeferredCaptureResultPtr> results;
+            // Results handed to the client, the worker prepares at most
+            // DEFERRED_PREPARE_STREAM_WINDOW captures ahead of it
+            size_t delivered_count = 0;
+
+            boost::function<void(const experimental::artec_scanner::DeferredCaptureResultPtr&,
+                const RobotRaconteur::RobotRaconteurExceptionPtr&)> next_handler;
+
+            DeferredCapturePrepareWorkerPtr worker;
+
+        public:
+
+            DeferredCapturePrepareStream(boost::shared_ptr<ArtecScannerImpl> parent);
+
+            void Init(std::vector<boost::shared_ptr<RRDeferredCapture> >&& input_data, bool mesh, bool stl);
+
+            void AsyncNext(boost::function<void(const experimental::artec_scanner::DeferredCaptureResultPtr&,
+                const RobotRaconteur::RobotRaconteurExceptionPtr&)> handler, int32_t timeout = RR_TIMEOUT_INFINITE )
+                override;
+
+            void AsyncClose(boost::function<void(const RobotRaconteur::RobotRaconteurExceptionPtr& err)> handler,
+                            int32_t timeout = RR_TIMEOUT_INFINITE) override;
+
+            void AsyncAbort(boost::function<void(const RobotRaconteur::RobotRaconteurExceptionPtr& err)> handler,
+                            int32_t timeout = RR_TIMEOUT_INFINITE) override;
+
+            experimental::artec_scanner::DeferredCaptureResultPtr Next() override {return nullptr;}
+            void Close() override {}
+            void Abort() override {}
+
+        protected:
+
+            void capture_prepared(const boost::shared_ptr<RRDeferredCapture>& work, 
+                const com::robotraconteur::geometry::shapes::MeshPtr& rr_mesh, 
+                const RobotRaconteur::RRArrayPtr<uint8_t>& stl_bytes, bool success);
+
+            void prepare_done();
 
-            void prepare();
+            // Called with this_lock held after a result is handed to the client
+            void result_delivered();
     };
 }
\ No newline at end of file
@@ -7,6 +7,11 @@
 #include <artec/sdk/base/IJobObserver.h>
 #include <artec/sdk/base/AlgorithmWorkset.h>
 #include "artec_scanner_util.h" 
+#include "artec_scanner_generator.h"
+#include "artec_scanner_preview.h"
+#include "artec_scanner_progress.h"
+#include "artec_scanner_job_scheduler.h"
+#include <boost/atomic.hpp>
 
 #pragma once
 
@@ -17,13 +22,13 @@ namespace artec_scanner_robotraconteur_driver
     class ScanningProcedureObserver;
     class ScanningProcedureJobObserver;
     class RRArtecModel;
-    class ScanningProcedure : public RobotRaconteur::Generator<experimental::artec_scanner::ScanningProcedureStatusPtr,void>,
+
+    class ScanningProcedure : public ProgressGenerator<ScanningProcedure, experimental::artec_scanner::ScanningProcedureStatusPtr>,
         public RR_ENABLE_SHARED_FROM_THIS<ScanningProcedure>
     {
         protected:
             boost::weak_ptr<ArtecScannerImpl> parent;
             boost::shared_ptr<ArtecScannerImpl> GetParent();
-            boost::mutex this_lock;
             artec::sdk::base::TRef<artec::sdk::scanning::IScanningProcedure> scanning_procedure;
             bool started = false;
             bool closed = false;
@@ -31,15 +36,28 @@ namespace artec_scanner_robotraconteur_driver
             bool completed = false;
             bool artec_job_complete = false;
             artec::sdk::base::ErrorCode artec_job_status = artec::sdk::base::ErrorCode_UnknownExceptionType;
-            boost::function<void(const experimental::artec_scanner::ScanningProcedureStatusPtr&,
-                const RobotRaconteur::RobotRaconteurExceptionPtr&)> next_handler;
+            boost::atomic<uint32_t> frame_count;
+            ScanPreviewSettings preview_settings;
             boost::shared_ptr<RRArtecModel> model;
             artec::sdk::base::AlgorithmWorkset workset;
             artec::sdk::base::TRef<artec::sdk::base::IModel> input_container;
             artec::sdk::base::TRef<artec::sdk::base::ICancellationTokenSource> ct_source;
-            RobotRaconteur::TimerPtr next_timer;
             boost::shared_ptr<ScanningProcedureObserver> observer;
             boost::shared_ptr<ScanningProcedureJobObserver> job_observer;
+            JobProgressSinkPtr progress_sink;
+            int32_t max_frame_count = 0;
+
+            // Job scheduler admission, held until the procedure completes. Scanning is admitted
+            // right away so live scanning is never held up by offline processing.
+            JobTicketPtr ticket;
+            // Set once the scanning job has been launched
+            bool launched = false;
+
+            // Called with this_lock held
+            void fill_progress(const experimental::artec_scanner::ScanningProcedureStatusPtr& status);
+
+            // Called with this_lock held
+            void launch_job();
         public:
 
             friend class ScanningProcedureObserver;
@@ -67,10 +85,17 @@ namespace artec_scanner_robotraconteur_driver
         protected:
             void scan_job_complete(artec::sdk::base::ErrorCode result);
 
+            void frame_scanned();
+
+            void publish_telemetry(experimental::artec_scanner::FrameTelemetryEvent::FrameTelemetryEvent event,
+                const artec::sdk::scanning::RegistrationInfo* frame_info, int32_t scanner_index);
+
+            void publish_preview(const artec::sdk::scanning::RegistrationInfo* frame_info);
+
             void complete_gen(boost::function<void(const experimental::artec_scanner::ScanningProcedureStatusPtr&,
                 const RobotRaconteur::RobotRaconteurExceptionPtr&)> handler);
 
-            void next_timer_handler(const RobotRaconteur::TimerEvent& evt);
+            experimental::artec_scanner::ScanningProcedureStatusPtr progress_status() override;
     };
 
     class ScanningProcedureObserver : public artec::sdk::scanning::ScanningProcedureObserverBase
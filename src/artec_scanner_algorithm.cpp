@@ -1,10 +1,13 @@
 #include "artec_scanner_algorithm.h"
 #include "artec_scanner_algorithm_util.h"
 #include "artec_scanner_impl.h"
+#include "artec_scanner_thread_budget.h"
 
 #include <artec/sdk/algorithms/Algorithms.h>
 #include <artec/sdk/base/IScan.h>
 
+#include <algorithm>
+
 namespace asdk {
     using namespace artec::sdk::base;
     using namespace artec::sdk::algorithms;
@@ -38,8 +41,9 @@ RunAlgorithms::RunAlgorithms(boost::shared_ptr<ArtecScannerImpl> parent)
     this->parent = parent;
 }
 
-void RunAlgorithms::Init(boost::shared_ptr<RRArtecModel> input_model, 
-    const RobotRaconteur::RRListPtr<RobotRaconteur::RRValue>& algorithms)
+void RunAlgorithms::Init(boost::shared_ptr<RRArtecModel> input_model, int32_t input_model_handle,
+    const RobotRaconteur::RRListPtr<RobotRaconteur::RRValue>& algorithms,
+    const experimental::artec_scanner::RunAlgorithmsOptionsPtr& options)
 {
     if (input_model->model->getSize() <= 0)
     {
@@ -48,89 +52,22 @@ void RunAlgorithms::Init(boost::shared_ptr<RRArtecModel> input_model,
     }
 
     this->input_model = input_model;
+    this->input_model_handle = input_model_handle;
+    this->input_model_id = input_model->model_id;
 
     auto scanner_type = input_model->model->getElement(0)->getScannerType();
 
     std::vector<asdk::TRef<asdk::IAlgorithm> > artec_algs;
+    std::vector<std::string> settings_keys;
+    std::vector<uint32_t> alg_threads_counts;
     for(auto& alg : *algorithms)
     {
         asdk::TRef<asdk::IAlgorithm> artec_alg;
-        auto alg_rr_type = alg->RRType();
-        // Look at type of each algorithm and dispatch appropriately
-        if (alg_rr_type == (RR_ARTEC_PREFIX "AutoAlignAlgorithm"))
-        {
-            auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::AutoAlignAlgorithm>(alg);
-            create_auto_align_algorithm(&artec_alg, alg2, scanner_type); 
-        }
-        else
-        if (alg_rr_type == (RR_ARTEC_PREFIX "FastFusionAlgorithm"))
-        {
-            auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::FastFusionAlgorithm>(alg);
-            create_fast_fusion_algorithm(&artec_alg, alg2, scanner_type); 
-        }
-        else
-        if (alg_rr_type == (RR_ARTEC_PREFIX "FastMeshSimplificationAlgorithm"))
-        {
-            auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::FastMeshSimplificationAlgorithm>(alg);
-            create_fast_mesh_simplification_algorithm(&artec_alg, alg2, scanner_type); 
-        }
-        else
-        if (alg_rr_type == (RR_ARTEC_PREFIX "GlobalRegistrationAlgorithm"))
-        {
-            auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::GlobalRegistrationAlgorithm>(alg);
-            create_global_registration_algorithm(&artec_alg, alg2, scanner_type); 
-        }
-        else
-        if (alg_rr_type == (RR_ARTEC_PREFIX "LoopClosureAlgorithm"))
-        {
-            auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::LoopClosureAlgorithm>(alg);
-            create_loop_closure_algorithm(&artec_alg, alg2, scanner_type); 
-        }
-        else
-        if (alg_rr_type == (RR_ARTEC_PREFIX "MeshSimplificationAlgorithm"))
-        {
-            auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::MeshSimplificationAlgorithm>(alg);
-            create_mesh_simplification_algorithm(&artec_alg, alg2, scanner_type); 
-        }
-        else
-        if (alg_rr_type == (RR_ARTEC_PREFIX "OutliersRemovalAlgorithm"))
-        {
-            auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::OutliersRemovalAlgorithm>(alg);
-            create_outliers_removal_algorithm(&artec_alg, alg2, scanner_type); 
-        }
-        else
-        if (alg_rr_type == (RR_ARTEC_PREFIX "PoissonFusionAlgorithm"))
-        {
-            auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::PoissonFusionAlgorithm>(alg);
-            create_poisson_fusion_algorithm(&artec_alg, alg2, scanner_type); 
-        }
-        else
-        if (alg_rr_type == (RR_ARTEC_PREFIX "SerialRegistrationAlgorithm"))
-        {
-            auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::SerialRegistrationAlgorithm>(alg);
-            create_serial_registration_algorithm(&artec_alg, alg2, scanner_type); 
-        }
-        else
-        if (alg_rr_type == (RR_ARTEC_PREFIX "SmallObjectsFilterAlgorithm"))
-        {
-            auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::SmallObjectsFilterAlgorithm>(alg);
-            create_small_objects_filter_algorithm(&artec_alg, alg2, scanner_type); 
-        }
-        else
-        if (alg_rr_type == (RR_ARTEC_PREFIX "TexturizationAlgorithm"))
-        {
-            auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::TexturizationAlgorithm>(alg);
-            create_texturization_algorithm(&artec_alg, alg2, scanner_type); 
-        }
-        
-
-        if (!artec_alg)
-        {
-            RR_ARTEC_LOG_ERROR("Invalid algorithm type: " << alg_rr_type);
-            throw RR::InvalidArgumentException("Invalid algorithm type: " + alg_rr_type);
-        }
-
+        uint32_t threads_count = 0;
+        create_algorithm(&artec_alg, alg, scanner_type, &threads_count);
         artec_algs.push_back(std::move(artec_alg));
+        settings_keys.push_back(algorithm_settings_key(alg));
+        alg_threads_counts.push_back(threads_count);
     }
 
     if (artec_algs.empty())
@@ -139,7 +76,47 @@ void RunAlgorithms::Init(boost::shared_ptr<RRArtecModel> input_model,
         throw RR::InvalidArgumentException("No algorithms specified");
     }
 
+    std::vector<uint32_t> retain;
+    if (options)
+    {
+        priority = options->priority;
+        release_intermediates = options->release_intermediates.value != 0;
+        release_input_model = options->release_input_model.value != 0;
+        if (options->retain_intermediates)
+        {
+            for (size_t i = 0; i < options->retain_intermediates->size(); i++)
+            {
+                uint32_t step = (*options->retain_intermediates)[i];
+                if (step >= artec_algs.size() - 1)
+                {
+                    RR_ARTEC_LOG_ERROR("Invalid retain_intermediates algorithm index: " << step);
+                    throw RR::InvalidArgumentException("retain_intermediates must only name algorithms before the last");
+                }
+                retain.push_back(step);
+            }
+        }
+    }
+
     artec_algorithms.swap(artec_algs);
+    threads_counts.swap(alg_threads_counts);
+    retain_intermediates.swap(retain);
+    retained_models.assign(retain_intermediates.size(), nullptr);
+
+    chain_keys.clear();
+    for (size_t i = 0; i < settings_keys.size(); i++)
+    {
+        chain_keys.push_back(AlgorithmResultCache::chain_key(input_model_id, settings_keys, i + 1));
+    }
+    result_cache = GetParent()->algorithm_cache;
+
+    progress_sink = boost::make_shared<JobProgressSink>();
+    boost::weak_ptr<RunAlgorithms> weak_this = shared_from_this();
+    progress_sink->set_changed_handler([weak_this]()
+    {
+        auto t = weak_this.lock();
+        if (!t) return;
+        t->notify_progress();
+    });
 }
 
 void RunAlgorithms::AsyncNext(boost::function<void(const experimental::artec_scanner::RunAlgorithmsStatusPtr&,
@@ -158,24 +135,79 @@ void RunAlgorithms::AsyncNext(boost::function<void(const experimental::artec_sca
         if (!started)
         {
             RR_CALL_ARTEC(asdk::createCancellationTokenSource(&ct_source), "Error creating cancellation source");
-            auto job_observer = new RunAlgorithmsJobObserver(shared_from_this(), 0);
-            auto job = artec_algorithms.at(0);
+            run_start = boost::chrono::steady_clock::now();
+
+            // Resume after the longest prefix of the chain that has already been run on this model
             current_input_model = input_model;
-            current_output_model = RR_MAKE_SHARED<RRArtecModel>();
-            current_workset.in = current_input_model->model;
-            current_workset.out = current_output_model->model;
-            current_workset.cancellation = ct_source->getToken();
-            current_workset.progress = nullptr;
-            current_workset.threadsCount = 0;
+            uint32_t first_algorithm = 0;
+            for (size_t i = chain_keys.size(); i > 0; i--)
+            {
+                auto cached = result_cache->get(chain_keys[i - 1]);
+                if (cached && load_cached_intermediates(static_cast<uint32_t>(i)))
+                {
+                    current_input_model = cached;
+                    first_algorithm = static_cast<uint32_t>(i);
+                    break;
+                }
+            }
 
-            RR_CALL_ARTEC(asdk::launchJob(job, &current_workset, job_observer), 
-                "Error launching scanning procedure");
+            if (first_algorithm > 0)
+            {
+                RR_ARTEC_LOG_INFO("Reusing cached result of the first " << first_algorithm << " algorithms");
+            }
+
+            if (release_input_model || release_intermediates)
+            {
+                // current_input_model keeps the model until the first algorithm completes
+                input_model.reset();
+            }
+
+            current_algorithm = first_algorithm;
+            if (first_algorithm == artec_algorithms.size())
+            {
+                started = true;
+                artec_job_complete = true;
+                artec_job_status = asdk::ErrorCode_OK;
+                current_output_model = current_input_model;
+                current_algorithm = first_algorithm - 1;
+                // The whole chain was cached, the run has succeeded without launching a job
+                free_input_model_handle();
+                complete_gen(handler);
+                return;
+            }
+
+            // Wait for the job scheduler to admit the chain
+            uint64_t memory_estimate = EstimateModelBytes(current_input_model->model) * ALGORITHM_JOB_MEMORY_FACTOR;
+            boost::weak_ptr<RunAlgorithms> weak_this = shared_from_this();
+            bool admitted = false;
+            ticket = GetParent()->job_scheduler->submit(priority, memory_estimate, [weak_this]()
+            {
+                auto t = weak_this.lock();
+                if (!t) return;
+                t->scheduled_start();
+            }, admitted);
             started = true;
-            auto ret = rr_artec::RunAlgorithmsStatusPtr(new rr_artec::RunAlgorithmsStatus());
-            ret->action_status = rr_action::ActionStatusCode::running;
-            ret->output_model_handle = 0;
-            ret->current_algorithm = 0;
-            RR_ARTEC_LOG_INFO("Started scanning procedure")
+            if (admitted)
+            {
+                try
+                {
+                    launch_first();
+                }
+                catch (std::exception&)
+                {
+                    // The input model may already be released, so the run can not be retried.
+                    // Later Next calls report the failure.
+                    ticket.reset();
+                    artec_job_complete = true;
+                    artec_job_status = asdk::ErrorCode_OperationFailed;
+                    throw;
+                }
+            }
+            else
+            {
+                RR_ARTEC_LOG_INFO("Run algorithms queued at position " << ticket->get_queue_position());
+            }
+            auto ret = progress_status();
             lock.unlock();
             handler(ret, nullptr);
             return;
@@ -192,29 +224,76 @@ void RunAlgorithms::AsyncNext(boost::function<void(const experimental::artec_sca
             return;
         }
 
-        if (last_algorithm_update < current_algorithm)
+        // Replies immediately if an algorithm finished since the last reply
+        wait_progress(lock, handler);
+    }
+
+bool RunAlgorithms::load_cached_intermediates(uint32_t count)
+{
+    for (size_t i = 0; i < retain_intermediates.size(); i++)
+    {
+        if (retain_intermediates[i] >= count)
         {
-            auto ret = rr_artec::RunAlgorithmsStatusPtr(new rr_artec::RunAlgorithmsStatus());
-            ret->action_status = rr_action::ActionStatusCode::running;
-            ret->output_model_handle = 0;
-            ret->current_algorithm = current_algorithm;
-            last_algorithm_update = current_algorithm;
-            lock.unlock();
-            handler(ret, nullptr);
-            return;
+            retained_models[i].reset();
+            continue;
+        }
+        retained_models[i] = result_cache->get(chain_keys.at(retain_intermediates[i]));
+        if (!retained_models[i])
+        {
+            std::fill(retained_models.begin(), retained_models.end(), nullptr);
+            return false;
         }
+    }
+    return true;
+}
 
-        next_handler = handler;
+void RunAlgorithms::launch_first()
+{
+    auto job_observer = new RunAlgorithmsJobObserver(shared_from_this(), current_algorithm);
+    auto job = artec_algorithms.at(current_algorithm);
+    current_output_model = RR_MAKE_SHARED<RRArtecModel>();
+    current_workset.in = current_input_model->model;
+    current_workset.out = current_output_model->model;
+    current_workset.cancellation = ct_source->getToken();
+    current_workset.progress = progress_sink.get();
+    current_threads = ticket->acquire_algorithm_threads(threads_counts.at(current_algorithm));
+    current_workset.threadsCount = current_threads;
+
+    progress_sink->restart();
+    RR_CALL_ARTEC(asdk::launchJob(job, &current_workset, job_observer), 
+        "Error launching scanning procedure");
+    launched = true;
+    RR_ARTEC_LOG_INFO("Started scanning procedure")
+}
 
-        RR_WEAK_PTR<RunAlgorithms> weak_this = shared_from_this();
-        next_timer = RR::RobotRaconteurNode::s()->CreateTimer(boost::posix_time::seconds(5), 
-            [weak_this](const RR::TimerEvent& evt) {
-                auto t = weak_this.lock();
-                if (!t) return;
-                t->next_timer_handler(evt);
-        }, true);
-        next_timer->Start();
+void RunAlgorithms::scheduled_start()
+{
+    boost::mutex::scoped_lock lock(this_lock);
+    if (closed || aborted || launched || artec_job_complete)
+    {
+        ticket.reset();
+        return;
+    }
+    try
+    {
+        launch_first();
     }
+    catch (std::exception& e)
+    {
+        RR_ARTEC_LOG_ERROR("Error launching queued algorithms: " << e.what());
+        ticket.reset();
+        artec_job_complete = true;
+        artec_job_status = asdk::ErrorCode_OperationFailed;
+        auto h = take_next_handler();
+        if (h)
+        {
+            complete_gen(h);
+        }
+        return;
+    }
+    lock.unlock();
+    notify_progress();
+}
 
 void RunAlgorithms::AsyncClose(boost::function<void(const RobotRaconteur::RobotRaconteurExceptionPtr& err)> handler,
                 int32_t timeout)
@@ -228,6 +307,10 @@ void RunAlgorithms::AsyncClose(boost::function<void(const RobotRaconteur::RobotR
     }
     closed = true;
     this->ct_source->cancel();
+    if (!launched)
+    {
+        ticket.reset();
+    }
     lock.unlock();
     handler(nullptr);
 }
@@ -244,14 +327,64 @@ void RunAlgorithms::AsyncAbort(boost::function<void(const RobotRaconteur::RobotR
     }
     aborted = true;
     this->ct_source->cancel();
+    if (!launched)
+    {
+        ticket.reset();
+    }
     lock.unlock();
     handler(nullptr);
 }
 
+void RunAlgorithms::free_input_model_handle()
+{
+    // A closed or aborted run keeps the handle even if the running job still succeeds
+    if (!release_input_model || input_model_handle_freed || closed || aborted)
+    {
+        return;
+    }
+    input_model_handle_freed = true;
+    try
+    {
+        GetParent()->model_free(input_model_handle);
+    }
+    catch (RR::InvalidArgumentException&)
+    {
+        // Already freed by the client
+    }
+    catch (std::exception& e)
+    {
+        // Called from the job observer, the run itself has succeeded
+        RR_ARTEC_LOG_WARNING("Could not free run_algorithms input model: " << e.what());
+    }
+}
+
 void RunAlgorithms::algorithm_job_complete(artec::sdk::base::ErrorCode result, uint32_t job_number)
 {
     boost::mutex::scoped_lock lock(this_lock);
     auto next_algorithm = current_algorithm+1;
+
+    if (result == asdk::ErrorCode_OK)
+    {
+        // The first algorithm has consumed the input. Freed only on success so failed runs
+        // keep the handle.
+        free_input_model_handle();
+
+        bool retained = false;
+        for (size_t i = 0; i < retain_intermediates.size(); i++)
+        {
+            if (retain_intermediates[i] == current_algorithm)
+            {
+                retained_models[i] = current_output_model;
+                retained = true;
+            }
+        }
+        // Results of a released input model can not be looked up again. Lean runs only cache
+        // results that are kept anyway.
+        if (!release_input_model && (!release_intermediates || retained || next_algorithm >= artec_algorithms.size()))
+        {
+            result_cache->put(chain_keys.at(current_algorithm), input_model_id, current_output_model);
+        }
+    }
     
     if ((next_algorithm) < artec_algorithms.size() && result == asdk::ErrorCode_OK)
     {
@@ -261,40 +394,60 @@ void RunAlgorithms::algorithm_job_complete(artec::sdk::base::ErrorCode result, u
         current_output_model = RR_MAKE_SHARED<RRArtecModel>();
         current_workset.in = current_input_model->model;
         current_workset.out = current_output_model->model;
+        if (ticket)
+        {
+            ticket->release_algorithm_threads(current_threads);
+            current_threads = ticket->acquire_algorithm_threads(threads_counts.at(next_algorithm));
+        }
+        current_workset.threadsCount = current_threads;
 
-        auto job_observer = new RunAlgorithmsJobObserver(shared_from_this(), next_algorithm);
-        RR_CALL_ARTEC(asdk::launchJob(job, &current_workset, job_observer), 
-                "Error launching next algorithm");
+        progress_sink->restart();
+        try
+        {
+            auto job_observer = new RunAlgorithmsJobObserver(shared_from_this(), next_algorithm);
+            RR_CALL_ARTEC(asdk::launchJob(job, &current_workset, job_observer), 
+                    "Error launching next algorithm");
+        }
+        catch (std::exception& e)
+        {
+            // Called from the SDK observer thread, nobody else would release the slot
+            RR_ARTEC_LOG_ERROR("Error launching next algorithm: " << e.what());
+            if (ticket)
+            {
+                ticket->release_algorithm_threads(current_threads);
+            }
+            current_threads = 0;
+            ticket.reset();
+            artec_job_complete = true;
+            artec_job_status = asdk::ErrorCode_OperationFailed;
+            auto h = take_next_handler();
+            if (h)
+            {
+                complete_gen(h);
+            }
+            return;
+        }
         
         current_algorithm = next_algorithm;
-        auto h = next_handler;
-        next_handler.clear();
-        if (h)
+        auto h = take_next_handler();
+        if (!h)
         {
-            auto ret = rr_artec::RunAlgorithmsStatusPtr(new rr_artec::RunAlgorithmsStatus());
-            ret->action_status = rr_action::ActionStatusCode::running;
-            ret->output_model_handle = 0;
-            ret->current_algorithm = current_algorithm;
-            last_algorithm_update = current_algorithm;
-            lock.unlock();
-            h(ret, nullptr);
+            progress_pending = true;
             return;
         }
+        auto ret = progress_status();
+        lock.unlock();
+        h(ret, nullptr);
+        return;
     }
     else
     {
         artec_job_complete = true;
         artec_job_status = result;
-        auto h = next_handler;
-        next_handler.clear();
+        ticket.reset();
+        auto h = take_next_handler();
         if (h)
         {
-            try
-            {
-                next_timer->Stop();
-            }
-            catch (std::exception&) {}
-
             complete_gen(h);
             return;
         }
@@ -315,29 +468,45 @@ void RunAlgorithms::complete_gen(boost::function<void(const experimental::artec_
         return;
     }
 
-    auto handle = GetParent()->add_model(current_output_model);
+    auto parent = GetParent();
+    auto handle = parent->add_model(current_output_model);
+    auto intermediate_handles = RR::AllocateRRArray<int32_t>(retained_models.size());
+    for (size_t i = 0; i < retained_models.size(); i++)
+    {
+        (*intermediate_handles)[i] = parent->add_model(retained_models[i]);
+    }
     auto ret = rr_artec::RunAlgorithmsStatusPtr(new rr_artec::RunAlgorithmsStatus());
     ret->action_status = rr_action::ActionStatusCode::complete;
     ret->output_model_handle = handle;
+    ret->intermediate_model_handles = intermediate_handles;
     ret->current_algorithm = current_algorithm;
+    fill_progress(ret);
+    ret->queue_position = 0;
+    ret->percent_complete = 100.0;
+    ret->remaining_time = 0.0;
     handler(ret,nullptr);
 }
 
-void RunAlgorithms::next_timer_handler(const RobotRaconteur::TimerEvent& evt)
+rr_artec::RunAlgorithmsStatusPtr RunAlgorithms::progress_status()
 {
-    boost::mutex::scoped_lock lock(this_lock);
-    auto h = next_handler;
-    next_handler.clear();
-    if (h)
-    {
-        auto ret = rr_artec::RunAlgorithmsStatusPtr(new rr_artec::RunAlgorithmsStatus());
-        ret->action_status = rr_action::ActionStatusCode::running;
-        ret->output_model_handle = 0;
-        ret->current_algorithm = current_algorithm;
-        last_algorithm_update = current_algorithm;
-        h(ret, nullptr);
-        return;
-    }
+    auto ret = rr_artec::RunAlgorithmsStatusPtr(new rr_artec::RunAlgorithmsStatus());
+    ret->action_status = launched ? rr_action::ActionStatusCode::running : rr_action::ActionStatusCode::pending;
+    ret->output_model_handle = 0;
+    ret->current_algorithm = current_algorithm;
+    fill_progress(ret);
+    ret->queue_position = (!launched && ticket) ? ticket->get_queue_position() : 0;
+    ret->intermediate_model_handles = RR::AllocateEmptyRRArray<int32_t>(0);
+    return ret;
+}
+
+void RunAlgorithms::fill_progress(const rr_artec::RunAlgorithmsStatusPtr& status)
+{
+    JobProgress p = progress_sink->get_progress();
+    status->percent_complete = p.percent;
+    status->elapsed_time = p.elapsed_time;
+    status->remaining_time = p.remaining_time;
+    status->total_elapsed_time = started ?
+        boost::chrono::duration<double>(boost::chrono::steady_clock::now() - run_start).count() : 0.0;
 }
 
 RunAlgorithmsJobObserver::RunAlgorithmsJobObserver(boost::shared_ptr<RunAlgorithms> parent, uint32_t job_number)
@@ -0,0 +1,467 @@
+#include "artec_scanner_algorithm_graph.h"
+#include "artec_scanner_algorithm_util.h"
+#include "artec_scanner_impl.h"
+#include "artec_scanner_thread_budget.h"
+
+#include <artec/sdk/algorithms/Algorithms.h>
+#include <artec/sdk/base/IScan.h>
+
+#include <map>
+
+namespace asdk {
+    using namespace artec::sdk::base;
+    using namespace artec::sdk::algorithms;
+};
+using asdk::TRef;
+
+namespace RR=RobotRaconteur;
+namespace rr_artec = experimental::artec_scanner;
+namespace rr_action = com::robotraconteur::action;
+
+namespace artec_scanner_robotraconteur_driver
+{
+
+boost::shared_ptr<ArtecScannerImpl> RunAlgorithmGraph::GetParent()
+{
+    auto p = parent.lock();
+    if (!p) {
+        RR_ARTEC_LOG_ERROR("ArtecScannerImpl parent has been released");
+        throw RR::InvalidOperationException("ArtecScannerImpl parent has been released");
+    }
+    return p;
+}
+
+RunAlgorithmGraph::RunAlgorithmGraph(boost::shared_ptr<ArtecScannerImpl> parent)
+{
+    this->parent = parent;
+}
+
+void RunAlgorithmGraph::Init(boost::shared_ptr<RRArtecModel> input_model,
+    const RR::RRListPtr<rr_artec::AlgorithmGraphNode>& graph_nodes)
+{
+    if (input_model->model->getSize() <= 0)
+    {
+        RR_ARTEC_LOG_ERROR("Model passed to run_algorithm_graph does not contain any scans")
+        throw RR::InvalidArgumentException("Model passed to run_algorithm_graph does not contain any scans");
+    }
+
+    if (!graph_nodes || graph_nodes->empty())
+    {
+        RR_ARTEC_LOG_ERROR("No nodes specified to run_algorithm_graph");
+        throw RR::InvalidArgumentException("No nodes specified");
+    }
+
+    this->input_model = input_model;
+
+    auto scanner_type = input_model->model->getElement(0)->getScannerType();
+
+    std::vector<Node> new_nodes(graph_nodes->size());
+    std::map<std::string, int32_t> node_index;
+    for (size_t i = 0; i < graph_nodes->size(); i++)
+    {
+        auto& graph_node = graph_nodes->at(i);
+        if (!graph_node)
+        {
+            throw RR::NullValueException("Algorithm graph node must not be null");
+        }
+        if (graph_node->name.empty())
+        {
+            RR_ARTEC_LOG_ERROR("Algorithm graph node " << i << " has an empty name");
+            throw RR::InvalidArgumentException("Algorithm graph node names must not be empty");
+        }
+        if (!node_index.insert(std::make_pair(graph_node->name, static_cast<int32_t>(i))).second)
+        {
+            RR_ARTEC_LOG_ERROR("Duplicate algorithm graph node name: " << graph_node->name);
+            throw RR::InvalidArgumentException("Duplicate algorithm graph node name: " + graph_node->name);
+        }
+
+        auto& node = new_nodes[i];
+        node.name = graph_node->name;
+        node.output = graph_node->output.value != 0;
+        create_algorithm(&node.algorithm, graph_node->algorithm, scanner_type, &node.threads_count);
+    }
+
+    for (size_t i = 0; i < graph_nodes->size(); i++)
+    {
+        const std::string& input = graph_nodes->at(i)->input;
+        if (input.empty())
+        {
+            continue;
+        }
+        auto e = node_index.find(input);
+        if (e == node_index.end())
+        {
+            RR_ARTEC_LOG_ERROR("Algorithm graph node " << new_nodes[i].name << " has unknown input " << input);
+            throw RR::InvalidArgumentException("Unknown algorithm graph node input: " + input);
+        }
+        new_nodes[i].input = e->second;
+    }
+
+    // Each node has a single input, so a node is reachable from the graph input if its chain
+    // of inputs ends within the node count
+    for (size_t i = 0; i < new_nodes.size(); i++)
+    {
+        int32_t n = new_nodes[i].input;
+        size_t steps = 0;
+        while (n >= 0 && steps <= new_nodes.size())
+        {
+            n = new_nodes[n].input;
+            steps++;
+        }
+        if (n >= 0)
+        {
+            RR_ARTEC_LOG_ERROR("Algorithm graph node " << new_nodes[i].name << " is part of a cycle");
+            throw RR::InvalidArgumentException("Algorithm graph contains a cycle at node: " + new_nodes[i].name);
+        }
+    }
+
+    nodes.swap(new_nodes);
+}
+
+void RunAlgorithmGraph::launch_node(size_t index, boost::shared_ptr<RRArtecModel> node_input)
+{
+    auto& node = nodes.at(index);
+    node.output_model = RR_MAKE_SHARED<RRArtecModel>();
+    node.workset.in = node_input->model;
+    node.workset.out = node.output_model->model;
+    node.workset.cancellation = ct_source->getToken();
+    node.workset.progress = nullptr;
+    node.threads = ticket->acquire_algorithm_threads(node.threads_count);
+    node.workset.threadsCount = node.threads;
+
+    auto job_observer = new RunAlgorithmGraphJobObserver(shared_from_this(), static_cast<uint32_t>(index));
+    try
+    {
+        RR_CALL_ARTEC(asdk::launchJob(node.algorithm, &node.workset, job_observer),
+            "Error launching algorithm graph node " + node.name);
+    }
+    catch (std::exception&)
+    {
+        ticket->release_algorithm_threads(node.threads);
+        node.threads = 0;
+        throw;
+    }
+    node.running = true;
+    running_count++;
+}
+
+void RunAlgorithmGraph::launch_children(int32_t index, boost::shared_ptr<RRArtecModel> node_input)
+{
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        if (nodes[i].input == index)
+        {
+            launch_node(i, node_input);
+        }
+    }
+}
+
+bool RunAlgorithmGraph::graph_done()
+{
+    if (running_count > 0)
+    {
+        return false;
+    }
+    return completed_count == nodes.size() || failed_status != asdk::ErrorCode_OK || closed || aborted;
+}
+
+void RunAlgorithmGraph::AsyncNext(boost::function<void(const rr_artec::RunAlgorithmGraphStatusPtr&,
+    const RR::RobotRaconteurExceptionPtr&)> handler, int32_t timeout)
+{
+    boost::mutex::scoped_lock lock(this_lock);
+    if (aborted)
+    {
+        throw RR::OperationAbortedException("Algorithm graph operation was aborted");
+    }
+    if (closed || completed)
+    {
+        throw RR::StopIterationException("");
+    }
+
+    if (!started)
+    {
+        RR_CALL_ARTEC(asdk::createCancellationTokenSource(&ct_source), "Error creating cancellation source");
+
+        // Each root branch holds its own copy of the input model while it runs
+        size_t root_count = 0;
+        for (auto& node : nodes)
+        {
+            if (node.input < 0)
+            {
+                root_count++;
+            }
+        }
+        uint64_t memory_estimate = EstimateModelBytes(input_model->model) * ALGORITHM_JOB_MEMORY_FACTOR * root_count;
+        boost::weak_ptr<RunAlgorithmGraph> weak_this = shared_from_this();
+        bool admitted = false;
+        ticket = GetParent()->job_scheduler->submit(0, memory_estimate, [weak_this]()
+        {
+            auto t = weak_this.lock();
+            if (!t) return;
+            t->scheduled_start();
+        }, admitted);
+        started = true;
+        if (admitted)
+        {
+            try
+            {
+                launch_roots();
+            }
+            catch (std::exception&)
+            {
+                // Jobs already launched are cancelled and complete in the background
+                completed = true;
+                ct_source->cancel();
+                ticket.reset();
+                throw;
+            }
+        }
+        else
+        {
+            RR_ARTEC_LOG_INFO("Algorithm graph queued at position " << ticket->get_queue_position());
+        }
+        auto ret = progress_status();
+        lock.unlock();
+        handler(ret, nullptr);
+        return;
+    }
+
+    if (next_handler)
+    {
+        throw RR::InvalidOperationException("Next call already in progress");
+    }
+
+    if (graph_done())
+    {
+        complete_gen(handler);
+        return;
+    }
+
+    // Replies immediately if a node finished since the last reply
+    wait_progress(lock, handler);
+}
+
+void RunAlgorithmGraph::launch_roots()
+{
+    launched = true;
+    launch_children(-1, input_model);
+    RR_ARTEC_LOG_INFO("Started algorithm graph with " << nodes.size() << " nodes");
+}
+
+void RunAlgorithmGraph::scheduled_start()
+{
+    boost::mutex::scoped_lock lock(this_lock);
+    if (closed || aborted || launched || completed)
+    {
+        ticket.reset();
+        return;
+    }
+    try
+    {
+        launch_roots();
+    }
+    catch (std::exception& e)
+    {
+        RR_ARTEC_LOG_ERROR("Error launching queued algorithm graph: " << e.what());
+        failed_status = asdk::ErrorCode_OperationFailed;
+        ct_source->cancel();
+        // Root jobs launched before the failure complete through node_job_complete
+        if (graph_done())
+        {
+            ticket.reset();
+            auto h = take_next_handler();
+            if (h)
+            {
+                complete_gen(h);
+            }
+        }
+        return;
+    }
+    lock.unlock();
+    notify_progress();
+}
+
+void RunAlgorithmGraph::AsyncClose(boost::function<void(const RR::RobotRaconteurExceptionPtr& err)> handler,
+                int32_t timeout)
+{
+    boost::mutex::scoped_lock lock(this_lock);
+    if (closed || aborted)
+    {
+        lock.unlock();
+        handler(nullptr);
+        return;
+    }
+    closed = true;
+    if (ct_source)
+    {
+        this->ct_source->cancel();
+    }
+    if (!launched)
+    {
+        ticket.reset();
+    }
+    lock.unlock();
+    handler(nullptr);
+}
+
+void RunAlgorithmGraph::AsyncAbort(boost::function<void(const RR::RobotRaconteurExceptionPtr& err)> handler,
+                int32_t timeout)
+{
+    boost::mutex::scoped_lock lock(this_lock);
+    if (closed || aborted)
+    {
+        lock.unlock();
+        handler(nullptr);
+        return;
+    }
+    aborted = true;
+    if (ct_source)
+    {
+        this->ct_source->cancel();
+    }
+    if (!launched)
+    {
+        ticket.reset();
+    }
+    lock.unlock();
+    handler(nullptr);
+}
+
+void RunAlgorithmGraph::node_job_complete(artec::sdk::base::ErrorCode result, uint32_t node_index)
+{
+    boost::mutex::scoped_lock lock(this_lock);
+    auto& node = nodes.at(node_index);
+    node.running = false;
+    running_count--;
+    if (ticket)
+    {
+        ticket->release_algorithm_threads(node.threads);
+    }
+    node.threads = 0;
+
+    if (result == asdk::ErrorCode_OK)
+    {
+        node.done = true;
+        completed_count++;
+        if (failed_status == asdk::ErrorCode_OK && !closed && !aborted)
+        {
+            // Each child gets its own workset and output model, sharing this node's output as input
+            try
+            {
+                launch_children(static_cast<int32_t>(node_index), node.output_model);
+            }
+            catch (std::exception&)
+            {
+                failed_status = asdk::ErrorCode_OperationFailed;
+                failed_node = node.name;
+                ct_source->cancel();
+            }
+        }
+    }
+    else if (failed_status == asdk::ErrorCode_OK)
+    {
+        // The first failure cancels the rest of the graph
+        RR_ARTEC_LOG_ERROR("Algorithm graph node " << node.name << " failed");
+        failed_status = result;
+        failed_node = node.name;
+        ct_source->cancel();
+    }
+
+    if (graph_done())
+    {
+        ticket.reset();
+        auto h = take_next_handler();
+        if (h)
+        {
+            complete_gen(h);
+        }
+        return;
+    }
+
+    lock.unlock();
+    notify_progress();
+}
+
+void RunAlgorithmGraph::complete_gen(boost::function<void(const rr_artec::RunAlgorithmGraphStatusPtr&,
+    const RR::RobotRaconteurExceptionPtr&)> handler)
+{
+    RR_ARTEC_LOG_INFO("Algorithm graph execution complete");
+
+    completed = true;
+
+    if (failed_status != asdk::ErrorCode_OK)
+    {
+        auto exp = ArtecErrorToExceptionPtr(failed_status, "Algorithm graph execution failed for node: " + failed_node);
+        handler(nullptr, exp);
+        return;
+    }
+
+    if (completed_count != nodes.size())
+    {
+        handler(nullptr, RR_MAKE_SHARED<RR::OperationAbortedException>("Algorithm graph operation was cancelled"));
+        return;
+    }
+
+    // Nodes marked as output, or the leaves if no node is marked
+    bool any_output = false;
+    std::vector<bool> has_children(nodes.size(), false);
+    for (auto& node : nodes)
+    {
+        any_output = any_output || node.output;
+        if (node.input >= 0)
+        {
+            has_children[node.input] = true;
+        }
+    }
+
+    auto parent = GetParent();
+    auto handles = RR::AllocateEmptyRRMap<std::string, RR::RRArray<int32_t> >();
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        if (any_output ? nodes[i].output : !has_children[i])
+        {
+            auto handle = parent->add_model(nodes[i].output_model);
+            handles->insert(std::make_pair(nodes[i].name, RR::ScalarToRRArray(handle)));
+        }
+    }
+
+    auto ret = progress_status();
+    ret->action_status = rr_action::ActionStatusCode::complete;
+    ret->output_model_handles = handles;
+    handler(ret, nullptr);
+}
+
+rr_artec::RunAlgorithmGraphStatusPtr RunAlgorithmGraph::progress_status()
+{
+    auto ret = rr_artec::RunAlgorithmGraphStatusPtr(new rr_artec::RunAlgorithmGraphStatus());
+    ret->action_status = launched ? rr_action::ActionStatusCode::running : rr_action::ActionStatusCode::pending;
+    ret->queue_position = (!launched && ticket) ? ticket->get_queue_position() : 0;
+    ret->completed_count = static_cast<uint32_t>(completed_count);
+    ret->node_count = static_cast<uint32_t>(nodes.size());
+    ret->running_nodes = RR::AllocateEmptyRRList<RR::RRArray<char> >();
+    for (auto& node : nodes)
+    {
+        if (node.running)
+        {
+            ret->running_nodes->push_back(RR::stringToRRArray(node.name));
+        }
+    }
+    ret->output_model_handles = RR::AllocateEmptyRRMap<std::string, RR::RRArray<int32_t> >();
+    return ret;
+}
+
+RunAlgorithmGraphJobObserver::RunAlgorithmGraphJobObserver(boost::shared_ptr<RunAlgorithmGraph> parent, uint32_t node_index)
+{
+    this->parent = parent;
+    this->node_index = node_index;
+}
+
+void RunAlgorithmGraphJobObserver::completed(artec::sdk::base::ErrorCode result)
+{
+    auto p = parent;
+    parent.reset();
+    if (!p) return;
+    p->node_job_complete(result, node_index);
+}
+
+}
@@ -5,6 +5,9 @@
 
 #include "artec_scanner_impl.h"
 
+#include <cstring>
+#include <sstream>
+
 #define RR_ARTEC_PREFIX "experimental.artec_scanner."
 
 namespace asdk {
@@ -186,6 +189,337 @@ void create_outliers_removal_algorithm(artec::sdk::algorithms::IAlgorithm** alg,
     RR_CALL_ARTEC(asdk::createOutliersRemovalAlgorithm(alg, &s), "Could not create OutlierRemovalsAlgorithm");
 }
 
+void create_algorithm(artec::sdk::algorithms::IAlgorithm** alg, const RobotRaconteur::RRValuePtr& settings,
+    artec::sdk::base::ScannerType scanner_type, uint32_t* threads_count)
+{
+    *alg = nullptr;
+    RR_NULL_CHECK(settings);
+    RR::RRMapPtr<std::string,RR::RRValue> extended;
+    auto alg_rr_type = settings->RRType();
+    // Look at type of each algorithm and dispatch appropriately
+    if (alg_rr_type == (RR_ARTEC_PREFIX "AutoAlignAlgorithm"))
+    {
+        auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::AutoAlignAlgorithm>(settings);
+        create_auto_align_algorithm(alg, alg2, scanner_type); 
+        extended = alg2->extended;
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "FastFusionAlgorithm"))
+    {
+        auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::FastFusionAlgorithm>(settings);
+        create_fast_fusion_algorithm(alg, alg2, scanner_type); 
+        extended = alg2->extended;
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "FastMeshSimplificationAlgorithm"))
+    {
+        auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::FastMeshSimplificationAlgorithm>(settings);
+        create_fast_mesh_simplification_algorithm(alg, alg2, scanner_type); 
+        extended = alg2->extended;
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "GlobalRegistrationAlgorithm"))
+    {
+        auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::GlobalRegistrationAlgorithm>(settings);
+        create_global_registration_algorithm(alg, alg2, scanner_type); 
+        extended = alg2->extended;
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "LoopClosureAlgorithm"))
+    {
+        auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::LoopClosureAlgorithm>(settings);
+        create_loop_closure_algorithm(alg, alg2, scanner_type); 
+        extended = alg2->extended;
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "MeshSimplificationAlgorithm"))
+    {
+        auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::MeshSimplificationAlgorithm>(settings);
+        create_mesh_simplification_algorithm(alg, alg2, scanner_type); 
+        extended = alg2->extended;
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "OutliersRemovalAlgorithm"))
+    {
+        auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::OutliersRemovalAlgorithm>(settings);
+        create_outliers_removal_algorithm(alg, alg2, scanner_type); 
+        extended = alg2->extended;
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "PoissonFusionAlgorithm"))
+    {
+        auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::PoissonFusionAlgorithm>(settings);
+        create_poisson_fusion_algorithm(alg, alg2, scanner_type); 
+        extended = alg2->extended;
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "SerialRegistrationAlgorithm"))
+    {
+        auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::SerialRegistrationAlgorithm>(settings);
+        create_serial_registration_algorithm(alg, alg2, scanner_type); 
+        extended = alg2->extended;
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "SmallObjectsFilterAlgorithm"))
+    {
+        auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::SmallObjectsFilterAlgorithm>(settings);
+        create_small_objects_filter_algorithm(alg, alg2, scanner_type); 
+        extended = alg2->extended;
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "TexturizationAlgorithm"))
+    {
+        auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::TexturizationAlgorithm>(settings);
+        create_texturization_algorithm(alg, alg2, scanner_type); 
+        extended = alg2->extended;
+    }
+    
+
+    if (!*alg)
+    {
+        RR_ARTEC_LOG_ERROR("Invalid algorithm type: " << alg_rr_type);
+        throw RR::InvalidArgumentException("Invalid algorithm type: " + alg_rr_type);
+    }
+    if (threads_count)
+    {
+        *threads_count = GetExtendedThreadsCount(extended);
+    }
+}
+
+// Writes the settings fields in a fixed order. Floats are written as their bit pattern so
+// equal keys mean bit identical settings.
+class AlgorithmSettingsKeyWriter
+{
+    protected:
+        std::ostringstream s;
+
+    public:
+        AlgorithmSettingsKeyWriter(const std::string& type)
+        {
+            s << type;
+        }
+
+        AlgorithmSettingsKeyWriter& field(float v)
+        {
+            uint32_t bits;
+            std::memcpy(&bits, &v, sizeof(bits));
+            s << ";f" << std::hex << bits << std::dec;
+            return *this;
+        }
+
+        AlgorithmSettingsKeyWriter& field(int32_t v)
+        {
+            s << ";i" << v;
+            return *this;
+        }
+
+        AlgorithmSettingsKeyWriter& field(RR::rr_bool v)
+        {
+            s << ";b" << (v.value != 0 ? 1 : 0);
+            return *this;
+        }
+
+        std::string str() const
+        {
+            return s.str();
+        }
+};
+
+std::string algorithm_settings_key(const RobotRaconteur::RRValuePtr& settings)
+{
+    RR_NULL_CHECK(settings);
+    auto alg_rr_type = settings->RRType();
+    AlgorithmSettingsKeyWriter k(alg_rr_type);
+    // Only the fields passed to the Artec settings by the create_* functions are part of the key
+    if (alg_rr_type == (RR_ARTEC_PREFIX "AutoAlignAlgorithm"))
+    {
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "FastFusionAlgorithm"))
+    {
+        auto s = RR_DYNAMIC_POINTER_CAST<rr_artec::FastFusionAlgorithm>(settings);
+        k.field(s->generate_normals).field(s->radius).field(s->resolution);
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "FastMeshSimplificationAlgorithm"))
+    {
+        auto s = RR_DYNAMIC_POINTER_CAST<rr_artec::FastMeshSimplificationAlgorithm>(settings);
+        k.field(s->triangle_number).field(s->keep_boundary).field(s->enable_additional_criteria)
+            .field(s->enable_distance_threshold).field(s->distance_threshold)
+            .field(s->enable_angle_threshold).field(s->angle_threshold)
+            .field(s->enable_aspect_ratio_threshold).field(s->aspect_ratio_threshold);
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "GlobalRegistrationAlgorithm"))
+    {
+        auto s = RR_DYNAMIC_POINTER_CAST<rr_artec::GlobalRegistrationAlgorithm>(settings);
+        k.field(static_cast<int32_t>(s->registration_type));
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "LoopClosureAlgorithm"))
+    {
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "MeshSimplificationAlgorithm"))
+    {
+        auto s = RR_DYNAMIC_POINTER_CAST<rr_artec::MeshSimplificationAlgorithm>(settings);
+        k.field(static_cast<int32_t>(s->simplify_type)).field(static_cast<int32_t>(s->simplify_metrics))
+            .field(s->triangle_number).field(s->keep_boundary).field(s->angle_threshold)
+            .field(s->remesh_edge_threshold).field(s->error);
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "OutliersRemovalAlgorithm"))
+    {
+        auto s = RR_DYNAMIC_POINTER_CAST<rr_artec::OutliersRemovalAlgorithm>(settings);
+        k.field(s->standard_deviation_multiplier).field(s->resolution);
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "PoissonFusionAlgorithm"))
+    {
+        auto s = RR_DYNAMIC_POINTER_CAST<rr_artec::PoissonFusionAlgorithm>(settings);
+        k.field(static_cast<int32_t>(s->fusion_type)).field(static_cast<int32_t>(s->fill_type))
+            .field(s->resolution).field(s->max_hole_radius).field(s->remove_targets)
+            .field(s->target_inner_size).field(s->target_outer_size).field(s->generate_normals);
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "SerialRegistrationAlgorithm"))
+    {
+        auto s = RR_DYNAMIC_POINTER_CAST<rr_artec::SerialRegistrationAlgorithm>(settings);
+        k.field(static_cast<int32_t>(s->registration_type));
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "SmallObjectsFilterAlgorithm"))
+    {
+        auto s = RR_DYNAMIC_POINTER_CAST<rr_artec::SmallObjectsFilterAlgorithm>(settings);
+        k.field(static_cast<int32_t>(s->filter_type)).field(s->filter_threshold);
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "TexturizationAlgorithm"))
+    {
+        auto s = RR_DYNAMIC_POINTER_CAST<rr_artec::TexturizationAlgorithm>(settings);
+        k.field(static_cast<int32_t>(s->texturize_type)).field(static_cast<int32_t>(s->texturize_resolution))
+            .field(s->enable_background_segmentation).field(s->enable_ambient_lighting_compensation)
+            .field(s->atlas_unfolding_polygon_limit).field(s->enable_texture_inpainting)
+            .field(s->use_texture_normalization).field(static_cast<int32_t>(s->input_filter_type));
+    }
+    else
+    {
+        RR_ARTEC_LOG_ERROR("Invalid algorithm type: " << alg_rr_type);
+        throw RR::InvalidArgumentException("Invalid algorithm type: " + alg_rr_type);
+    }
+    return k.str();
+}
+
+AlgorithmResultCache::AlgorithmResultCache(size_t max_entries, uint64_t memory_budget)
+{
+    this->max_entries = max_entries;
+    this->memory_budget = memory_budget;
+}
+
+std::string AlgorithmResultCache::chain_key(uint64_t input_model_id, const std::vector<std::string>& settings_keys,
+    size_t count)
+{
+    std::ostringstream s;
+    s << input_model_id;
+    for (size_t i = 0; i < count; i++)
+    {
+        s << '|' << settings_keys.at(i);
+    }
+    return s.str();
+}
+
+boost::shared_ptr<RRArtecModel> AlgorithmResultCache::get(const std::string& key)
+{
+    boost::mutex::scoped_lock lock(this_lock);
+    auto e = entries.find(key);
+    if (e == entries.end())
+    {
+        return boost::shared_ptr<RRArtecModel>();
+    }
+    lru.remove(key);
+    lru.push_front(key);
+    return e->second.output;
+}
+
+void AlgorithmResultCache::put(const std::string& key, uint64_t input_model_id, boost::shared_ptr<RRArtecModel> output)
+{
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        if (max_entries == 0)
+        {
+            return;
+        }
+    }
+
+    uint64_t bytes = EstimateModelBytes(output->model);
+
+    boost::mutex::scoped_lock lock(this_lock);
+    if (max_entries == 0 || (memory_budget > 0 && bytes > memory_budget))
+    {
+        return;
+    }
+    auto existing = entries.find(key);
+    if (existing != entries.end())
+    {
+        erase(existing);
+    }
+    Entry& e = entries[key];
+    e.input_model_id = input_model_id;
+    e.output = output;
+    e.bytes = bytes;
+    total_bytes += bytes;
+    lru.push_front(key);
+    trim();
+}
+
+void AlgorithmResultCache::remove_model(uint64_t model_id)
+{
+    boost::mutex::scoped_lock lock(this_lock);
+    for (auto e = entries.begin(); e != entries.end(); )
+    {
+        if (e->second.input_model_id == model_id || e->second.output->model_id == model_id)
+        {
+            e = erase(e);
+        }
+        else
+        {
+            ++e;
+        }
+    }
+}
+
+void AlgorithmResultCache::set_limits(size_t max_entries, uint64_t memory_budget)
+{
+    boost::mutex::scoped_lock lock(this_lock);
+    this->max_entries = max_entries;
+    this->memory_budget = memory_budget;
+    trim();
+}
+
+void AlgorithmResultCache::clear()
+{
+    boost::mutex::scoped_lock lock(this_lock);
+    entries.clear();
+    lru.clear();
+    total_bytes = 0;
+}
+
+std::map<std::string, AlgorithmResultCache::Entry>::iterator AlgorithmResultCache::erase(
+    std::map<std::string, Entry>::iterator e)
+{
+    lru.remove(e->first);
+    total_bytes -= e->second.bytes;
+    return entries.erase(e);
+}
+
+void AlgorithmResultCache::trim()
+{
+    while (!lru.empty() && (lru.size() > max_entries || (memory_budget > 0 && total_bytes > memory_budget)))
+    {
+        erase(entries.find(lru.back()));
+    }
+}
+
 RobotRaconteur::RRValuePtr util_initialize_algorithm(boost::shared_ptr<RRArtecModel> model, const std::string& algorithm)
 {
     if (model->model->getSize() <= 0)
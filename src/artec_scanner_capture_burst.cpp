@@ -0,0 +1,94 @@
+#include "artec_scanner_capture_burst.h"
+#include "artec_scanner_impl.h"
+
+#include <artec/sdk/capturing/IFrame.h>
+
+namespace asdk {
+    using namespace artec::sdk::base;
+    using namespace artec::sdk::capturing;
+};
+using asdk::TRef;
+
+namespace RR=RobotRaconteur;
+
+namespace artec_scanner_robotraconteur_driver
+{
+    CaptureBurst::CaptureBurst(asdk::IScanner* scanner, double rate, uint32_t max_frames)
+        : stop_requested(false), captured_count(0)
+    {
+        this->scanner = scanner;
+        period = boost::chrono::steady_clock::duration::zero();
+        if (rate > 0.0)
+        {
+            period = boost::chrono::duration_cast<boost::chrono::steady_clock::duration>(
+                boost::chrono::duration<double>(1.0 / rate));
+        }
+
+        frames.reserve(max_frames);
+        for (uint32_t i = 0; i < max_frames; i++)
+        {
+            frames.push_back(boost::make_shared<RRDeferredCapture>());
+        }
+    }
+
+    void CaptureBurst::start()
+    {
+        capture_thread = boost::thread(boost::bind(&CaptureBurst::capture_thread_func, this));
+    }
+
+    void CaptureBurst::capture_thread_func()
+    {
+        auto next_capture = boost::chrono::steady_clock::now();
+        while (!stop_requested.load())
+        {
+            if (period != boost::chrono::steady_clock::duration::zero())
+            {
+                boost::this_thread::sleep_until(next_capture);
+                next_capture += period;
+                if (stop_requested.load())
+                {
+                    break;
+                }
+            }
+
+            TRef<asdk::IFrame> frame;
+            asdk::ErrorCode res = scanner->capture(&frame, false);
+            if (res != asdk::ErrorCode_OK)
+            {
+                RR_ARTEC_LOG_ERROR("Capture burst stopped after capture error: " << (int32_t)res);
+                break;
+            }
+
+            uint64_t n = captured_count.load();
+            frames[n]->frame = frame;
+            captured_count.store(n + 1);
+            if (n + 1 == frames.size())
+            {
+                RR_ARTEC_LOG_INFO("Capture burst stopped capturing after max_frames " << frames.size() << " frames");
+                break;
+            }
+        }
+    }
+
+    std::vector<RRDeferredCapturePtr> CaptureBurst::stop()
+    {
+        stop_requested.store(true);
+        capture_thread.interrupt();
+        capture_thread.join();
+
+        uint64_t n = captured_count.load();
+        return std::vector<RRDeferredCapturePtr>(frames.begin(), frames.begin() + static_cast<size_t>(n));
+    }
+
+    uint64_t CaptureBurst::get_captured_count()
+    {
+        return captured_count.load();
+    }
+
+    CaptureBurst::~CaptureBurst()
+    {
+        stop_requested.store(true);
+        capture_thread.interrupt();
+        capture_thread.join();
+    }
+}
@@ -0,0 +1,399 @@
+#include "artec_scanner_compact_mesh.h"
+#include "artec_scanner_image_encode.h"
+#include "artec_scanner_worker_pool.h"
+
+#include <zlib.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace artec_scanner_robotraconteur_driver
+{
+    static const uint8_t COMPACT_MESH_MAGIC[4] = { 'A', 'C', 'M', 'F' };
+    static const uint8_t COMPACT_MESH_VERSION = 1;
+    static const uint8_t COMPACT_MESH_FLAG_NORMALS = 0x01;
+    static const uint8_t COMPACT_MESH_FLAG_DEFLATE = 0x02;
+    static const size_t COMPACT_MESH_HEADER_SIZE = 64;
+    static const size_t COMPACT_MESH_VERTEX_CHUNK = 16384;
+
+    static void put_le16(uint8_t* p, uint32_t v)
+    {
+        p[0] = static_cast<uint8_t>(v);
+        p[1] = static_cast<uint8_t>(v >> 8);
+    }
+
+    static void put_le32(uint8_t* p, uint32_t v)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            p[i] = static_cast<uint8_t>(v >> (8 * i));
+        }
+    }
+
+    static void put_le_f64(uint8_t* p, double v)
+    {
+        uint64_t u;
+        memcpy(&u, &v, 8);
+        for (int i = 0; i < 8; i++)
+        {
+            p[i] = static_cast<uint8_t>(u >> (8 * i));
+        }
+    }
+
+    static uint32_t get_le16(const uint8_t* p)
+    {
+        return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8);
+    }
+
+    static uint32_t get_le32(const uint8_t* p)
+    {
+        return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8)
+            | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    }
+
+    static double get_le_f64(const uint8_t* p)
+    {
+        uint64_t u = 0;
+        for (int i = 0; i < 8; i++)
+        {
+            u |= static_cast<uint64_t>(p[i]) << (8 * i);
+        }
+        double v;
+        memcpy(&v, &u, 8);
+        return v;
+    }
+
+    static void put_varint(std::vector<uint8_t>& out, uint32_t v)
+    {
+        while (v >= 0x80)
+        {
+            out.push_back(static_cast<uint8_t>(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(v));
+    }
+
+    static uint32_t zigzag(int64_t v)
+    {
+        return static_cast<uint32_t>((v << 1) ^ (v >> 63));
+    }
+
+    static int64_t unzigzag(uint32_t v)
+    {
+        return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+    }
+
+    static int16_t to_snorm16(float v)
+    {
+        v = (std::max)(-1.0f, (std::min)(1.0f, v));
+        return static_cast<int16_t>(std::floor(v * 32767.0f + 0.5f));
+    }
+
+    static float sign_not_zero(float v)
+    {
+        return v < 0.0f ? -1.0f : 1.0f;
+    }
+
+    // Octahedral mapping of a unit vector onto the [-1,1] square
+    static void octahedral_encode(const float* n, int16_t* oct)
+    {
+        float l1 = std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+        if (!(l1 > 0.0f))
+        {
+            oct[0] = 0;
+            oct[1] = 0;
+            return;
+        }
+        float x = n[0] / l1;
+        float y = n[1] / l1;
+        if (n[2] < 0.0f)
+        {
+            float ox = (1.0f - std::fabs(y)) * sign_not_zero(x);
+            float oy = (1.0f - std::fabs(x)) * sign_not_zero(y);
+            x = ox;
+            y = oy;
+        }
+        oct[0] = to_snorm16(x);
+        oct[1] = to_snorm16(y);
+    }
+
+    static void octahedral_decode(int16_t ox, int16_t oy, float* n)
+    {
+        float x = (std::max)(-1.0f, ox / 32767.0f);
+        float y = (std::max)(-1.0f, oy / 32767.0f);
+        float z = 1.0f - std::fabs(x) - std::fabs(y);
+        if (z < 0.0f)
+        {
+            float nx = (1.0f - std::fabs(y)) * sign_not_zero(x);
+            float ny = (1.0f - std::fabs(x)) * sign_not_zero(y);
+            x = nx;
+            y = ny;
+        }
+        float len = std::sqrt(x * x + y * y + z * z);
+        n[0] = x / len;
+        n[1] = y / len;
+        n[2] = z / len;
+    }
+
+    void EncodeCompactMesh(const float* points, size_t vertex_count, const float* normals,
+        const int32_t* triangles, size_t triangle_count, double scale, bool deflate, std::vector<uint8_t>& out)
+    {
+        if (vertex_count > std::numeric_limits<uint32_t>::max() || triangle_count > std::numeric_limits<uint32_t>::max())
+        {
+            throw std::invalid_argument("Mesh too large for compact format");
+        }
+
+        double origin[3] = { 0.0, 0.0, 0.0 };
+        double step[3] = { 0.0, 0.0, 0.0 };
+        float lo[3] = { 0.0f, 0.0f, 0.0f };
+        if (vertex_count > 0)
+        {
+            lo[0] = points[0];
+            lo[1] = points[1];
+            lo[2] = points[2];
+            float hi[3] = { points[0], points[1], points[2] };
+            for (size_t i = 1; i < vertex_count; i++)
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    lo[k] = (std::min)(lo[k], points[i * 3 + k]);
+                    hi[k] = (std::max)(hi[k], points[i * 3 + k]);
+                }
+            }
+            for (int k = 0; k < 3; k++)
+            {
+                origin[k] = lo[k] * scale;
+                step[k] = (static_cast<double>(hi[k]) - lo[k]) * scale / 65535.0;
+            }
+        }
+
+        const size_t position_bytes = vertex_count * 6;
+        const size_t normal_bytes = normals ? vertex_count * 4 : 0;
+        std::vector<uint8_t> body(position_bytes + normal_bytes);
+        body.reserve(body.size() + triangle_count * 4);
+
+        // Vertices quantize independently, split across the worker pool
+        uint8_t* pos_out = body.data();
+        uint8_t* nrm_out = body.data() + position_bytes;
+        GetWorkerPool()->parallel_for(vertex_count, COMPACT_MESH_VERTEX_CHUNK, [&](size_t begin, size_t end)
+        {
+            // Quantized in the input units
+            double inv_step[3];
+            for (int k = 0; k < 3; k++)
+            {
+                inv_step[k] = step[k] > 0.0 ? scale / step[k] : 0.0;
+            }
+            for (size_t i = begin; i < end; i++)
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    double q = std::floor((static_cast<double>(points[i * 3 + k]) - lo[k]) * inv_step[k] + 0.5);
+                    q = (std::max)(0.0, (std::min)(65535.0, q));
+                    put_le16(pos_out + i * 6 + k * 2, static_cast<uint32_t>(q));
+                }
+                if (normals)
+                {
+                    int16_t oct[2];
+                    octahedral_encode(normals + i * 3, oct);
+                    put_le16(nrm_out + i * 4, static_cast<uint16_t>(oct[0]));
+                    put_le16(nrm_out + i * 4 + 2, static_cast<uint16_t>(oct[1]));
+                }
+            }
+        });
+
+        int64_t prev_first = 0;
+        for (size_t i = 0; i < triangle_count; i++)
+        {
+            const int32_t* t = triangles + i * 3;
+            for (int k = 0; k < 3; k++)
+            {
+                if (t[k] < 0 || static_cast<size_t>(t[k]) >= vertex_count)
+                {
+                    throw std::invalid_argument("Invalid vertex index in mesh triangle");
+                }
+            }
+            put_varint(body, zigzag(static_cast<int64_t>(t[0]) - prev_first));
+            put_varint(body, zigzag(static_cast<int64_t>(t[1]) - t[0]));
+            put_varint(body, zigzag(static_cast<int64_t>(t[2]) - t[0]));
+            prev_first = t[0];
+        }
+
+        out.clear();
+        out.resize(COMPACT_MESH_HEADER_SIZE);
+        uint8_t* h = out.data();
+        memcpy(h, COMPACT_MESH_MAGIC, 4);
+        h[4] = COMPACT_MESH_VERSION;
+        h[5] = (normals ? COMPACT_MESH_FLAG_NORMALS : 0) | (deflate ? COMPACT_MESH_FLAG_DEFLATE : 0);
+        h[6] = 0;
+        h[7] = 0;
+        put_le32(h + 8, static_cast<uint32_t>(vertex_count));
+        put_le32(h + 12, static_cast<uint32_t>(triangle_count));
+        for (int k = 0; k < 3; k++)
+        {
+            put_le_f64(h + 16 + k * 8, origin[k]);
+            put_le_f64(h + 40 + k * 8, step[k]);
+        }
+
+        if (deflate)
+        {
+            DeflateFast(body.data(), body.size(), out);
+        }
+        else
+        {
+            out.insert(out.end(), body.begin(), body.end());
+        }
+    }
+
+    // Inflate the raw deflate body for the reference decoder. Fails if the body inflates to
+    // more than max_size bytes.
+    static void compact_mesh_inflate(const uint8_t* data, size_t size, size_t max_size, std::vector<uint8_t>& out)
+    {
+        if (size > std::numeric_limits<uInt>::max())
+        {
+            throw std::invalid_argument("Compact mesh too large");
+        }
+
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        if (inflateInit2(&zs, -15) != Z_OK)
+        {
+            throw std::runtime_error("Could not initialize inflate");
+        }
+        zs.next_in = const_cast<Bytef*>(data);
+        zs.avail_in = static_cast<uInt>(size);
+        int res = Z_OK;
+        uint8_t buf[65536];
+        while (res == Z_OK)
+        {
+            zs.next_out = buf;
+            zs.avail_out = sizeof(buf);
+            res = inflate(&zs, Z_NO_FLUSH);
+            size_t n = sizeof(buf) - zs.avail_out;
+            if (n > max_size - out.size())
+            {
+                inflateEnd(&zs);
+                throw std::invalid_argument("Compact mesh body larger than its header counts allow");
+            }
+            out.insert(out.end(), buf, buf + n);
+            if (res == Z_BUF_ERROR && zs.avail_in == 0)
+            {
+                break;
+            }
+        }
+        inflateEnd(&zs);
+        if (res != Z_STREAM_END)
+        {
+            throw std::invalid_argument("Invalid deflate stream in compact mesh");
+        }
+    }
+
+    void DecodeCompactMesh(const uint8_t* data, size_t size, CompactMesh& mesh)
+    {
+        if (size < COMPACT_MESH_HEADER_SIZE || memcmp(data, COMPACT_MESH_MAGIC, 4) != 0)
+        {
+            throw std::invalid_argument("Not a compact mesh");
+        }
+        if (data[4] != COMPACT_MESH_VERSION)
+        {
+            throw std::invalid_argument("Unsupported compact mesh version");
+        }
+        const uint8_t flags = data[5];
+        const size_t vertex_count = get_le32(data + 8);
+        const size_t triangle_count = get_le32(data + 12);
+        double origin[3];
+        double step[3];
+        for (int k = 0; k < 3; k++)
+        {
+            origin[k] = get_le_f64(data + 16 + k * 8);
+            step[k] = get_le_f64(data + 40 + k * 8);
+        }
+
+        // The counts are untrusted. Every vertex takes a fixed size and every triangle three to
+        // five varint bytes, so bound the body by the counts before allocating anything.
+        const bool has_normals = (flags & COMPACT_MESH_FLAG_NORMALS) != 0;
+        const uint64_t fixed_size = static_cast<uint64_t>(vertex_count) * (has_normals ? 10 : 6);
+        const uint64_t min_body_size = fixed_size + static_cast<uint64_t>(triangle_count) * 3;
+        const uint64_t max_body_size = fixed_size + static_cast<uint64_t>(triangle_count) * 15;
+
+        std::vector<uint8_t> inflated;
+        const uint8_t* body = data + COMPACT_MESH_HEADER_SIZE;
+        size_t body_size = size - COMPACT_MESH_HEADER_SIZE;
+        if (flags & COMPACT_MESH_FLAG_DEFLATE)
+        {
+            // Deflate expands at most 1032:1
+            if (min_body_size > static_cast<uint64_t>(body_size) * 1032 + 64
+                || max_body_size > std::numeric_limits<size_t>::max())
+            {
+                throw std::invalid_argument("Compact mesh counts exceed the payload");
+            }
+            compact_mesh_inflate(body, body_size, static_cast<size_t>(max_body_size), inflated);
+            body = inflated.data();
+            body_size = inflated.size();
+        }
+
+        if (body_size < min_body_size)
+        {
+            throw std::invalid_argument("Truncated compact mesh");
+        }
+
+        mesh.vertices.resize(vertex_count * 3);
+        for (size_t i = 0; i < vertex_count; i++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                mesh.vertices[i * 3 + k] = static_cast<float>(origin[k] + get_le16(body + i * 6 + k * 2) * step[k]);
+            }
+        }
+
+        mesh.normals.clear();
+        if (has_normals)
+        {
+            mesh.normals.resize(vertex_count * 3);
+            const uint8_t* n = body + vertex_count * 6;
+            for (size_t i = 0; i < vertex_count; i++)
+            {
+                int16_t ox = static_cast<int16_t>(get_le16(n + i * 4));
+                int16_t oy = static_cast<int16_t>(get_le16(n + i * 4 + 2));
+                octahedral_decode(ox, oy, &mesh.normals[i * 3]);
+            }
+        }
+
+        mesh.triangles.resize(triangle_count * 3);
+        size_t pos = static_cast<size_t>(fixed_size);
+        auto read_varint = [&]() -> uint32_t {
+            uint32_t v = 0;
+            for (int shift = 0; shift < 35; shift += 7)
+            {
+                if (pos >= body_size)
+                {
+                    throw std::invalid_argument("Truncated compact mesh");
+                }
+                uint8_t b = body[pos++];
+                v |= static_cast<uint32_t>(b & 0x7F) << shift;
+                if (!(b & 0x80))
+                {
+                    return v;
+                }
+            }
+            throw std::invalid_argument("Invalid compact mesh varint");
+        };
+        int64_t prev_first = 0;
+        for (size_t i = 0; i < triangle_count; i++)
+        {
+            int64_t a = prev_first + unzigzag(read_varint());
+            int64_t b = a + unzigzag(read_varint());
+            int64_t c = a + unzigzag(read_varint());
+            const int64_t n = static_cast<int64_t>(vertex_count);
+            if (a < 0 || a >= n || b < 0 || b >= n || c < 0 || c >= n)
+            {
+                throw std::invalid_argument("Invalid vertex index in compact mesh");
+            }
+            mesh.triangles[i * 3] = static_cast<uint32_t>(a);
+            mesh.triangles[i * 3 + 1] = static_cast<uint32_t>(b);
+            mesh.triangles[i * 3 + 2] = static_cast<uint32_t>(c);
+            prev_first = a;
+        }
+    }
+}
@@ -0,0 +1,102 @@
+#include "artec_scanner_convert.h"
+
+#include <cstring>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define ARTEC_CONVERT_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ARTEC_CONVERT_SSE2
+#endif
+
+namespace artec_scanner_robotraconteur_driver
+{
+    void BulkConvert(const float* src, double* dst, size_t count)
+    {
+        size_t i = 0;
+#if defined(ARTEC_CONVERT_AVX)
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 f = _mm256_loadu_ps(src + i);
+            _mm256_storeu_pd(dst + i, _mm256_cvtps_pd(_mm256_castps256_ps128(f)));
+            _mm256_storeu_pd(dst + i + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(f, 1)));
+        }
+#elif defined(ARTEC_CONVERT_SSE2)
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 f = _mm_loadu_ps(src + i);
+            _mm_storeu_pd(dst + i, _mm_cvtps_pd(f));
+            _mm_storeu_pd(dst + i + 2, _mm_cvtps_pd(_mm_movehl_ps(f, f)));
+        }
+#endif
+        for (; i < count; i++)
+        {
+            dst[i] = src[i];
+        }
+    }
+
+    static void bulk_convert_scaled(const float* src, double* dst, size_t count, double scale)
+    {
+        size_t i = 0;
+#if defined(ARTEC_CONVERT_AVX)
+        __m256d s = _mm256_set1_pd(scale);
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 f = _mm256_loadu_ps(src + i);
+            _mm256_storeu_pd(dst + i, _mm256_mul_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(f)), s));
+            _mm256_storeu_pd(dst + i + 4, _mm256_mul_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(f, 1)), s));
+        }
+#elif defined(ARTEC_CONVERT_SSE2)
+        __m128d s = _mm_set1_pd(scale);
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 f = _mm_loadu_ps(src + i);
+            _mm_storeu_pd(dst + i, _mm_mul_pd(_mm_cvtps_pd(f), s));
+            _mm_storeu_pd(dst + i + 2, _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(f, f)), s));
+        }
+#endif
+        for (; i < count; i++)
+        {
+            dst[i] = src[i] * scale;
+        }
+    }
+
+    void BulkConvertStrided(const float* src, double* dst, size_t count, size_t field_count, 
+        size_t stride, double scale)
+    {
+        if (stride <= 1)
+        {
+            bulk_convert_scaled(src, dst, count * field_count, scale);
+            return;
+        }
+
+        // Decimated reads are gather bound, a scalar loop is as fast as a vector one here
+        const size_t src_step = stride * field_count;
+        for (size_t i = 0; i < count; i++)
+        {
+            for (size_t j = 0; j < field_count; j++)
+            {
+                dst[j] = src[j] * scale;
+            }
+            src += src_step;
+            dst += field_count;
+        }
+    }
+
+    void BulkConvert(const float* src, float* dst, size_t count)
+    {
+        memcpy(dst, src, count * sizeof(float));
+    }
+
+    void BulkConvert(const int32_t* src, uint32_t* dst, size_t count)
+    {
+        // Artec indices are never negative so the bit pattern is identical
+        memcpy(dst, src, count * sizeof(uint32_t));
+    }
+
+    void BulkConvert(const uint32_t* src, uint32_t* dst, size_t count)
+    {
+        memcpy(dst, src, count * sizeof(uint32_t));
+    }
+}
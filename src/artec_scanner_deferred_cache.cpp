@@ -0,0 +1,215 @@
+#include "artec_scanner_deferred_cache.h"
+#include "artec_scanner_impl.h"
+
+#include <algorithm>
+
+namespace RR=RobotRaconteur;
+namespace rr_shapes = com::robotraconteur::geometry::shapes;
+
+namespace artec_scanner_robotraconteur_driver
+{
+    template<typename T>
+    static size_t named_array_bytes(const RR::RRNamedArrayPtr<T>& a)
+    {
+        return a ? a->size() * sizeof(T) : 0;
+    }
+
+    size_t EstimateMeshBytes(const rr_shapes::MeshPtr& mesh)
+    {
+        if (!mesh)
+        {
+            return 0;
+        }
+        size_t ret = sizeof(rr_shapes::Mesh);
+        ret += named_array_bytes(mesh->vertices);
+        ret += named_array_bytes(mesh->normals);
+        ret += named_array_bytes(mesh->triangles);
+        ret += named_array_bytes(mesh->colors);
+        if (mesh->textures)
+        {
+            for (auto& t : *mesh->textures)
+            {
+                if (!t)
+                {
+                    continue;
+                }
+                ret += named_array_bytes(t->uvs);
+                if (t->image && t->image->data)
+                {
+                    ret += t->image->data->size();
+                }
+            }
+        }
+        return ret;
+    }
+
+    void DeferredCaptureCache::set_limits(size_t budget_bytes, boost::chrono::steady_clock::duration ttl)
+    {
+        this->budget_bytes = budget_bytes;
+        this->ttl = ttl;
+        evict(-1);
+    }
+
+    void DeferredCaptureCache::add(const RRDeferredCapturePtr& capture)
+    {
+        remove(capture->handle);
+        lru.push_front(capture->handle);
+        Entry& e = entries[capture->handle];
+        e.capture = capture;
+        e.lru_position = lru.begin();
+        e.last_access = boost::chrono::steady_clock::now();
+        update_cached_bytes(e);
+        evict(capture->handle);
+    }
+
+    void DeferredCaptureCache::remove(int32_t handle)
+    {
+        auto e = entries.find(handle);
+        if (e == entries.end())
+        {
+            return;
+        }
+        cached_bytes -= e->second.cached_bytes;
+        lru.erase(e->second.lru_position);
+        entries.erase(e);
+    }
+
+    void DeferredCaptureCache::clear()
+    {
+        entries.clear();
+        lru.clear();
+        cached_bytes = 0;
+    }
+
+    DeferredCaptureCache::Entry* DeferredCaptureCache::touch_entry(int32_t handle)
+    {
+        auto e = entries.find(handle);
+        if (e == entries.end())
+        {
+            return nullptr;
+        }
+        lru.splice(lru.begin(), lru, e->second.lru_position);
+        e->second.last_access = boost::chrono::steady_clock::now();
+        return &e->second;
+    }
+
+    void DeferredCaptureCache::touch(int32_t handle)
+    {
+        touch_entry(handle);
+    }
+
+    void DeferredCaptureCache::update_cached_bytes(Entry& entry)
+    {
+        size_t n = EstimateMeshBytes(entry.capture->mesh);
+        if (entry.capture->mesh_stl_bytes)
+        {
+            n += entry.capture->mesh_stl_bytes->size();
+        }
+        cached_bytes = cached_bytes - entry.cached_bytes + n;
+        entry.cached_bytes = n;
+    }
+
+    void DeferredCaptureCache::store_mesh(const RRDeferredCapturePtr& capture, const rr_shapes::MeshPtr& mesh,
+        const MeshConvertOptions& options)
+    {
+        Entry* e = touch_entry(capture->handle);
+        if (!e || e->capture != capture)
+        {
+            return;
+        }
+        capture->mesh = mesh;
+        capture->mesh_options = options;
+        update_cached_bytes(*e);
+        evict(capture->handle);
+    }
+
+    void DeferredCaptureCache::store_stl(const RRDeferredCapturePtr& capture, const RR::RRArrayPtr<uint8_t>& stl_bytes)
+    {
+        Entry* e = touch_entry(capture->handle);
+        if (!e || e->capture != capture)
+        {
+            return;
+        }
+        capture->mesh_stl_bytes = stl_bytes;
+        update_cached_bytes(*e);
+        evict(capture->handle);
+    }
+
+    void DeferredCaptureCache::evict(int32_t keep_handle)
+    {
+        if (budget_bytes == 0 || cached_bytes <= budget_bytes)
+        {
+            return;
+        }
+
+        size_t evicted_count = 0;
+        for (auto h = lru.rbegin(); h != lru.rend() && cached_bytes > budget_bytes; ++h)
+        {
+            if (*h == keep_handle)
+            {
+                continue;
+            }
+            Entry& e = entries[*h];
+            if (e.cached_bytes == 0)
+            {
+                continue;
+            }
+            e.capture->mesh.reset();
+            e.capture->mesh_stl_bytes.reset();
+            cached_bytes -= e.cached_bytes;
+            e.cached_bytes = 0;
+            evicted_count++;
+        }
+        if (evicted_count > 0)
+        {
+            RR_ARTEC_LOG_INFO("Evicted cached meshes of " << evicted_count << " deferred captures, "
+                << cached_bytes << " bytes remain cached");
+        }
+    }
+
+    std::vector<RRDeferredCapturePtr> DeferredCaptureCache::spill_candidates(size_t resident_limit)
+    {
+        std::vector<RRDeferredCapturePtr> ret;
+        size_t resident_count = 0;
+        for (auto h : lru)
+        {
+            const RRDeferredCapturePtr& c = entries[h].capture;
+            if (!c->frame)
+            {
+                continue;
+            }
+            if (++resident_count > resident_limit && !c->spill_pending)
+            {
+                ret.push_back(c);
+            }
+        }
+        std::reverse(ret.begin(), ret.end());
+        return ret;
+    }
+
+    std::vector<int32_t> DeferredCaptureCache::expire()
+    {
+        std::vector<int32_t> ret;
+        if (ttl == boost::chrono::steady_clock::duration::zero())
+        {
+            return ret;
+        }
+        auto cutoff = boost::chrono::steady_clock::now() - ttl;
+        while (!lru.empty())
+        {
+            int32_t h = lru.back();
+            if (entries[h].last_access >= cutoff)
+            {
+                break;
+            }
+            remove(h);
+            ret.push_back(h);
+        }
+        return ret;
+    }
+
+    size_t DeferredCaptureCache::get_cached_bytes()
+    {
+        return cached_bytes;
+    }
+}
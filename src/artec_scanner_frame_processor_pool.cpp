@@ -0,0 +1,107 @@
+#include "artec_scanner_frame_processor_pool.h"
+#include "artec_scanner_util.h"
+
+namespace asdk {
+    using namespace artec::sdk::base;
+    using namespace artec::sdk::capturing;
+};
+using asdk::TRef;
+
+namespace RR=RobotRaconteur;
+
+namespace artec_scanner_robotraconteur_driver
+{
+    FrameProcessorLease::FrameProcessorLease(boost::shared_ptr<FrameProcessorPool> pool,
+        TRef<asdk::IFrameProcessor> processor)
+    {
+        this->pool = pool;
+        this->processor = processor;
+    }
+
+    FrameProcessorLease::FrameProcessorLease(FrameProcessorLease&& other)
+    {
+        pool.swap(other.pool);
+        processor = other.processor;
+        other.processor = nullptr;
+    }
+
+    asdk::IFrameProcessor* FrameProcessorLease::get() const
+    {
+        return processor;
+    }
+
+    asdk::IFrameProcessor* FrameProcessorLease::operator->() const
+    {
+        return processor;
+    }
+
+    FrameProcessorLease::~FrameProcessorLease()
+    {
+        if (pool && processor)
+        {
+            pool->checkin(processor);
+        }
+    }
+
+    FrameProcessorPool::FrameProcessorPool(asdk::IScanner* scanner)
+    {
+        this->scanner = scanner;
+    }
+
+    TRef<asdk::IFrameProcessor> FrameProcessorPool::create_processor()
+    {
+        if (scanner == nullptr)
+        {
+            RR_ARTEC_LOG_ERROR("Attempt to use scanner when no scanner is available");
+            throw RR::InvalidOperationException("No scanner available");
+        }
+        TRef<asdk::IFrameProcessor> processor;
+        RR_CALL_ARTEC(scanner->createFrameProcessor(&processor), "Error creating frame processor");
+        boost::mutex::scoped_lock lock(this_lock);
+        created_count++;
+        return processor;
+    }
+
+    void FrameProcessorPool::warm_up(size_t count)
+    {
+        while (get_idle_count() < count)
+        {
+            checkin(create_processor());
+        }
+        RR_ARTEC_LOG_INFO("Frame processor pool warmed up with " << count << " processors");
+    }
+
+    FrameProcessorLease FrameProcessorPool::checkout()
+    {
+        {
+            boost::mutex::scoped_lock lock(this_lock);
+            if (!idle.empty())
+            {
+                TRef<asdk::IFrameProcessor> processor = idle.back();
+                idle.pop_back();
+                return FrameProcessorLease(shared_from_this(), processor);
+            }
+        }
+
+        // Created outside the lock so other checkouts are not held up
+        return FrameProcessorLease(shared_from_this(), create_processor());
+    }
+
+    void FrameProcessorPool::checkin(TRef<asdk::IFrameProcessor> processor)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        idle.push_back(processor);
+    }
+
+    size_t FrameProcessorPool::get_created_count()
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        return created_count;
+    }
+
+    size_t FrameProcessorPool::get_idle_count()
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        return idle.size();
+    }
+}
@@ -0,0 +1,21 @@
+#include "artec_scanner_generator.h"
+
+#include <boost/thread/mutex.hpp>
+
+namespace artec_scanner_robotraconteur_driver
+{
+    static boost::mutex generator_heartbeat_lock;
+    static boost::posix_time::time_duration generator_heartbeat_period = boost::posix_time::seconds(5);
+
+    void SetGeneratorHeartbeatPeriod(const boost::posix_time::time_duration& period)
+    {
+        boost::mutex::scoped_lock lock(generator_heartbeat_lock);
+        generator_heartbeat_period = period;
+    }
+
+    boost::posix_time::time_duration GetGeneratorHeartbeatPeriod()
+    {
+        boost::mutex::scoped_lock lock(generator_heartbeat_lock);
+        return generator_heartbeat_period;
+    }
+}
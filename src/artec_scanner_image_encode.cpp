@@ -0,0 +1,272 @@
+#include "artec_scanner_image_encode.h"
+#include "artec_scanner_worker_pool.h"
+
+#include <zlib.h>
+#include <cstdio>
+#include <jpeglib.h>
+#include <csetjmp>
+#include <cstdlib>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace artec_scanner_robotraconteur_driver
+{
+    // JPEG
+
+    struct JpegErrorManager
+    {
+        jpeg_error_mgr pub;
+        std::jmp_buf jump;
+        char message[JMSG_LENGTH_MAX];
+    };
+
+    static void jpeg_error_exit(j_common_ptr cinfo)
+    {
+        auto err = reinterpret_cast<JpegErrorManager*>(cinfo->err);
+        (*cinfo->err->format_message)(cinfo, err->message);
+        std::longjmp(err->jump, 1);
+    }
+
+    // libjpeg reports errors with longjmp, so nothing with a destructor may live in this
+    // function. Returns false and fills message on error. *buf is allocated by libjpeg and
+    // must be released with free() by the caller, also on error.
+    static bool jpeg_compress_rgb(const uint8_t* rgb, size_t width, size_t height, int quality,
+        unsigned char** buf, unsigned long* size, char* message)
+    {
+        jpeg_compress_struct cinfo;
+        JpegErrorManager err;
+        cinfo.err = jpeg_std_error(&err.pub);
+        err.pub.error_exit = jpeg_error_exit;
+        if (setjmp(err.jump))
+        {
+            memcpy(message, err.message, JMSG_LENGTH_MAX);
+            jpeg_destroy_compress(&cinfo);
+            return false;
+        }
+
+        jpeg_create_compress(&cinfo);
+        jpeg_mem_dest(&cinfo, buf, size);
+        cinfo.image_width = static_cast<JDIMENSION>(width);
+        cinfo.image_height = static_cast<JDIMENSION>(height);
+        cinfo.input_components = 3;
+        cinfo.in_color_space = JCS_RGB;
+        jpeg_set_defaults(&cinfo);
+        jpeg_set_quality(&cinfo, quality, TRUE);
+        // 4:4:4, chroma subsampling smears the chart boundaries of texture atlases
+        for (int c = 0; c < cinfo.num_components; c++)
+        {
+            cinfo.comp_info[c].h_samp_factor = 1;
+            cinfo.comp_info[c].v_samp_factor = 1;
+        }
+
+        jpeg_start_compress(&cinfo, TRUE);
+        while (cinfo.next_scanline < cinfo.image_height)
+        {
+            JSAMPROW row = const_cast<JSAMPROW>(rgb + static_cast<size_t>(cinfo.next_scanline) * width * 3);
+            jpeg_write_scanlines(&cinfo, &row, 1);
+        }
+        jpeg_finish_compress(&cinfo);
+        jpeg_destroy_compress(&cinfo);
+        return true;
+    }
+
+    void EncodeJpeg(const uint8_t* rgb, size_t width, size_t height, int quality, std::vector<uint8_t>& out)
+    {
+        if (width == 0 || height == 0 || width > 65535 || height > 65535)
+        {
+            throw std::invalid_argument("Invalid image size for jpeg");
+        }
+
+        quality = (std::max)(1, (std::min)(100, quality));
+
+        unsigned char* buf = nullptr;
+        unsigned long size = 0;
+        char message[JMSG_LENGTH_MAX] = { 0 };
+        bool ok = jpeg_compress_rgb(rgb, width, height, quality, &buf, &size, message);
+        if (ok)
+        {
+            out.assign(buf, buf + size);
+        }
+        free(buf);
+        if (!ok)
+        {
+            throw std::runtime_error(std::string("JPEG encoding failed: ") + message);
+        }
+    }
+
+    // PNG
+
+    // Compress one band with zlib as raw deflate. Bands do not reference each other. Non-final
+    // bands end with a sync flush, so the next band starts on a byte boundary and the
+    // concatenated bands form a single deflate stream.
+    static void deflate_band(const uint8_t* data, size_t size, bool final, std::vector<uint8_t>& out)
+    {
+        if (size > std::numeric_limits<uInt>::max() / 2)
+        {
+            throw std::invalid_argument("Deflate band too large");
+        }
+
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        if (deflateInit2(&zs, Z_BEST_SPEED, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            throw std::runtime_error("Could not initialize deflate");
+        }
+        // deflateBound covers Z_FINISH, a sync flush adds at most an empty stored block
+        out.resize(deflateBound(&zs, static_cast<uLong>(size)) + 16);
+        zs.next_in = const_cast<Bytef*>(data);
+        zs.avail_in = static_cast<uInt>(size);
+        zs.next_out = out.data();
+        zs.avail_out = static_cast<uInt>(out.size());
+        int res = deflate(&zs, final ? Z_FINISH : Z_SYNC_FLUSH);
+        size_t out_size = zs.total_out;
+        bool consumed = zs.avail_in == 0;
+        deflateEnd(&zs);
+        if (res != (final ? Z_STREAM_END : Z_OK) || !consumed)
+        {
+            throw std::runtime_error("Deflate failed");
+        }
+        out.resize(out_size);
+    }
+
+    // Uncompressed bytes per independently compressed band of a raw deflate stream
+    static const size_t DEFLATE_BAND_SIZE = 262144;
+
+    void DeflateFast(const uint8_t* data, size_t size, std::vector<uint8_t>& out)
+    {
+        size_t band_count = (std::max)(static_cast<size_t>(1), (size + DEFLATE_BAND_SIZE - 1) / DEFLATE_BAND_SIZE);
+        std::vector<std::vector<uint8_t> > bands(band_count);
+
+        GetWorkerPool()->parallel_for(band_count, 1, [&](size_t begin, size_t end)
+        {
+            for (size_t b = begin; b < end; b++)
+            {
+                size_t offset = b * DEFLATE_BAND_SIZE;
+                size_t n = (std::min)(DEFLATE_BAND_SIZE, size - offset);
+                deflate_band(data + offset, n, b + 1 == band_count, bands[b]);
+            }
+        });
+
+        for (auto& b : bands)
+        {
+            out.insert(out.end(), b.begin(), b.end());
+        }
+    }
+
+    static void put_be32(std::vector<uint8_t>& out, uint32_t v)
+    {
+        out.push_back(static_cast<uint8_t>(v >> 24));
+        out.push_back(static_cast<uint8_t>(v >> 16));
+        out.push_back(static_cast<uint8_t>(v >> 8));
+        out.push_back(static_cast<uint8_t>(v));
+    }
+
+    static void png_begin_chunk(std::vector<uint8_t>& out, const char* type)
+    {
+        put_be32(out, 0);
+        out.insert(out.end(), type, type + 4);
+    }
+
+    static void png_end_chunk(std::vector<uint8_t>& out, size_t chunk_start)
+    {
+        size_t data_size = out.size() - chunk_start - 8;
+        uint32_t len = static_cast<uint32_t>(data_size);
+        out[chunk_start] = static_cast<uint8_t>(len >> 24);
+        out[chunk_start + 1] = static_cast<uint8_t>(len >> 16);
+        out[chunk_start + 2] = static_cast<uint8_t>(len >> 8);
+        out[chunk_start + 3] = static_cast<uint8_t>(len);
+        uLong crc = crc32(0L, Z_NULL, 0);
+        crc = crc32(crc, &out[chunk_start + 4], static_cast<uInt>(data_size + 4));
+        put_be32(out, static_cast<uint32_t>(crc));
+    }
+
+    // Target filtered bytes per independently compressed band
+    static const size_t PNG_BAND_SIZE = 262144;
+
+    void EncodePngFast(const uint8_t* rgb, size_t width, size_t height, std::vector<uint8_t>& out)
+    {
+        if (width == 0 || height == 0 || width > 0x7FFFFFFF || height > 0x7FFFFFFF)
+        {
+            throw std::invalid_argument("Invalid image size for png");
+        }
+
+        size_t row_size = 1 + width * 3;
+        size_t band_rows = (std::max)(static_cast<size_t>(1), PNG_BAND_SIZE / row_size);
+        size_t band_count = (height + band_rows - 1) / band_rows;
+
+        std::vector<std::vector<uint8_t> > bands(band_count);
+        std::vector<uLong> band_adler(band_count);
+        std::vector<size_t> band_raw_size(band_count);
+
+        GetWorkerPool()->parallel_for(band_count, 1, [&](size_t begin, size_t end)
+        {
+            std::vector<uint8_t> filtered;
+            for (size_t b = begin; b < end; b++)
+            {
+                size_t y0 = b * band_rows;
+                size_t y1 = (std::min)(height, y0 + band_rows);
+                filtered.resize((y1 - y0) * row_size);
+                uint8_t* f = filtered.data();
+                for (size_t y = y0; y < y1; y++)
+                {
+                    const uint8_t* row = rgb + y * width * 3;
+                    // Sub filter
+                    *f++ = 1;
+                    f[0] = row[0];
+                    f[1] = row[1];
+                    f[2] = row[2];
+                    for (size_t x = 3; x < width * 3; x++)
+                    {
+                        f[x] = static_cast<uint8_t>(row[x] - row[x - 3]);
+                    }
+                    f += width * 3;
+                }
+                band_adler[b] = adler32(adler32(0L, Z_NULL, 0), filtered.data(), static_cast<uInt>(filtered.size()));
+                band_raw_size[b] = filtered.size();
+                deflate_band(filtered.data(), filtered.size(), b + 1 == band_count, bands[b]);
+            }
+        });
+
+        out.clear();
+        const uint8_t png_signature[] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+        out.insert(out.end(), png_signature, png_signature + 8);
+
+        size_t ihdr_start = out.size();
+        png_begin_chunk(out, "IHDR");
+        put_be32(out, static_cast<uint32_t>(width));
+        put_be32(out, static_cast<uint32_t>(height));
+        // 8 bit RGB, deflate, adaptive filtering, no interlace
+        const uint8_t ihdr_tail[] = { 8, 2, 0, 0, 0 };
+        out.insert(out.end(), ihdr_tail, ihdr_tail + 5);
+        png_end_chunk(out, ihdr_start);
+
+        size_t compressed_size = 0;
+        for (auto& b : bands)
+        {
+            compressed_size += b.size();
+        }
+        out.reserve(out.size() + compressed_size + 64);
+
+        size_t idat_start = out.size();
+        png_begin_chunk(out, "IDAT");
+        // zlib header, deflate with 32K window, fastest level
+        out.push_back(0x78);
+        out.push_back(0x01);
+        uLong adler = adler32(0L, Z_NULL, 0);
+        for (size_t b = 0; b < band_count; b++)
+        {
+            out.insert(out.end(), bands[b].begin(), bands[b].end());
+            std::vector<uint8_t>().swap(bands[b]);
+            adler = adler32_combine(adler, band_adler[b], static_cast<z_off_t>(band_raw_size[b]));
+        }
+        put_be32(out, static_cast<uint32_t>(adler));
+        png_end_chunk(out, idat_start);
+
+        size_t iend_start = out.size();
+        png_begin_chunk(out, "IEND");
+        png_end_chunk(out, iend_start);
+    }
+}
@@ -19,12 +19,16 @@
 #include "artec_scanner_util.h"
 #include "artec_scanning_procedure.h"
 #include "artec_scanner_algorithm.h"
+#include "artec_scanner_algorithm_graph.h"
 #include "artec_scanner_algorithm_util.h"
 #include "artec_scanning_deferred.h"
+#include "artec_scanner_worker_pool.h"
+#include "artec_scanner_mesh_stream.h"
 
 #include <boost/filesystem.hpp>
 #include <boost/range/adaptor/map.hpp>
 #include <boost/range/algorithm/copy.hpp>
+#include <boost/atomic.hpp>
 
 namespace asdk {
     using namespace artec::sdk::base;
@@ -45,9 +49,17 @@ namespace artec_scanner_robotraconteur_driver
     void ArtecScannerImpl::Init(artec::sdk::capturing::IScanner* scanner)
     {
         this->scanner=scanner;
+        frame_processors = boost::make_shared<FrameProcessorPool>(scanner);
+        frame_telemetry_publisher = boost::make_shared<FrameTelemetryPublisher>();
+        scan_preview_publisher = boost::make_shared<ScanPreviewPublisher>();
+        deferred_cache = boost::make_shared<DeferredCaptureCache>();
+        algorithm_cache = boost::make_shared<AlgorithmResultCache>();
+        job_scheduler = boost::make_shared<JobScheduler>();
         if (scanner)
         {
-            RR_CALL_ARTEC(scanner->createFrameProcessor(&processor), "error creating frame processor");      
+            // One processor per worker thread covers deferred capture preparation, plus
+            // one for direct captures
+            frame_processors->warm_up(GetWorkerPool()->get_thread_count() + 1);
         }
 
     }
@@ -69,24 +81,111 @@ namespace artec_scanner_robotraconteur_driver
         this->save_path = save_path;
     }
 
+    MeshConvertOptions ArtecScannerImpl::get_mesh_convert_options()
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        return mesh_options;
+    }
+
+    static MeshConvertOptions parent_mesh_convert_options(const boost::weak_ptr<ArtecScannerImpl>& parent)
+    {
+        auto p = parent.lock();
+        if (!p)
+        {
+            return MeshConvertOptions();
+        }
+        return p->get_mesh_convert_options();
+    }
+
+    rr_artec::TextureEncoding::TextureEncoding ArtecScannerImpl::get_texture_encoding()
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        return mesh_options.texture_encoding;
+    }
+
+    void ArtecScannerImpl::set_texture_encoding(rr_artec::TextureEncoding::TextureEncoding value)
+    {
+        if (value < rr_artec::TextureEncoding::png || value > rr_artec::TextureEncoding::none)
+        {
+            RR_ARTEC_LOG_ERROR("Invalid texture encoding: " << (int32_t)value);
+            throw RR::InvalidArgumentException("Invalid texture encoding");
+        }
+        boost::mutex::scoped_lock lock(this_lock);
+        mesh_options.texture_encoding = value;
+        RR_ARTEC_LOG_INFO("Texture encoding set to " << (int32_t)value);
+    }
+
+    int32_t ArtecScannerImpl::get_texture_jpeg_quality()
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        return mesh_options.jpeg_quality;
+    }
+
+    void ArtecScannerImpl::set_texture_jpeg_quality(int32_t value)
+    {
+        if (value < 1 || value > 100)
+        {
+            RR_ARTEC_LOG_ERROR("Invalid texture jpeg quality: " << value);
+            throw RR::InvalidArgumentException("Texture jpeg quality must be between 1 and 100");
+        }
+        boost::mutex::scoped_lock lock(this_lock);
+        mesh_options.jpeg_quality = value;
+    }
+
+    RR::PipePtr<rr_artec::FrameTelemetryPtr> ArtecScannerImpl::get_frame_telemetry()
+    {
+        throw RR::InvalidOperationException("Not valid for service");
+    }
+
+    void ArtecScannerImpl::set_frame_telemetry(const RR::PipePtr<rr_artec::FrameTelemetryPtr>& value)
+    {
+        frame_telemetry_publisher->Init(value);
+    }
+
+    RR::PipePtr<rr_artec::ScanPreviewPtr> ArtecScannerImpl::get_scan_preview()
+    {
+        throw RR::InvalidOperationException("Not valid for service");
+    }
+
+    void ArtecScannerImpl::set_scan_preview(const RR::PipePtr<rr_artec::ScanPreviewPtr>& value)
+    {
+        scan_preview_publisher->Init(value);
+    }
+
     com::robotraconteur::geometry::shapes::MeshPtr ArtecScannerImpl::capture(RR::rr_bool with_texture)
+    {
+        return capture_mesh(with_texture.value != 0, get_mesh_convert_options());
+    }
+
+    com::robotraconteur::geometry::shapes::MeshPtr ArtecScannerImpl::capture_ex(RR::rr_bool with_texture,
+        const rr_artec::MeshExportOptionsPtr& options)
+    {
+        return capture_mesh(with_texture.value != 0, ApplyMeshExportOptions(get_mesh_convert_options(), options));
+    }
+
+    com::robotraconteur::geometry::shapes::MeshPtr ArtecScannerImpl::capture_mesh(bool with_texture, 
+        const MeshConvertOptions& options)
     {
         if (this->scanner == nullptr)
         {
             RR_ARTEC_LOG_ERROR("Attempt to use scanner when no scanner is available");
             throw RR::InvalidOperationException("No scanner available");
         }
+        check_scanner_idle();
         RR_ARTEC_LOG_INFO("Begin scanner capture");
         TRef<asdk::IFrame> frame;
         TRef<asdk::IFrameMesh> mesh;
         frame = nullptr;
         mesh = nullptr;
         asdk::ErrorCode ec = asdk::ErrorCode_OK;
-        RR_CALL_ARTEC(scanner->capture( &frame, with_texture.value != 0), "Error capturing from scanner");
+        RR_CALL_ARTEC(scanner->capture( &frame, with_texture), "Error capturing from scanner");
         
-        RR_CALL_ARTEC(processor->reconstructAndTexturizeMesh( &mesh, frame ), "Error reconstructing mesh");
+        {
+            FrameProcessorLease processor = frame_processors->checkout();
+            RR_CALL_ARTEC(processor->reconstructAndTexturizeMesh( &mesh, frame ), "Error reconstructing mesh");
+        }
         
-        com::robotraconteur::geometry::shapes::MeshPtr rr_mesh = ConvertArtecFrameMeshToRR(mesh);
+        com::robotraconteur::geometry::shapes::MeshPtr rr_mesh = ConvertArtecFrameMeshToRR(mesh, options);
         RR_ARTEC_LOG_INFO("Scanner capture complete");
         return rr_mesh;
     }
@@ -98,6 +197,7 @@ namespace artec_scanner_robotraconteur_driver
             RR_ARTEC_LOG_ERROR("Attempt to use scanner when no scanner is available");
             throw RR::InvalidOperationException("No scanner available");
         }
+        check_scanner_idle();
         RR_ARTEC_LOG_INFO("Begin scanner capture");
         TRef<asdk::IFrame> frame;
         TRef<asdk::IFrameMesh> mesh;
@@ -106,7 +206,10 @@ namespace artec_scanner_robotraconteur_driver
         asdk::ErrorCode ec = asdk::ErrorCode_OK;
         RR_CALL_ARTEC(scanner->capture( &frame, false), "Error capturing from scanner");
         
-        RR_CALL_ARTEC(processor->reconstructAndTexturizeMesh( &mesh, frame ), "Error reconstructing mesh");
+        {
+            FrameProcessorLease processor = frame_processors->checkout();
+            RR_CALL_ARTEC(processor->reconstructAndTexturizeMesh( &mesh, frame ), "Error reconstructing mesh");
+        }
         
         auto stl_bytes = ConvertArtecMeshToStlBytes(mesh);
         RR_ARTEC_LOG_INFO("Scanner capture complete");
@@ -122,6 +225,7 @@ namespace artec_scanner_robotraconteur_driver
             RR_ARTEC_LOG_ERROR("Attempt to use scanner when no scanner is available");
             throw RR::InvalidOperationException("No scanner available");
         }
+        check_scanner_idle();
         auto proc = RR_MAKE_SHARED<ScanningProcedure>(shared_from_this());
         proc->Init(settings);
         RR_ARTEC_LOG_INFO("ScanningProcedure generator returned to client. Call Next() to begin.");
@@ -130,15 +234,16 @@ namespace artec_scanner_robotraconteur_driver
 
     ArtecScannerImpl::~ArtecScannerImpl()
     {
-        if (processor)
+        if (pipelined_capture)
         {
-            processor->release();
+            pipelined_capture->stop();
         }
     }
 
     int32_t ArtecScannerImpl::add_model(RRArtecModelPtr model)
     { 
         boost::mutex::scoped_lock lock(this_lock);
+        model->parent = shared_from_this();
         auto h = ++handle_cnt;
         models.insert(std::make_pair(h,model));
         RR_ARTEC_LOG_INFO("Created model handle: " << h);
@@ -182,6 +287,7 @@ namespace artec_scanner_robotraconteur_driver
             RR_ARTEC_LOG_ERROR("Attempt to free invalid model: " << model_handle);
             throw RR::InvalidArgumentException("Invalid workset handle");
         }
+        algorithm_cache->remove_model(e->second->model_id);
         models.erase(e);
         try
         {
@@ -289,11 +395,32 @@ namespace artec_scanner_robotraconteur_driver
     {
         auto model = RR_DYNAMIC_POINTER_CAST<RRArtecModel>(get_models(input_model_handle));
         auto gen = RR_MAKE_SHARED<RunAlgorithms>(shared_from_this());
-        gen->Init(model, algorithms);
+        gen->Init(model, input_model_handle, algorithms, nullptr);
         RR_ARTEC_LOG_INFO("RunAlgorithms generator returned to client. Call Next() to begin.");
         return gen;
     }
 
+    RR::GeneratorPtr<rr_artec::RunAlgorithmsStatusPtr,void >
+        ArtecScannerImpl::run_algorithms_ex(int32_t input_model_handle, const RR::RRListPtr<RR::RRValue>& algorithms,
+            const rr_artec::RunAlgorithmsOptionsPtr& options)
+    {
+        auto model = RR_DYNAMIC_POINTER_CAST<RRArtecModel>(get_models(input_model_handle));
+        auto gen = RR_MAKE_SHARED<RunAlgorithms>(shared_from_this());
+        gen->Init(model, input_model_handle, algorithms, options);
+        RR_ARTEC_LOG_INFO("RunAlgorithms generator returned to client. Call Next() to begin.");
+        return gen;
+    }
+
+    RR::GeneratorPtr<rr_artec::RunAlgorithmGraphStatusPtr,void >
+        ArtecScannerImpl::run_algorithm_graph(int32_t input_model_handle, const RR::RRListPtr<rr_artec::AlgorithmGraphNode>& nodes)
+    {
+        auto model = RR_DYNAMIC_POINTER_CAST<RRArtecModel>(get_models(input_model_handle));
+        auto gen = RR_MAKE_SHARED<RunAlgorithmGraph>(shared_from_this());
+        gen->Init(model, nodes);
+        RR_ARTEC_LOG_INFO("RunAlgorithmGraph generator returned to client. Call Next() to begin.");
+        return gen;
+    }
+
     int32_t ArtecScannerImpl::capture_deferred(RobotRaconteur::rr_bool with_texture)
     {
         if (this->scanner == nullptr)
@@ -301,6 +428,7 @@ namespace artec_scanner_robotraconteur_driver
             RR_ARTEC_LOG_ERROR("Attempt to use scanner when no scanner is available");
             throw RR::InvalidOperationException("No scanner available");
         }
+        check_scanner_idle();
         RR_ARTEC_LOG_INFO("Begin scanner capture");
         RRDeferredCapturePtr capture = boost::make_shared<RRDeferredCapture>();
         capture->frame = nullptr;
@@ -309,76 +437,416 @@ namespace artec_scanner_robotraconteur_driver
         {
             boost::mutex::scoped_lock lock(this_lock);
             handle = ++handle_cnt;
-            deferred_captures.insert(std::make_pair(handle, capture));
             capture->handle = handle;
+            add_deferred_capture(capture);
         }
         RR_ARTEC_LOG_INFO("Deferred scanner capture complete stored deferred capture with handle: " << handle);
         return handle;
     }
 
-    void ArtecScannerImpl::deferred_capture_to_iframemesh(const RRDeferredCapturePtr& capture, asdk::IFrameMesh** frame_mesh)
+    void ArtecScannerImpl::check_scanner_idle()
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        if (capture_burst)
+        {
+            RR_ARTEC_LOG_ERROR("Attempt to use scanner while a capture burst is running");
+            throw RR::InvalidOperationException("Capture burst is running");
+        }
+        if (pipelined_capture)
+        {
+            RR_ARTEC_LOG_ERROR("Attempt to use scanner while a pipelined capture is running");
+            throw RR::InvalidOperationException("Pipelined capture is running");
+        }
+    }
+
+    void ArtecScannerImpl::start_capture_burst(double rate, uint32_t max_frames)
     {
         if (this->scanner == nullptr)
         {
             RR_ARTEC_LOG_ERROR("Attempt to use scanner when no scanner is available");
             throw RR::InvalidOperationException("No scanner available");
         }
+        if (!(rate >= 0.0))
+        {
+            RR_ARTEC_LOG_ERROR("Invalid capture burst rate: " << rate);
+            throw RR::InvalidArgumentException("Capture burst rate must not be negative");
+        }
+        if (max_frames < 1 || max_frames > 10000)
+        {
+            RR_ARTEC_LOG_ERROR("Invalid capture burst max_frames: " << max_frames);
+            throw RR::InvalidArgumentException("Capture burst max_frames must be between 1 and 10000");
+        }
 
-        TRef<asdk::IFrameProcessor> processor;
-        if ( scanner->createFrameProcessor( &processor ) != asdk::ErrorCode_OK )
+        boost::mutex::scoped_lock lock(this_lock);
+        if (capture_burst)
         {
-            return;
+            RR_ARTEC_LOG_ERROR("Attempt to start capture burst while one is already running");
+            throw RR::InvalidOperationException("Capture burst is already running");
+        }
+        if (pipelined_capture)
+        {
+            RR_ARTEC_LOG_ERROR("Attempt to start capture burst while a pipelined capture is running");
+            throw RR::InvalidOperationException("Pipelined capture is running");
         }
-        *frame_mesh = nullptr;
-        RR_CALL_ARTEC(processor->reconstructAndTexturizeMesh( frame_mesh, capture->frame ), "Error reconstructing mesh");
+        auto burst = boost::make_shared<CaptureBurst>(scanner, rate, max_frames);
+        burst->start();
+        capture_burst = burst;
+        RR_ARTEC_LOG_INFO("Started capture burst with rate " << rate << " and max_frames " << max_frames);
+    }
+
+    RR::RRArrayPtr<int32_t> ArtecScannerImpl::stop_capture_burst()
+    {
+        CaptureBurstPtr burst;
+        {
+            boost::mutex::scoped_lock lock(this_lock);
+            if (!capture_burst)
+            {
+                RR_ARTEC_LOG_ERROR("Attempt to stop capture burst when none is running");
+                throw RR::InvalidOperationException("Capture burst is not running");
+            }
+            if (capture_burst_stopping)
+            {
+                RR_ARTEC_LOG_ERROR("Attempt to stop capture burst while it is already being stopped");
+                throw RR::InvalidOperationException("Capture burst is already stopping");
+            }
+            capture_burst_stopping = true;
+            burst = capture_burst;
+        }
+
+        // The burst stays set until its thread has been joined so other captures are held off
+        std::vector<RRDeferredCapturePtr> captures;
+        try
+        {
+            captures = burst->stop();
+        }
+        catch (...)
+        {
+            boost::mutex::scoped_lock lock(this_lock);
+            capture_burst.reset();
+            capture_burst_stopping = false;
+            throw;
+        }
+        auto ret = RR::AllocateRRArray<int32_t>(captures.size());
+        {
+            boost::mutex::scoped_lock lock(this_lock);
+            capture_burst.reset();
+            capture_burst_stopping = false;
+            for (size_t i = 0; i < captures.size(); i++)
+            {
+                int32_t handle = ++handle_cnt;
+                captures[i]->handle = handle;
+                add_deferred_capture(captures[i]);
+                (*ret)[i] = handle;
+            }
+        }
+        RR_ARTEC_LOG_INFO("Capture burst stopped, stored " << captures.size() << " deferred captures");
+        return ret;
+    }
+
+    void ArtecScannerImpl::start_pipelined_capture(RR::rr_bool with_texture, uint32_t max_frames)
+    {
+        if (this->scanner == nullptr)
+        {
+            RR_ARTEC_LOG_ERROR("Attempt to use scanner when no scanner is available");
+            throw RR::InvalidOperationException("No scanner available");
+        }
+
+        MeshConvertOptions options = get_mesh_convert_options();
+
+        boost::mutex::scoped_lock lock(this_lock);
+        if (pipelined_capture)
+        {
+            RR_ARTEC_LOG_ERROR("Attempt to start pipelined capture while one is already running");
+            throw RR::InvalidOperationException("Pipelined capture is already running");
+        }
+        if (capture_burst)
+        {
+            RR_ARTEC_LOG_ERROR("Attempt to start pipelined capture while a capture burst is running");
+            throw RR::InvalidOperationException("Capture burst is running");
+        }
+        // One frame reconstructing per worker thread while the next frame is acquired
+        size_t max_in_flight = (std::max)(GetWorkerPool()->get_thread_count(), (size_t)2);
+        auto capture = boost::make_shared<PipelinedCapture>(scanner, frame_processors, pipelined_capture_broadcaster,
+            options, with_texture.value != 0, max_frames, max_in_flight);
+        capture->start();
+        pipelined_capture = capture;
+        RR_ARTEC_LOG_INFO("Started pipelined capture with max_frames " << max_frames);
+    }
+
+    void ArtecScannerImpl::stop_pipelined_capture()
+    {
+        PipelinedCapturePtr capture;
+        {
+            boost::mutex::scoped_lock lock(this_lock);
+            if (!pipelined_capture)
+            {
+                RR_ARTEC_LOG_ERROR("Attempt to stop pipelined capture when none is running");
+                throw RR::InvalidOperationException("Pipelined capture is not running");
+            }
+            if (pipelined_capture_stopping)
+            {
+                RR_ARTEC_LOG_ERROR("Attempt to stop pipelined capture while it is already being stopped");
+                throw RR::InvalidOperationException("Pipelined capture is already stopping");
+            }
+            pipelined_capture_stopping = true;
+            capture = pipelined_capture;
+        }
+
+        // Stays set until the frames in flight are sent so other captures are held off
+        try
+        {
+            capture->stop();
+        }
+        catch (...)
+        {
+            boost::mutex::scoped_lock lock(this_lock);
+            pipelined_capture.reset();
+            pipelined_capture_stopping = false;
+            throw;
+        }
+        boost::mutex::scoped_lock lock(this_lock);
+        pipelined_capture.reset();
+        pipelined_capture_stopping = false;
+        RR_ARTEC_LOG_INFO("Pipelined capture stopped");
+    }
+
+    RR::PipePtr<rr_artec::PipelinedCaptureResultPtr> ArtecScannerImpl::get_pipelined_capture()
+    {
+        throw RR::InvalidOperationException("Not valid for service");
+    }
+
+    void ArtecScannerImpl::set_pipelined_capture(const RR::PipePtr<rr_artec::PipelinedCaptureResultPtr>& value)
+    {
+        auto b = RR_MAKE_SHARED<RR::PipeBroadcaster<rr_artec::PipelinedCaptureResultPtr> >();
+        // Meshes are large, clients that fall further behind than this lose results and can
+        // detect the gap from the sequence numbers
+        b->Init(value, 8);
+        boost::mutex::scoped_lock lock(this_lock);
+        pipelined_capture_broadcaster = b;
+    }
+
+    void ArtecScannerImpl::deferred_capture_to_iframemesh(const RRDeferredCapturePtr& capture, asdk::IFrameMesh** frame_mesh)
+    {
+        DeferredCaptureToFrameMesh(capture, this_lock, frame_processors.get(), spill_store.get(), frame_mesh);
     }
 
     RRDeferredCapturePtr ArtecScannerImpl::get_deferred_capture(int32_t deferred_capture_handle)
     {
         boost::mutex::scoped_lock lock(this_lock);
+        expire_deferred_captures();
         auto e = deferred_captures.find(deferred_capture_handle);
         if (e == deferred_captures.end())
         {
             RR_ARTEC_LOG_ERROR("Attempt to use invalid deferred_capture_handle: " << deferred_capture_handle);
             throw RR::InvalidArgumentException("Invalid deferred_capture_handle");
         }
+        deferred_cache->touch(deferred_capture_handle);
         return e->second;
     }
 
+    void ArtecScannerImpl::add_deferred_capture(const RRDeferredCapturePtr& capture)
+    {
+        expire_deferred_captures();
+        deferred_captures.insert(std::make_pair(capture->handle, capture));
+        deferred_cache->add(capture);
+        schedule_frame_spill();
+    }
+
+    void ArtecScannerImpl::expire_deferred_captures()
+    {
+        std::vector<int32_t> expired = deferred_cache->expire();
+        for (auto h : expired)
+        {
+            deferred_captures.erase(h);
+            if (spill_store)
+            {
+                spill_store->remove(h);
+            }
+        }
+        if (!expired.empty())
+        {
+            RR_ARTEC_LOG_INFO("Expired " << expired.size() << " unused deferred capture handles");
+        }
+    }
+
+    void ArtecScannerImpl::set_deferred_capture_limits(size_t cache_budget_bytes, boost::chrono::steady_clock::duration ttl)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        deferred_cache->set_limits(cache_budget_bytes, ttl);
+        expire_deferred_captures();
+    }
+
+    void ArtecScannerImpl::set_deferred_frame_spill(size_t resident_frame_limit)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        if (resident_frame_limit == 0)
+        {
+            this->resident_frame_limit = 0;
+            return;
+        }
+        if (!save_path)
+        {
+            RR_ARTEC_LOG_ERROR("Deferred frame spilling requires a project save path");
+            throw RR::InvalidOperationException("Deferred frame spilling requires a project save path");
+        }
+        if (!spill_store)
+        {
+            spill_store = boost::make_shared<FrameSpillStore>(*save_path / "deferred_frames.spill");
+            // Spilling reconstructs the frame, keep it from crowding out client work
+            spill_queue = GetWorkerPool()->create_queue(2);
+        }
+        this->resident_frame_limit = resident_frame_limit;
+        schedule_frame_spill();
+    }
+
+    void ArtecScannerImpl::set_algorithm_cache_limits(size_t max_entries, uint64_t memory_budget)
+    {
+        algorithm_cache->set_limits(max_entries, memory_budget);
+    }
+
+    void ArtecScannerImpl::set_job_limits(size_t max_concurrent, uint64_t memory_budget)
+    {
+        job_scheduler->set_limits(max_concurrent, memory_budget);
+    }
+
+    void ArtecScannerImpl::schedule_frame_spill()
+    {
+        if (!spill_store || resident_frame_limit == 0)
+        {
+            return;
+        }
+        ArtecScannerImplWeakPtr weak_this = shared_from_this();
+        for (auto& c : deferred_cache->spill_candidates(resident_frame_limit))
+        {
+            if (!spill_queue->try_post([weak_this, c]() {
+                auto this_ = weak_this.lock();
+                if (this_)
+                {
+                    this_->spill_deferred_frame(c);
+                }
+            }))
+            {
+                // Remaining candidates are picked up by the next capture
+                break;
+            }
+            c->spill_pending = true;
+        }
+    }
+
+    void ArtecScannerImpl::spill_deferred_frame(const RRDeferredCapturePtr& capture)
+    {
+        asdk::TRef<asdk::IFrame> frame;
+        {
+            boost::mutex::scoped_lock lock(this_lock);
+            if (!capture->frame || deferred_captures.count(capture->handle) == 0)
+            {
+                capture->spill_pending = false;
+                return;
+            }
+            frame = capture->frame;
+        }
+
+        try
+        {
+            asdk::TRef<asdk::IFrameMesh> frame_mesh;
+            {
+                FrameProcessorLease processor = frame_processors->checkout();
+                RR_CALL_ARTEC(processor->reconstructAndTexturizeMesh( &frame_mesh, frame ), "Error reconstructing mesh");
+            }
+            spill_store->append(capture->handle, frame_mesh);
+        }
+        catch (std::exception& e)
+        {
+            RR_ARTEC_LOG_ERROR("Error spilling deferred capture handle " << capture->handle << ": " << e.what());
+            boost::mutex::scoped_lock lock(this_lock);
+            capture->spill_pending = false;
+            return;
+        }
+
+        boost::mutex::scoped_lock lock(this_lock);
+        capture->spill_pending = false;
+        auto e = deferred_captures.find(capture->handle);
+        if (e == deferred_captures.end() || e->second != capture)
+        {
+            // Freed while spilling
+            spill_store->remove(capture->handle);
+            return;
+        }
+        capture->frame = nullptr;
+        capture->spilled = true;
+        RR_ARTEC_LOG_INFO("Spilled deferred capture handle " << capture->handle << " frame to disk");
+    }
+
     com::robotraconteur::geometry::shapes::MeshPtr ArtecScannerImpl::getf_deferred_capture(int32_t deferred_capture_handle)
     {
         RRDeferredCapturePtr capture = get_deferred_capture(deferred_capture_handle);
-        if (capture->mesh)
+        return deferred_capture_mesh(capture, get_mesh_convert_options());
+    }
+
+    com::robotraconteur::geometry::shapes::MeshPtr ArtecScannerImpl::getf_deferred_capture_ex(int32_t deferred_capture_handle,
+        const rr_artec::MeshExportOptionsPtr& options)
+    {
+        RRDeferredCapturePtr capture = get_deferred_capture(deferred_capture_handle);
+        return deferred_capture_mesh(capture, ApplyMeshExportOptions(get_mesh_convert_options(), options));
+    }
+
+    com::robotraconteur::geometry::shapes::MeshPtr ArtecScannerImpl::deferred_capture_mesh(const RRDeferredCapturePtr& capture, 
+        const MeshConvertOptions& options)
+    {
         {
-            RR_ARTEC_LOG_INFO("Deferred capture mesh returned from cached value");
-            return capture->mesh;
+            boost::mutex::scoped_lock lock(this_lock);
+            // Cached meshes are only valid for the options they were converted with
+            if (capture->mesh && capture->mesh_options == options)
+            {
+                RR_ARTEC_LOG_INFO("Deferred capture mesh returned from cached value");
+                return capture->mesh;
+            }
         }
         asdk::TRef<asdk::IFrameMesh> frame_mesh;
         deferred_capture_to_iframemesh(capture, &frame_mesh);
-        auto rr_mesh = ConvertArtecFrameMeshToRR(frame_mesh);        
+        auto rr_mesh = ConvertArtecFrameMeshToRR(frame_mesh, options);        
         RR_ARTEC_LOG_INFO("Deferred capture to mesh complete");
         boost::mutex::scoped_lock lock(this_lock);
-        capture->mesh = rr_mesh;
+        // Only meshes converted with the driver options are cached so one off export options
+        // do not evict a mesh prepared by deferred_capture_prepare
+        if (options == mesh_options)
+        {
+            deferred_cache->store_mesh(capture, rr_mesh, options);
+        }
         return rr_mesh;
     }
 
     RobotRaconteur::RRArrayPtr<uint8_t > ArtecScannerImpl::getf_deferred_capture_stl(int32_t deferred_capture_handle)
     {
         RRDeferredCapturePtr capture = get_deferred_capture(deferred_capture_handle);
-        if (capture->mesh_stl_bytes)
         {
-            RR_ARTEC_LOG_INFO("Deferred capture stl mesh returned from cached value");
-            return capture->mesh_stl_bytes;
+            boost::mutex::scoped_lock lock(this_lock);
+            if (capture->mesh_stl_bytes)
+            {
+                RR_ARTEC_LOG_INFO("Deferred capture stl mesh returned from cached value");
+                return capture->mesh_stl_bytes;
+            }
         }
         asdk::TRef<asdk::IFrameMesh> frame_mesh;
         deferred_capture_to_iframemesh(capture, &frame_mesh);
         auto stl_bytes = ConvertArtecMeshToStlBytes(frame_mesh);
         RR_ARTEC_LOG_INFO("Deferred capture to stl bytes complete");
         boost::mutex::scoped_lock lock(this_lock);
-        capture->mesh_stl_bytes = stl_bytes;
+        deferred_cache->store_stl(capture, stl_bytes);
         return stl_bytes;
     }
 
+    RobotRaconteur::RRArrayPtr<uint8_t > ArtecScannerImpl::getf_deferred_capture_compact(int32_t deferred_capture_handle,
+        RobotRaconteur::rr_bool deflate)
+    {
+        RRDeferredCapturePtr capture = get_deferred_capture(deferred_capture_handle);
+        asdk::TRef<asdk::IFrameMesh> frame_mesh;
+        deferred_capture_to_iframemesh(capture, &frame_mesh);
+        auto compact_bytes = ConvertArtecMeshToCompactBytes(frame_mesh, get_mesh_convert_options(), deflate.value != 0);
+        RR_ARTEC_LOG_INFO("Deferred capture to compact mesh complete");
+        return compact_bytes;
+    }
+
     void ArtecScannerImpl::deferred_capture_free(const RobotRaconteur::RRArrayPtr<int32_t>& deferred_capture_handle)
     {
         if (!deferred_capture_handle)
@@ -389,6 +857,11 @@ namespace artec_scanner_robotraconteur_driver
         for (auto k : *deferred_capture_handle)
         {
             deferred_captures.erase(k);
+            deferred_cache->remove(k);
+            if (spill_store)
+            {
+                spill_store->remove(k);
+            }
         }
     }
 
@@ -398,6 +871,12 @@ namespace artec_scanner_robotraconteur_driver
         {
             boost::mutex::scoped_lock lock(this_lock);
             deferred_captures.clear();
+            deferred_cache->clear();
+            if (spill_store)
+            {
+                spill_store->clear();
+            }
+            algorithm_cache->clear();
             boost::copy(models | boost::adaptors::map_keys, std::back_inserter(model_handles));
         }
 
@@ -418,7 +897,7 @@ namespace artec_scanner_robotraconteur_driver
         ArtecScannerImpl::deferred_capture_prepare(const RobotRaconteur::RRArrayPtr<int32_t >& deferred_capture_handles) 
     {
         RR_NULL_CHECK(deferred_capture_handles);
-        std::list<boost::shared_ptr<RRDeferredCapture> > work;
+        std::vector<boost::shared_ptr<RRDeferredCapture> > work;
         for(auto handle : *deferred_capture_handles)
         {
             work.push_back(get_deferred_capture(handle));
@@ -432,7 +911,7 @@ namespace artec_scanner_robotraconteur_driver
         ArtecScannerImpl::deferred_capture_prepare_stl(const RobotRaconteur::RRArrayPtr<int32_t >& deferred_capture_handles)
     {
         RR_NULL_CHECK(deferred_capture_handles);
-        std::list<boost::shared_ptr<RRDeferredCapture> > work;
+        std::vector<boost::shared_ptr<RRDeferredCapture> > work;
         for(auto handle : *deferred_capture_handles)
         {
             work.push_back(get_deferred_capture(handle));
@@ -442,9 +921,41 @@ namespace artec_scanner_robotraconteur_driver
         return gen;
     }
 
+    RobotRaconteur::GeneratorPtr<experimental::artec_scanner::DeferredCaptureResultPtr,void> 
+        ArtecScannerImpl::deferred_capture_prepare_stream(const RobotRaconteur::RRArrayPtr<int32_t >& deferred_capture_handles)
+    {
+        RR_NULL_CHECK(deferred_capture_handles);
+        std::vector<boost::shared_ptr<RRDeferredCapture> > work;
+        for(auto handle : *deferred_capture_handles)
+        {
+            work.push_back(get_deferred_capture(handle));
+        }
+        auto gen = RR_MAKE_SHARED<DeferredCapturePrepareStream>(shared_from_this());
+        gen->Init(std::move(work), true, false);
+        return gen;
+    }
+
+    RobotRaconteur::GeneratorPtr<experimental::artec_scanner::DeferredCaptureResultPtr,void> 
+        ArtecScannerImpl::deferred_capture_prepare_stream_stl(const RobotRaconteur::RRArrayPtr<int32_t >& deferred_capture_handles)
+    {
+        RR_NULL_CHECK(deferred_capture_handles);
+        std::vector<boost::shared_ptr<RRDeferredCapture> > work;
+        for(auto handle : *deferred_capture_handles)
+        {
+            work.push_back(get_deferred_capture(handle));
+        }
+        auto gen = RR_MAKE_SHARED<DeferredCapturePrepareStream>(shared_from_this());
+        gen->Init(std::move(work), false, true);
+        return gen;
+    }
+
+    static boost::atomic<uint64_t> next_model_id(1);
+
     RRArtecModel::RRArtecModel()
     {
         RR_CALL_ARTEC( asdk::createModel( &model ), "Error creating artec model");
+        lod_cache = boost::make_shared<MeshLodCache>();
+        model_id = next_model_id++;
     }
 
     uint32_t RRArtecModel::get_scan_count()
@@ -460,7 +971,7 @@ namespace artec_scanner_robotraconteur_driver
             RR_ARTEC_LOG_ERROR("Attempt to access invalid scan index: " << ind);
             throw RR::InvalidArgumentException("Invalid scan index");
         }
-        return RR_MAKE_SHARED<RRScan>(scan);
+        return RR_MAKE_SHARED<RRScan>(scan, parent);
     }
 
     RobotRaconteur::rr_bool RRArtecModel::get_composite_container_valid()
@@ -478,13 +989,14 @@ namespace artec_scanner_robotraconteur_driver
             RR_ARTEC_LOG_ERROR("Attempt to access invalid composite container");
             throw RR::InvalidArgumentException("Invalid composite container");
         }
-        return RR_MAKE_SHARED<RRCompositeContainer>(container);
+        return RR_MAKE_SHARED<RRCompositeContainer>(container, parent, lod_cache);
         
     }
 
-    RRScan::RRScan(artec::sdk::base::IScan* scan)
+    RRScan::RRScan(artec::sdk::base::IScan* scan, boost::weak_ptr<ArtecScannerImpl> parent)
     {
         this->scan = scan;
+        this->parent = parent;
     }
 
     com::robotraconteur::geometry::Transform RRScan::get_scan_transform()
@@ -506,7 +1018,19 @@ namespace artec_scanner_robotraconteur_driver
             RR_ARTEC_LOG_ERROR("Attempt to access invalid scan frame mesh index: " << ind);
             throw RR::InvalidArgumentException("Invalid scan frame mesh index");
         }
-        return ConvertArtecFrameMeshToRR(mesh);
+        return ConvertArtecFrameMeshToRR(mesh, parent_mesh_convert_options(parent));
+    }
+
+    com::robotraconteur::geometry::shapes::MeshPtr RRScan::getf_frame_mesh_ex(uint32_t ind, 
+        const rr_artec::MeshExportOptionsPtr& options)
+    {
+        auto mesh = scan->getElement(ind);
+        if (!mesh)
+        {
+            RR_ARTEC_LOG_ERROR("Attempt to access invalid scan frame mesh index: " << ind);
+            throw RR::InvalidArgumentException("Invalid scan frame mesh index");
+        }
+        return ConvertArtecFrameMeshToRR(mesh, ApplyMeshExportOptions(parent_mesh_convert_options(parent), options));
     }
 
     RobotRaconteur::RRArrayPtr<uint8_t > RRScan::getf_frame_mesh_stl(uint32_t ind)
@@ -520,6 +1044,17 @@ namespace artec_scanner_robotraconteur_driver
         return ConvertArtecMeshToStlBytes(mesh);
     }
 
+    RobotRaconteur::RRArrayPtr<uint8_t > RRScan::getf_frame_mesh_compact(uint32_t ind, RobotRaconteur::rr_bool deflate)
+    {
+        auto mesh = scan->getElement(ind);
+        if (!mesh)
+        {
+            RR_ARTEC_LOG_ERROR("Attempt to access invalid scan frame mesh index: " << ind);
+            throw RR::InvalidArgumentException("Invalid scan frame mesh index");
+        }
+        return ConvertArtecMeshToCompactBytes(mesh, parent_mesh_convert_options(parent), deflate.value != 0);
+    }
+
     com::robotraconteur::geometry::Transform RRScan::getf_frame_transform(uint32_t ind)
     {
         auto t = scan->getTransformation(ind);
@@ -531,9 +1066,12 @@ namespace artec_scanner_robotraconteur_driver
         return ConvertArtecTransformToRR(t);
     }
 
-    RRCompositeContainer::RRCompositeContainer(artec::sdk::base::ICompositeContainer *container)
+    RRCompositeContainer::RRCompositeContainer(artec::sdk::base::ICompositeContainer *container, 
+        boost::weak_ptr<ArtecScannerImpl> parent, MeshLodCachePtr lod_cache)
     {
         this->container = container;
+        this->parent = parent;
+        this->lod_cache = lod_cache;
     }
 
     uint32_t RRCompositeContainer::get_composite_mesh_count()
@@ -554,7 +1092,19 @@ namespace artec_scanner_robotraconteur_driver
             RR_ARTEC_LOG_ERROR("Attempt to access invalid composite mesh index: " << ind);
             throw RR::InvalidArgumentException("Invalid composite mesh index");
         }
-        return ConvertArtecCompositeMeshToRR(mesh);
+        return ConvertArtecCompositeMeshToRR(mesh, parent_mesh_convert_options(parent));
+    }
+
+    com::robotraconteur::geometry::shapes::MeshPtr RRCompositeContainer::getf_composite_mesh_ex(uint32_t ind,
+        const rr_artec::MeshExportOptionsPtr& options)
+    {
+        auto mesh = container->getElement(ind);
+        if (!mesh)
+        {
+            RR_ARTEC_LOG_ERROR("Attempt to access invalid composite mesh index: " << ind);
+            throw RR::InvalidArgumentException("Invalid composite mesh index");
+        }
+        return ConvertArtecCompositeMeshToRR(mesh, ApplyMeshExportOptions(parent_mesh_convert_options(parent), options));
     }
 
     RobotRaconteur::RRArrayPtr<uint8_t> RRCompositeContainer::getf_composite_mesh_stl(uint32_t ind)
@@ -568,6 +1118,112 @@ namespace artec_scanner_robotraconteur_driver
         return ConvertArtecMeshToStlBytes(mesh);
     }
 
+    RobotRaconteur::RRArrayPtr<uint8_t> RRCompositeContainer::getf_composite_mesh_compact(uint32_t ind,
+        RobotRaconteur::rr_bool deflate)
+    {
+        auto mesh = container->getElement(ind);
+        if (!mesh)
+        {
+            RR_ARTEC_LOG_ERROR("Attempt to access invalid composite mesh index: " << ind);
+            throw RR::InvalidArgumentException("Invalid composite mesh index");
+        }
+        return ConvertArtecMeshToCompactBytes(mesh, parent_mesh_convert_options(parent), deflate.value != 0);
+    }
+
+    LodMeshPtr RRCompositeContainer::composite_mesh_lod(uint32_t ind, uint32_t target_triangles)
+    {
+        if (target_triangles < 1)
+        {
+            RR_ARTEC_LOG_ERROR("Invalid composite mesh lod target_triangles: " << target_triangles);
+            throw RR::InvalidArgumentException("target_triangles must be greater than zero");
+        }
+        auto mesh = container->getElement(ind);
+        if (!mesh)
+        {
+            RR_ARTEC_LOG_ERROR("Attempt to access invalid composite mesh index: " << ind);
+            throw RR::InvalidArgumentException("Invalid composite mesh index");
+        }
+
+        asdk::TArrayIndexTriplet triangles = mesh->getTriangles();
+        size_t triangle_count = static_cast<size_t>(triangles.size());
+        if (triangle_count <= target_triangles)
+        {
+            // Already within the target, served from the mesh itself rather than a cached copy
+            return LodMeshPtr();
+        }
+
+        LodMeshPtr lod = lod_cache->get(ind, target_triangles);
+        if (lod)
+        {
+            RR_ARTEC_LOG_INFO("Composite mesh lod returned from cached value");
+            return lod;
+        }
+
+        asdk::TArrayPoint3F points = mesh->getPoints();
+        size_t points_count = static_cast<size_t>(points.size());
+        auto new_lod = boost::make_shared<LodMesh>();
+        try
+        {
+            ClusterDecimateMesh(points_count > 0 ? &points[0].x : nullptr, points_count,
+                triangle_count > 0 ? reinterpret_cast<const int32_t*>(&triangles[0].x) : nullptr, triangle_count,
+                target_triangles, *new_lod);
+        }
+        catch (std::invalid_argument& e)
+        {
+            RR_ARTEC_LOG_ERROR("Error reducing composite mesh: " << e.what());
+            throw RR::OperationFailedException(e.what());
+        }
+        RR_ARTEC_LOG_INFO("Composite mesh " << ind << " reduced from " << triangle_count << " to "
+            << new_lod->triangles.size() / 3 << " triangles");
+        lod_cache->put(ind, target_triangles, new_lod);
+        return new_lod;
+    }
+
+    com::robotraconteur::geometry::shapes::MeshPtr RRCompositeContainer::getf_composite_mesh_lod(uint32_t ind,
+        uint32_t target_triangles)
+    {
+        LodMeshPtr lod = composite_mesh_lod(ind, target_triangles);
+        if (!lod)
+        {
+            // Same content as a reduced mesh, which has no textures
+            MeshConvertOptions options = parent_mesh_convert_options(parent);
+            options.include_textures = false;
+            options.include_uvs = false;
+            options.vertex_stride = 1;
+            return ConvertArtecCompositeMeshToRR(container->getElement(ind), options);
+        }
+        return ConvertLodMeshToRR(*lod, parent_mesh_convert_options(parent));
+    }
+
+    RobotRaconteur::RRArrayPtr<uint8_t> RRCompositeContainer::getf_composite_mesh_lod_stl(uint32_t ind,
+        uint32_t target_triangles)
+    {
+        LodMeshPtr lod = composite_mesh_lod(ind, target_triangles);
+        if (!lod)
+        {
+            return ConvertArtecMeshToStlBytes(container->getElement(ind));
+        }
+        return ConvertTrianglesToStlBytes(lod->points.data(), lod->points.size() / 3,
+            lod->triangles.data(), lod->triangles.size() / 3);
+    }
+
+    RR::GeneratorPtr<rr_artec::CompositeMeshChunkPtr,void> RRCompositeContainer::composite_mesh_stream(uint32_t ind,
+        uint32_t chunk_triangles)
+    {
+        if (chunk_triangles < 1 || chunk_triangles > 10000000)
+        {
+            RR_ARTEC_LOG_ERROR("Invalid composite mesh chunk_triangles: " << chunk_triangles);
+            throw RR::InvalidArgumentException("chunk_triangles must be between 1 and 10000000");
+        }
+        auto mesh = container->getElement(ind);
+        if (!mesh)
+        {
+            RR_ARTEC_LOG_ERROR("Attempt to access invalid composite mesh index: " << ind);
+            throw RR::InvalidArgumentException("Invalid composite mesh index");
+        }
+        return RR_MAKE_SHARED<CompositeMeshStream>(mesh, parent_mesh_convert_options(parent), chunk_triangles);
+    }
+
     com::robotraconteur::geometry::Transform RRCompositeContainer::getf_composite_mesh_transform(uint32_t ind)
     {
         auto t = container->getTransformation(ind);
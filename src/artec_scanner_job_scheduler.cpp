@@ -0,0 +1,195 @@
+#include "artec_scanner_job_scheduler.h"
+#include "artec_scanner_worker_pool.h"
+#include "artec_scanner_thread_budget.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace artec_scanner_robotraconteur_driver
+{
+    JobTicket::JobTicket(boost::shared_ptr<JobScheduler> scheduler, uint64_t id)
+    {
+        this->scheduler = scheduler;
+        this->id = id;
+    }
+
+    int32_t JobTicket::get_queue_position()
+    {
+        auto s = scheduler.lock();
+        if (!s) return 0;
+        return s->get_queue_position(id);
+    }
+
+    int JobTicket::acquire_algorithm_threads(uint32_t requested)
+    {
+        auto s = scheduler.lock();
+        if (!s) return AlgorithmJobThreadCount(requested, 0);
+        return s->acquire_algorithm_threads(id, requested);
+    }
+
+    void JobTicket::release_algorithm_threads(int count)
+    {
+        auto s = scheduler.lock();
+        if (!s) return;
+        s->release_algorithm_threads(id, count);
+    }
+
+    JobTicket::~JobTicket()
+    {
+        auto s = scheduler.lock();
+        if (!s) return;
+        s->release(id);
+    }
+
+    JobScheduler::JobScheduler(size_t max_concurrent, uint64_t memory_budget)
+    {
+        this->max_concurrent = max_concurrent;
+        this->memory_budget = memory_budget;
+    }
+
+    void JobScheduler::set_limits(size_t max_concurrent, uint64_t memory_budget)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        this->max_concurrent = max_concurrent;
+        this->memory_budget = memory_budget;
+        admit_queued();
+    }
+
+    bool JobScheduler::can_admit(uint64_t memory_estimate)
+    {
+        size_t limited_count = admitted.size() - unlimited.size();
+        if (max_concurrent > 0 && limited_count >= max_concurrent)
+        {
+            return false;
+        }
+        if (memory_budget > 0 && limited_count > 0 && memory_in_use + memory_estimate > memory_budget)
+        {
+            return false;
+        }
+        return true;
+    }
+
+    void JobScheduler::admit_queued()
+    {
+        while (!queue.empty() && can_admit(queue.front().memory_estimate))
+        {
+            QueuedJob& j = queue.front();
+            insert_admitted(j.id, j.memory_estimate);
+            // The start function takes the generator lock, so it must not run on this thread
+            GetWorkerPool()->post(j.start);
+            queue.pop_front();
+        }
+    }
+
+    JobTicketPtr JobScheduler::submit(int32_t priority, uint64_t memory_estimate, boost::function<void()> start,
+        bool& admitted_now)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        uint64_t id = next_id++;
+        auto ticket = boost::make_shared<JobTicket>(shared_from_this(), id);
+        if (queue.empty() && can_admit(memory_estimate))
+        {
+            insert_admitted(id, memory_estimate);
+            admitted_now = true;
+            return ticket;
+        }
+
+        QueuedJob j;
+        j.id = id;
+        j.priority = priority;
+        j.memory_estimate = memory_estimate;
+        j.start = start;
+        auto pos = queue.begin();
+        while (pos != queue.end() && pos->priority >= priority)
+        {
+            ++pos;
+        }
+        queue.insert(pos, j);
+        admitted_now = false;
+        // A higher priority job may be at the head now
+        admit_queued();
+        return ticket;
+    }
+
+    JobTicketPtr JobScheduler::admit_unlimited()
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        uint64_t id = next_id++;
+        insert_admitted(id, 0);
+        unlimited.insert(id);
+        return boost::make_shared<JobTicket>(shared_from_this(), id);
+    }
+
+    void JobScheduler::insert_admitted(uint64_t id, uint64_t memory_estimate)
+    {
+        AdmittedJob& j = admitted[id];
+        j.memory_estimate = memory_estimate;
+        memory_in_use += memory_estimate;
+    }
+
+    void JobScheduler::release(uint64_t id)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        auto e = admitted.find(id);
+        if (e != admitted.end())
+        {
+            memory_in_use -= e->second.memory_estimate;
+            threads_in_use -= e->second.threads;
+            admitted.erase(e);
+            unlimited.erase(id);
+        }
+        else
+        {
+            for (auto q = queue.begin(); q != queue.end(); ++q)
+            {
+                if (q->id == id)
+                {
+                    queue.erase(q);
+                    break;
+                }
+            }
+        }
+        admit_queued();
+    }
+
+    int32_t JobScheduler::get_queue_position(uint64_t id)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        int32_t pos = 1;
+        for (auto& q : queue)
+        {
+            if (q.id == id)
+            {
+                return pos;
+            }
+            pos++;
+        }
+        return 0;
+    }
+
+    int JobScheduler::acquire_algorithm_threads(uint64_t id, uint32_t requested)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        int count = AlgorithmJobThreadCount(requested, threads_in_use);
+        auto e = admitted.find(id);
+        if (e != admitted.end() && count > 0)
+        {
+            e->second.threads += static_cast<uint32_t>(count);
+            threads_in_use += static_cast<uint32_t>(count);
+        }
+        return count;
+    }
+
+    void JobScheduler::release_algorithm_threads(uint64_t id, int count)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        auto e = admitted.find(id);
+        if (e == admitted.end() || count <= 0)
+        {
+            return;
+        }
+        uint32_t n = (std::min)(static_cast<uint32_t>(count), e->second.threads);
+        e->second.threads -= n;
+        threads_in_use -= n;
+    }
+}
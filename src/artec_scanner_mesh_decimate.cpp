@@ -0,0 +1,201 @@
+#include "artec_scanner_mesh_decimate.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace artec_scanner_robotraconteur_driver
+{
+    static const uint32_t LOD_MAX_RESOLUTION = 1u << 20;
+
+    struct ClusterTriangleHash
+    {
+        size_t operator()(const std::array<uint32_t, 3>& t) const
+        {
+            uint64_t h = t[0];
+            h = h * 0x9E3779B97F4A7C15ull + t[1];
+            h = h * 0x9E3779B97F4A7C15ull + t[2];
+            return static_cast<size_t>(h ^ (h >> 32));
+        }
+    };
+
+    // Clusters the vertices on a grid with resolution cells along the longest bounding box axis
+    class VertexClustering
+    {
+        protected:
+            const float* points;
+            size_t vertex_count;
+            const int32_t* triangles;
+            size_t triangle_count;
+            float lo[3];
+            float extent;
+
+        public:
+            // Cluster of each vertex and the surviving triangles in cluster indices
+            std::vector<uint32_t> vertex_cluster;
+            size_t cluster_count = 0;
+            std::vector<std::array<uint32_t, 3> > cluster_triangles;
+
+            VertexClustering(const float* points, size_t vertex_count, const int32_t* triangles, size_t triangle_count)
+                : points(points), vertex_count(vertex_count), triangles(triangles), triangle_count(triangle_count)
+            {
+                float hi[3];
+                for (int k = 0; k < 3; k++)
+                {
+                    lo[k] = vertex_count > 0 ? points[k] : 0.0f;
+                    hi[k] = lo[k];
+                }
+                for (size_t i = 1; i < vertex_count; i++)
+                {
+                    for (int k = 0; k < 3; k++)
+                    {
+                        lo[k] = (std::min)(lo[k], points[i * 3 + k]);
+                        hi[k] = (std::max)(hi[k], points[i * 3 + k]);
+                    }
+                }
+                extent = (std::max)(hi[0] - lo[0], (std::max)(hi[1] - lo[1], hi[2] - lo[2]));
+            }
+
+            // Returns the number of surviving triangles
+            size_t cluster(uint32_t resolution)
+            {
+                const double inv_cell = extent > 0.0f ? resolution / static_cast<double>(extent) : 0.0;
+                const uint64_t max_cell = resolution - 1;
+
+                std::unordered_map<uint64_t, uint32_t> cell_cluster;
+                cell_cluster.reserve((std::min)(vertex_count, static_cast<size_t>(resolution) * resolution * 2));
+                vertex_cluster.resize(vertex_count);
+                for (size_t i = 0; i < vertex_count; i++)
+                {
+                    uint64_t key = 0;
+                    for (int k = 0; k < 3; k++)
+                    {
+                        uint64_t c = static_cast<uint64_t>((points[i * 3 + k] - lo[k]) * inv_cell);
+                        key = (key << 21) | (std::min)(c, max_cell);
+                    }
+                    auto e = cell_cluster.emplace(key, static_cast<uint32_t>(cell_cluster.size()));
+                    vertex_cluster[i] = e.first->second;
+                }
+                cluster_count = cell_cluster.size();
+
+                std::unordered_set<std::array<uint32_t, 3>, ClusterTriangleHash> seen;
+                cluster_triangles.clear();
+                for (size_t i = 0; i < triangle_count; i++)
+                {
+                    const int32_t* t = triangles + i * 3;
+                    std::array<uint32_t, 3> c = {{ vertex_cluster[t[0]], vertex_cluster[t[1]], vertex_cluster[t[2]] }};
+                    if (c[0] == c[1] || c[1] == c[2] || c[0] == c[2])
+                    {
+                        continue;
+                    }
+                    // Rotate the smallest index first so duplicates compare equal, keeping the winding
+                    while (c[0] > c[1] || c[0] > c[2])
+                    {
+                        std::rotate(c.begin(), c.begin() + 1, c.end());
+                    }
+                    if (seen.insert(c).second)
+                    {
+                        cluster_triangles.push_back(c);
+                    }
+                }
+                return cluster_triangles.size();
+            }
+    };
+
+    void ClusterDecimateMesh(const float* points, size_t vertex_count, const int32_t* triangles,
+        size_t triangle_count, size_t target_triangles, LodMesh& out)
+    {
+        for (size_t i = 0; i < triangle_count * 3; i++)
+        {
+            if (triangles[i] < 0 || static_cast<size_t>(triangles[i]) >= vertex_count)
+            {
+                throw std::invalid_argument("Invalid vertex index in mesh triangle " + std::to_string(i / 3));
+            }
+        }
+
+        out.points.clear();
+        out.triangles.clear();
+        if (target_triangles == 0 || triangle_count == 0)
+        {
+            return;
+        }
+        if (triangle_count <= target_triangles)
+        {
+            out.points.assign(points, points + vertex_count * 3);
+            out.triangles.assign(triangles, triangles + triangle_count * 3);
+            return;
+        }
+
+        VertexClustering clustering(points, vertex_count, triangles, triangle_count);
+
+        // Search for the finest grid that fits. Surface meshes keep about resolution^2
+        // triangles, so each trial predicts the next resolution, falling back to bisection
+        // between a resolution known to fit and one known to exceed the target. A single cell
+        // always fits since every triangle collapses.
+        uint32_t good = 1;
+        uint32_t bad = LOD_MAX_RESOLUTION + 1;
+        uint32_t r = 64;
+        uint32_t last_r = 0;
+        for (int i = 0; i < 24 && bad - good > (std::max)(1u, good / 64); i++)
+        {
+            size_t count = clustering.cluster(r);
+            last_r = r;
+            if (count <= target_triangles)
+            {
+                good = r;
+                if (count >= target_triangles - target_triangles / 32)
+                {
+                    break;
+                }
+            }
+            else
+            {
+                bad = r;
+            }
+            double estimate = r * std::sqrt(static_cast<double>(target_triangles) / (std::max)(count, (size_t)1));
+            r = static_cast<uint32_t>((std::min)(estimate, static_cast<double>(LOD_MAX_RESOLUTION)));
+            if (r <= good || r >= bad)
+            {
+                r = good + (bad - good) / 2;
+            }
+        }
+        if (last_r != good)
+        {
+            clustering.cluster(good);
+        }
+
+        // Clustered vertices are placed at the mean of their members, unused clusters are dropped
+        std::vector<double> sum(clustering.cluster_count * 3, 0.0);
+        std::vector<uint32_t> members(clustering.cluster_count, 0);
+        for (size_t i = 0; i < vertex_count; i++)
+        {
+            uint32_t c = clustering.vertex_cluster[i];
+            sum[c * 3] += points[i * 3];
+            sum[c * 3 + 1] += points[i * 3 + 1];
+            sum[c * 3 + 2] += points[i * 3 + 2];
+            members[c]++;
+        }
+
+        std::vector<int32_t> out_index(clustering.cluster_count, -1);
+        out.triangles.reserve(clustering.cluster_triangles.size() * 3);
+        for (auto& t : clustering.cluster_triangles)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                uint32_t c = t[k];
+                if (out_index[c] < 0)
+                {
+                    out_index[c] = static_cast<int32_t>(out.points.size() / 3);
+                    out.points.push_back(static_cast<float>(sum[c * 3] / members[c]));
+                    out.points.push_back(static_cast<float>(sum[c * 3 + 1] / members[c]));
+                    out.points.push_back(static_cast<float>(sum[c * 3 + 2] / members[c]));
+                }
+                out.triangles.push_back(out_index[c]);
+            }
+        }
+    }
+}
@@ -0,0 +1,115 @@
+#include "artec_scanner_mesh_lod.h"
+#include "artec_scanner_convert.h"
+
+#include <cmath>
+
+namespace RR=RobotRaconteur;
+namespace rr_geom = com::robotraconteur::geometry;
+namespace rr_shapes = com::robotraconteur::geometry::shapes;
+namespace rr_artec = experimental::artec_scanner;
+
+namespace artec_scanner_robotraconteur_driver
+{
+    rr_shapes::MeshPtr ConvertLodMeshToRR(const LodMesh& mesh, const MeshConvertOptions& options)
+    {
+        // Artec meshes are in millimeters
+        const double scale = options.units == rr_artec::MeshUnits::meters ? 0.001 : 1.0;
+        const size_t vertex_count = mesh.points.size() / 3;
+        const size_t triangle_count = mesh.triangles.size() / 3;
+
+        auto ret = rr_shapes::MeshPtr(new rr_shapes::Mesh());
+        ret->vertices = ConvertStridedArrayToRR<rr_geom::Point>(mesh.points.data(), vertex_count, 1, scale);
+        ret->triangles = ConvertPackedArrayToRR<rr_shapes::MeshTriangle>(mesh.triangles.data(), triangle_count);
+
+        if (options.include_normals)
+        {
+            // Area weighted vertex normals, the clustered mesh has no normals of its own
+            std::vector<double> acc(vertex_count * 3, 0.0);
+            const float* p = mesh.points.data();
+            for (size_t i = 0; i < triangle_count; i++)
+            {
+                const int32_t* t = &mesh.triangles[i * 3];
+                const float* a = p + t[0] * 3;
+                const float* b = p + t[1] * 3;
+                const float* c = p + t[2] * 3;
+                double e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+                double e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+                double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+                for (int k = 0; k < 3; k++)
+                {
+                    for (int j = 0; j < 3; j++)
+                    {
+                        acc[t[k] * 3 + j] += n[j];
+                    }
+                }
+            }
+            ret->normals = RR::AllocateEmptyRRNamedArray<rr_geom::Vector3>(vertex_count);
+            double* nrm = ret->normals->GetNumericArray()->data();
+            for (size_t i = 0; i < vertex_count; i++)
+            {
+                double len = std::sqrt(acc[i * 3] * acc[i * 3] + acc[i * 3 + 1] * acc[i * 3 + 1] + acc[i * 3 + 2] * acc[i * 3 + 2]);
+                double inv_len = len > 0.0 ? 1.0 / len : 0.0;
+                nrm[i * 3] = acc[i * 3] * inv_len;
+                nrm[i * 3 + 1] = acc[i * 3 + 1] * inv_len;
+                nrm[i * 3 + 2] = acc[i * 3 + 2] * inv_len;
+            }
+        }
+        else
+        {
+            ret->normals = RR::AllocateEmptyRRNamedArray<rr_geom::Vector3>(0);
+        }
+        ret->colors = RR::AllocateEmptyRRNamedArray<com::robotraconteur::color::ColorRGB>(0);
+        return ret;
+    }
+
+    MeshLodCache::MeshLodCache(size_t max_entries, uint64_t max_bytes)
+    {
+        this->max_entries = max_entries;
+        this->max_bytes = max_bytes;
+    }
+
+    uint64_t MeshLodCache::lod_bytes(const LodMeshPtr& lod)
+    {
+        return lod->points.size() * sizeof(float) + lod->triangles.size() * sizeof(int32_t);
+    }
+
+    LodMeshPtr MeshLodCache::get(uint32_t ind, uint32_t target_triangles)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        key_type key(ind, target_triangles);
+        auto e = lods.find(key);
+        if (e == lods.end())
+        {
+            return LodMeshPtr();
+        }
+        lru.remove(key);
+        lru.push_front(key);
+        return e->second;
+    }
+
+    void MeshLodCache::put(uint32_t ind, uint32_t target_triangles, LodMeshPtr lod)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        if (lod_bytes(lod) > max_bytes)
+        {
+            return;
+        }
+        key_type key(ind, target_triangles);
+        auto e = lods.find(key);
+        if (e != lods.end())
+        {
+            bytes -= lod_bytes(e->second);
+            lru.remove(key);
+        }
+        lods[key] = lod;
+        bytes += lod_bytes(lod);
+        lru.push_front(key);
+        while (lru.size() > max_entries || bytes > max_bytes)
+        {
+            auto oldest = lods.find(lru.back());
+            bytes -= lod_bytes(oldest->second);
+            lods.erase(oldest);
+            lru.pop_back();
+        }
+    }
+}
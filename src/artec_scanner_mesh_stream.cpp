@@ -0,0 +1,182 @@
+#include "artec_scanner_mesh_stream.h"
+#include "artec_scanner_convert.h"
+#include "artec_scanner_worker_pool.h"
+
+#include <unordered_map>
+
+namespace asdk {
+    using namespace artec::sdk::base;
+};
+
+namespace RR=RobotRaconteur;
+namespace rr_geom = com::robotraconteur::geometry;
+namespace rr_shapes = com::robotraconteur::geometry::shapes;
+namespace rr_artec = experimental::artec_scanner;
+
+namespace artec_scanner_robotraconteur_driver
+{
+    CompositeMeshStream::CompositeMeshStream(asdk::ICompositeMesh* mesh, const MeshConvertOptions& options,
+        uint32_t chunk_triangles)
+    {
+        this->mesh = mesh;
+        this->options = options;
+        this->chunk_triangles = chunk_triangles;
+
+        // All Artec SDK calls, including the array size and pointer accessors, are made here.
+        // build_chunk runs on the worker pool and only reads the plain memory behind the
+        // pointers, which stays valid while the arrays are held.
+        points = mesh->getPoints();
+        triangles = mesh->getTriangles();
+        vertex_count = static_cast<size_t>(points.size());
+        triangle_count = static_cast<size_t>(triangles.size());
+        points_p = vertex_count > 0 ? &points[0] : nullptr;
+        triangles_p = triangle_count > 0 ? reinterpret_cast<const int32_t*>(&triangles[0].x) : nullptr;
+        if (options.include_normals)
+        {
+            mesh->calculate( asdk::CM_Normals );
+            points_normals = mesh->getPointsNormals();
+            if (static_cast<size_t>(points_normals.size()) != vertex_count)
+            {
+                RR_ARTEC_LOG_ERROR("Composite mesh normal count does not match vertex count");
+                throw RR::InvalidOperationException("Composite mesh normal count does not match vertex count");
+            }
+            normals_p = vertex_count > 0 ? &points_normals[0] : nullptr;
+        }
+
+        // An empty mesh is sent as one empty chunk so the client still receives the totals
+        size_t count = (triangle_count + chunk_triangles - 1) / chunk_triangles;
+        chunk_count = static_cast<uint32_t>((std::max)(count, (size_t)1));
+    }
+
+    rr_artec::CompositeMeshChunkPtr CompositeMeshStream::build_chunk(uint32_t chunk_index)
+    {
+        const size_t first = static_cast<size_t>(chunk_index) * chunk_triangles;
+        const size_t n = first < triangle_count ? (std::min)(static_cast<size_t>(chunk_triangles), triangle_count - first) : 0;
+        // Artec meshes are in millimeters
+        const double scale = options.units == rr_artec::MeshUnits::meters ? 0.001 : 1.0;
+
+        // Assign chunk local vertex indices in order of first use
+        std::unordered_map<int32_t, uint32_t> local_index;
+        local_index.reserve(n * 2);
+        std::vector<uint32_t> global_index;
+        global_index.reserve(n);
+        std::vector<uint32_t> local_triangles(n * 3);
+        const int32_t* t = n > 0 ? triangles_p + first * 3 : nullptr;
+        for (size_t i = 0; i < n * 3; i++)
+        {
+            int32_t g = t[i];
+            if (g < 0 || static_cast<size_t>(g) >= vertex_count)
+            {
+                RR_ARTEC_LOG_ERROR("Composite mesh triangle references invalid vertex " << g);
+                throw RR::InvalidOperationException("Composite mesh triangle references invalid vertex");
+            }
+            auto e = local_index.emplace(g, static_cast<uint32_t>(global_index.size()));
+            if (e.second)
+            {
+                global_index.push_back(static_cast<uint32_t>(g));
+            }
+            local_triangles[i] = e.first->second;
+        }
+
+        const size_t nv = global_index.size();
+        auto ret = RR_MAKE_SHARED<rr_artec::CompositeMeshChunk>();
+        ret->chunk_index = chunk_index;
+        ret->chunk_count = chunk_count;
+        ret->triangle_offset = static_cast<uint32_t>(first);
+        ret->total_triangle_count = static_cast<uint32_t>(triangle_count);
+        ret->total_vertex_count = static_cast<uint32_t>(vertex_count);
+
+        ret->vertices = RR::AllocateEmptyRRNamedArray<rr_geom::Point>(nv);
+        double* v = ret->vertices->GetNumericArray()->data();
+        for (size_t i = 0; i < nv; i++)
+        {
+            const asdk::Point3F& src = points_p[global_index[i]];
+            v[i * 3] = src.x * scale;
+            v[i * 3 + 1] = src.y * scale;
+            v[i * 3 + 2] = src.z * scale;
+        }
+
+        if (options.include_normals)
+        {
+            ret->normals = RR::AllocateEmptyRRNamedArray<rr_geom::Vector3>(nv);
+            double* nrm = ret->normals->GetNumericArray()->data();
+            for (size_t i = 0; i < nv; i++)
+            {
+                const asdk::Point3F& src = normals_p[global_index[i]];
+                nrm[i * 3] = src.x;
+                nrm[i * 3 + 1] = src.y;
+                nrm[i * 3 + 2] = src.z;
+            }
+        }
+        else
+        {
+            ret->normals = RR::AllocateEmptyRRNamedArray<rr_geom::Vector3>(0);
+        }
+
+        ret->triangles = ConvertPackedArrayToRR<rr_shapes::MeshTriangle>(local_triangles.data(), n);
+        ret->vertex_indices = RR::AttachRRArrayCopy(global_index.data(), nv);
+        return ret;
+    }
+
+    void CompositeMeshStream::AsyncNext(boost::function<void(const rr_artec::CompositeMeshChunkPtr&,
+        const RR::RobotRaconteurExceptionPtr&)> handler, int32_t timeout)
+    {
+        uint32_t chunk_index;
+        {
+            boost::mutex::scoped_lock lock(this_lock);
+            if (aborted)
+            {
+                throw RR::OperationAbortedException("Composite mesh stream was aborted");
+            }
+            if (closed || next_chunk >= chunk_count)
+            {
+                throw RR::StopIterationException("");
+            }
+            if (busy)
+            {
+                throw RR::InvalidOperationException("Next call already in progress");
+            }
+            busy = true;
+            chunk_index = next_chunk++;
+        }
+
+        // Chunks are converted on the worker pool to keep the transport threads free
+        auto this_ = shared_from_this();
+        GetWorkerPool()->post([this_, chunk_index, handler]() {
+            rr_artec::CompositeMeshChunkPtr ret;
+            RR::RobotRaconteurExceptionPtr err;
+            try
+            {
+                ret = this_->build_chunk(chunk_index);
+            }
+            catch (std::exception& e)
+            {
+                RR_ARTEC_LOG_ERROR("Error converting composite mesh chunk " << chunk_index << ": " << e.what());
+                err = RR::RobotRaconteurExceptionUtil::ExceptionToSharedPtr(e);
+            }
+            {
+                boost::mutex::scoped_lock lock(this_->this_lock);
+                this_->busy = false;
+            }
+            handler(ret, err);
+        });
+    }
+
+    void CompositeMeshStream::AsyncClose(boost::function<void(const RR::RobotRaconteurExceptionPtr& err)> handler,
+                    int32_t timeout)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        closed = true;
+        lock.unlock();
+        handler(nullptr);
+    }
+
+    void CompositeMeshStream::AsyncAbort(boost::function<void(const RR::RobotRaconteurExceptionPtr& err)> handler,
+                    int32_t timeout)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        aborted = true;
+        lock.unlock();
+        handler(nullptr);
+    }
+}
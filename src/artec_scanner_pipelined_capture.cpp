@@ -0,0 +1,164 @@
+#include "artec_scanner_pipelined_capture.h"
+
+#include <artec/sdk/capturing/IFrameProcessor.h>
+#include <artec/sdk/base/IFrameMesh.h>
+
+namespace asdk {
+    using namespace artec::sdk::base;
+    using namespace artec::sdk::capturing;
+};
+using asdk::TRef;
+
+namespace RR=RobotRaconteur;
+namespace rr_artec = experimental::artec_scanner;
+
+namespace artec_scanner_robotraconteur_driver
+{
+    PipelinedCapture::PipelinedCapture(asdk::IScanner* scanner, FrameProcessorPoolPtr frame_processors,
+        RR::PipeBroadcasterPtr<rr_artec::PipelinedCaptureResultPtr> broadcaster,
+        const MeshConvertOptions& mesh_options, bool with_texture, uint32_t max_frames, size_t max_in_flight)
+        : stop_requested(false)
+    {
+        this->scanner = scanner;
+        this->frame_processors = frame_processors;
+        this->broadcaster = broadcaster;
+        this->mesh_options = mesh_options;
+        this->with_texture = with_texture;
+        this->max_frames = max_frames;
+        this->max_in_flight = (std::max)(max_in_flight, (size_t)1);
+        queue = GetWorkerPool()->create_queue(this->max_in_flight);
+    }
+
+    void PipelinedCapture::start()
+    {
+        // The thread keeps this object alive until it exits, stop() must be called to end it
+        capture_thread = boost::thread(boost::bind(&PipelinedCapture::capture_thread_func, shared_from_this()));
+    }
+
+    void PipelinedCapture::capture_thread_func()
+    {
+        for (uint64_t sequence_number = 0; max_frames == 0 || sequence_number < max_frames; sequence_number++)
+        {
+            {
+                boost::mutex::scoped_lock lock(this_lock);
+                while (in_flight >= max_in_flight && !stop_requested.load())
+                {
+                    in_flight_cv.wait(lock);
+                }
+                if (stop_requested.load())
+                {
+                    return;
+                }
+                in_flight++;
+            }
+
+            TRef<asdk::IFrame> frame;
+            asdk::ErrorCode res = scanner->capture(&frame, with_texture);
+            if (res != asdk::ErrorCode_OK)
+            {
+                RR_ARTEC_LOG_ERROR("Pipelined capture stopped after capture error: " << (int32_t)res);
+                auto result = RR_MAKE_SHARED<rr_artec::PipelinedCaptureResult>();
+                result->sequence_number = sequence_number;
+                result->success.value = 0;
+                complete_frame(result);
+                return;
+            }
+
+            auto this_ = shared_from_this();
+            if (!queue->try_post([this_, sequence_number, frame]() {
+                    this_->process_frame(sequence_number, frame);
+                }))
+            {
+                // Not expected since in_flight bounds the queue, reconstruct on this thread
+                process_frame(sequence_number, frame);
+            }
+        }
+    }
+
+    void PipelinedCapture::process_frame(uint64_t sequence_number, TRef<asdk::IFrame> frame)
+    {
+        auto result = RR_MAKE_SHARED<rr_artec::PipelinedCaptureResult>();
+        result->sequence_number = sequence_number;
+        result->success.value = 0;
+        try
+        {
+            TRef<asdk::IFrameMesh> mesh;
+            {
+                FrameProcessorLease processor = frame_processors->checkout();
+                RR_CALL_ARTEC(processor->reconstructAndTexturizeMesh(&mesh, frame), "Error reconstructing mesh");
+            }
+            result->mesh = ConvertArtecFrameMeshToRR(mesh, mesh_options);
+            result->success.value = 1;
+        }
+        catch (std::exception& e)
+        {
+            RR_ARTEC_LOG_ERROR("Pipelined capture frame " << sequence_number << " failed: " << e.what());
+        }
+        complete_frame(result);
+    }
+
+    void PipelinedCapture::complete_frame(const rr_artec::PipelinedCaptureResultPtr& result)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        completed.insert(std::make_pair(result->sequence_number, result));
+        // Send under the lock so packets leave in sequence order, AsyncSendPacket does not block
+        for (auto e = completed.find(next_send); e != completed.end(); e = completed.find(next_send))
+        {
+            try
+            {
+                if (broadcaster)
+                {
+                    broadcaster->AsyncSendPacket(e->second, []() {});
+                }
+            }
+            catch (std::exception& ex)
+            {
+                RR_ARTEC_LOG_WARNING("Error sending pipelined capture result: " << ex.what());
+            }
+            completed.erase(e);
+            next_send++;
+        }
+        in_flight--;
+        in_flight_cv.notify_all();
+    }
+
+    void PipelinedCapture::stop()
+    {
+        // Only the first caller joins the capture thread
+        if (stop_requested.exchange(true))
+        {
+            return;
+        }
+        {
+            boost::mutex::scoped_lock lock(this_lock);
+            in_flight_cv.notify_all();
+        }
+        capture_thread.join();
+
+        boost::mutex::scoped_lock lock(this_lock);
+        while (in_flight > 0)
+        {
+            in_flight_cv.wait(lock);
+        }
+    }
+
+    PipelinedCapture::~PipelinedCapture()
+    {
+        stop_requested.store(true);
+        {
+            boost::mutex::scoped_lock lock(this_lock);
+            in_flight_cv.notify_all();
+        }
+        if (!capture_thread.joinable())
+        {
+            return;
+        }
+        // The last reference may be released by the capture thread itself
+        if (capture_thread.get_id() == boost::this_thread::get_id())
+        {
+            capture_thread.detach();
+            return;
+        }
+        capture_thread.join();
+    }
+}
@@ -0,0 +1,345 @@
+#include "artec_scanner_preview.h"
+#include "artec_scanner_telemetry.h"
+#include "artec_scanner_convert.h"
+#include "artec_scanner_util.h"
+
+#include <artec/sdk/base/IFrameMesh.h>
+#include <artec/sdk/base/TArrayRef.h>
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+
+namespace asdk {
+    using namespace artec::sdk::base;
+    using namespace artec::sdk::scanning;
+};
+
+namespace RR=RobotRaconteur;
+namespace rr_geom = com::robotraconteur::geometry;
+namespace rr_artec = experimental::artec_scanner;
+
+namespace artec_scanner_robotraconteur_driver
+{
+    ScanPreviewSettings GetScanPreviewSettings(const RR::RRMapPtr<std::string,RR::RRValue>& extended)
+    {
+        ScanPreviewSettings ret;
+        double v;
+        if (TryGetExtendedNumber(extended, "preview_rate", v))
+        {
+            if (!(v >= 0.0) || v > 1000.0)
+            {
+                RR_ARTEC_LOG_ERROR("Invalid preview_rate: " << v);
+                throw RR::InvalidArgumentException("preview_rate must be between 0 and 1000");
+            }
+            ret.rate = v;
+        }
+        if (TryGetExtendedNumber(extended, "preview_point_budget", v))
+        {
+            if (!(v >= 1.0) || v > 10000000.0)
+            {
+                RR_ARTEC_LOG_ERROR("Invalid preview_point_budget: " << v);
+                throw RR::InvalidArgumentException("preview_point_budget must be between 1 and 10000000");
+            }
+            ret.point_budget = static_cast<uint32_t>(v);
+        }
+        if (TryGetExtendedNumber(extended, "preview_voxel_size", v))
+        {
+            if (!(v > 0.0))
+            {
+                RR_ARTEC_LOG_ERROR("Invalid preview_voxel_size: " << v);
+                throw RR::InvalidArgumentException("preview_voxel_size must be greater than zero");
+            }
+            ret.voxel_size = v;
+        }
+        return ret;
+    }
+
+    // Voxel coordinates are packed into 21 bits each. Wrapping only merges voxels that are
+    // 2^21 voxels apart, which is far outside the scanner working volume.
+    static uint64_t voxel_key(float x, float y, float z, double inv_voxel)
+    {
+        const uint64_t m = (1ull << 21) - 1;
+        uint64_t ix = static_cast<uint64_t>(static_cast<int64_t>(std::floor(x * inv_voxel))) & m;
+        uint64_t iy = static_cast<uint64_t>(static_cast<int64_t>(std::floor(y * inv_voxel))) & m;
+        uint64_t iz = static_cast<uint64_t>(static_cast<int64_t>(std::floor(z * inv_voxel))) & m;
+        return (ix << 42) | (iy << 21) | iz;
+    }
+
+    void VoxelAccumulator::reset(double voxel_size, size_t point_budget)
+    {
+        voxels.clear();
+        this->voxel_size = voxel_size;
+        this->point_budget = point_budget;
+        source_count = 0;
+    }
+
+    void VoxelAccumulator::regrid(double new_voxel_size)
+    {
+        std::unordered_map<uint64_t, Voxel> merged;
+        merged.reserve(voxels.size());
+        const double inv_voxel = 1.0 / new_voxel_size;
+        for (auto& e : voxels)
+        {
+            const Voxel& v = e.second;
+            double inv_n = 1.0 / v.count;
+            uint64_t key = voxel_key(static_cast<float>(v.sum[0] * inv_n), static_cast<float>(v.sum[1] * inv_n),
+                static_cast<float>(v.sum[2] * inv_n), inv_voxel);
+            auto m = merged.emplace(key, v);
+            if (!m.second)
+            {
+                Voxel& d = m.first->second;
+                d.sum[0] += v.sum[0];
+                d.sum[1] += v.sum[1];
+                d.sum[2] += v.sum[2];
+                d.count += v.count;
+            }
+        }
+        voxels.swap(merged);
+        voxel_size = new_voxel_size;
+    }
+
+    void VoxelAccumulator::add(const std::vector<float>& points)
+    {
+        const size_t count = points.size() / 3;
+        const double inv_voxel = 1.0 / voxel_size;
+        for (size_t i = 0; i < count; i++)
+        {
+            const float* p = &points[i * 3];
+            Voxel v = { { p[0], p[1], p[2] }, 1 };
+            auto e = voxels.emplace(voxel_key(p[0], p[1], p[2], inv_voxel), v);
+            if (!e.second)
+            {
+                Voxel& d = e.first->second;
+                d.sum[0] += p[0];
+                d.sum[1] += p[1];
+                d.sum[2] += p[2];
+                d.count++;
+            }
+        }
+        source_count += count;
+
+        for (int attempt = 0; attempt < 8 && point_budget > 0 && voxels.size() > point_budget; attempt++)
+        {
+            // Scanned surfaces fill voxels in two dimensions
+            double ratio = static_cast<double>(voxels.size()) / static_cast<double>(point_budget);
+            regrid(voxel_size * (std::max)(1.2, std::sqrt(ratio)));
+        }
+    }
+
+    void VoxelAccumulator::get_points(std::vector<float>& out) const
+    {
+        out.clear();
+        if (voxels.empty() || point_budget == 0)
+        {
+            return;
+        }
+        // Keep every n-th voxel if regridding did not meet the budget
+        size_t stride = (voxels.size() + point_budget - 1) / point_budget;
+        out.reserve((voxels.size() / stride + 1) * 3);
+        size_t i = 0;
+        for (auto& e : voxels)
+        {
+            if (i++ % stride != 0)
+            {
+                continue;
+            }
+            const Voxel& v = e.second;
+            double inv_n = 1.0 / v.count;
+            out.push_back(static_cast<float>(v.sum[0] * inv_n));
+            out.push_back(static_cast<float>(v.sum[1] * inv_n));
+            out.push_back(static_cast<float>(v.sum[2] * inv_n));
+        }
+    }
+
+    double VoxelAccumulator::get_voxel_size() const
+    {
+        return voxel_size;
+    }
+
+    uint64_t VoxelAccumulator::get_source_count() const
+    {
+        return source_count;
+    }
+
+    // Frames queued while the accumulation work runs. Beyond this the oldest queued frame is
+    // dropped, which only leaves a gap in the preview until the area is scanned again.
+    static const size_t MAX_PENDING_PREVIEW_FRAMES = 4;
+
+    void ScanPreviewPublisher::Init(const RR::PipePtr<rr_artec::ScanPreviewPtr>& pipe)
+    {
+        auto b = RR_MAKE_SHARED<RR::PipeBroadcaster<rr_artec::ScanPreviewPtr> >();
+        // Previews are superseded by the next one, so slow clients only get the latest
+        b->Init(pipe, 1);
+        boost::mutex::scoped_lock lock(this_lock);
+        broadcaster = b;
+        if (!queue)
+        {
+            queue = GetWorkerPool()->create_queue(1);
+        }
+    }
+
+    void ScanPreviewPublisher::begin_scan()
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        pending.clear();
+        reset_pending = true;
+        accepted_any = false;
+    }
+
+    void ScanPreviewPublisher::submit_frame(const ScanPreviewSettings& settings, const asdk::RegistrationInfo* info,
+        uint32_t frame_count)
+    {
+        if (settings.rate <= 0.0 || !info)
+        {
+            return;
+        }
+        FrameTelemetrySample sample;
+        RegistrationInfoToTelemetrySample(info, sample);
+        if (sample.registration_error != asdk::ErrorCode_OK)
+        {
+            return;
+        }
+
+        auto now = boost::chrono::steady_clock::now();
+        {
+            boost::mutex::scoped_lock lock(this_lock);
+            if (!broadcaster || broadcaster->GetActivePipeEndpointCount() == 0)
+            {
+                return;
+            }
+            auto period = boost::chrono::duration<double>(1.0 / settings.rate);
+            if (accepted_any && now - last_accepted < period)
+            {
+                return;
+            }
+            accepted_any = true;
+            last_accepted = now;
+        }
+
+        asdk::IFrameMesh* mesh = RegistrationInfoFrameMesh(info);
+        if (!mesh)
+        {
+            return;
+        }
+        asdk::TArrayPoint3F points = mesh->getPoints();
+        size_t points_count = static_cast<size_t>(points.size());
+
+        PendingFrame frame;
+        frame.points.resize(points_count * 3);
+        if (points_count > 0)
+        {
+            std::memcpy(frame.points.data(), &points[0].x, points_count * 3 * sizeof(float));
+        }
+        std::memcpy(frame.transform, sample.transform, sizeof(frame.transform));
+        frame.frame_number = sample.frame_number;
+        frame.frame_count = frame_count;
+        frame.settings = settings;
+
+        boost::mutex::scoped_lock lock(this_lock);
+        if (pending.size() >= MAX_PENDING_PREVIEW_FRAMES)
+        {
+            pending.pop_front();
+        }
+        pending.push_back(std::move(frame));
+        if (!work_posted)
+        {
+            work_posted = true;
+            post_work();
+        }
+    }
+
+    void ScanPreviewPublisher::post_work()
+    {
+        boost::weak_ptr<ScanPreviewPublisher> weak_this = shared_from_this();
+        if (!queue->try_post([weak_this]() {
+                auto t = weak_this.lock();
+                if (!t) return;
+                t->work();
+            }))
+        {
+            work_posted = false;
+        }
+    }
+
+    void ScanPreviewPublisher::work()
+    {
+        bool reset;
+        RR::PipeBroadcasterPtr<rr_artec::ScanPreviewPtr> b;
+        {
+            boost::mutex::scoped_lock lock(this_lock);
+            work_frames.clear();
+            work_frames.swap(pending);
+            // The first frame of a scan carries the scan's settings
+            reset = reset_pending && !work_frames.empty();
+            if (reset)
+            {
+                reset_pending = false;
+            }
+            b = broadcaster;
+        }
+
+        try
+        {
+            if (reset)
+            {
+                const ScanPreviewSettings& settings = work_frames.front().settings;
+                accumulator.reset(settings.voxel_size, settings.point_budget);
+            }
+
+            for (auto& f : work_frames)
+            {
+                // Frame points are in scanner coordinates in millimeters, the preview is in
+                // scan coordinates in meters. transform is column major.
+                const double* m = f.transform;
+                const size_t source_count = f.points.size() / 3;
+                for (size_t i = 0; i < source_count; i++)
+                {
+                    float* p = &f.points[i * 3];
+                    double x = p[0];
+                    double y = p[1];
+                    double z = p[2];
+                    p[0] = static_cast<float>((m[0] * x + m[4] * y + m[8] * z + m[12]) * 0.001);
+                    p[1] = static_cast<float>((m[1] * x + m[5] * y + m[9] * z + m[13]) * 0.001);
+                    p[2] = static_cast<float>((m[2] * x + m[6] * y + m[10] * z + m[14]) * 0.001);
+                }
+                accumulator.add(f.points);
+            }
+
+            if (!work_frames.empty())
+            {
+                const PendingFrame& latest = work_frames.back();
+                accumulator.get_points(preview_points);
+
+                auto ret = RR_MAKE_SHARED<rr_artec::ScanPreview>();
+                ret->sequence_number = sequence_number++;
+                ret->frame_number = latest.frame_number;
+                ret->frame_count = latest.frame_count;
+                // Points accumulated into the preview, saturated for very long scans
+                ret->source_point_count = static_cast<uint32_t>((std::min)(accumulator.get_source_count(),
+                    static_cast<uint64_t>(std::numeric_limits<uint32_t>::max())));
+                ret->voxel_size = accumulator.get_voxel_size();
+                ret->points = ConvertPackedArrayToRR<rr_geom::Point>(preview_points.data(), preview_points.size() / 3);
+                if (b)
+                {
+                    b->AsyncSendPacket(ret, []() {});
+                }
+            }
+        }
+        catch (std::exception& e)
+        {
+            RR_ARTEC_LOG_WARNING("Error building scan preview: " << e.what());
+        }
+
+        boost::mutex::scoped_lock lock(this_lock);
+        if (!pending.empty())
+        {
+            post_work();
+        }
+        else
+        {
+            work_posted = false;
+        }
+    }
+}
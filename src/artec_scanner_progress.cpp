@@ -0,0 +1,89 @@
+#include "artec_scanner_progress.h"
+
+#include <algorithm>
+
+namespace artec_scanner_robotraconteur_driver
+{
+    JobProgressSink::JobProgressSink()
+        : current(0), total(0), start_us(now_us()), notified_percent(-1)
+    {
+    }
+
+    int64_t JobProgressSink::now_us()
+    {
+        return boost::chrono::duration_cast<boost::chrono::microseconds>(
+            boost::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void JobProgressSink::set_changed_handler(boost::function<void()> handler)
+    {
+        boost::mutex::scoped_lock lock(changed_lock);
+        changed = handler;
+    }
+
+    void JobProgressSink::restart()
+    {
+        current.store(0, boost::memory_order_relaxed);
+        total.store(0, boost::memory_order_relaxed);
+        notified_percent.store(-1, boost::memory_order_relaxed);
+        start_us.store(now_us(), boost::memory_order_release);
+    }
+
+    void JobProgressSink::report(int current, int total)
+    {
+        if (total <= 0)
+        {
+            return;
+        }
+        this->total.store(total, boost::memory_order_relaxed);
+        this->current.store((std::min)((std::max)(current, 0), total), boost::memory_order_release);
+
+        int32_t percent = static_cast<int32_t>(100.0 * this->current.load(boost::memory_order_relaxed) / total);
+        if (notified_percent.exchange(percent, boost::memory_order_relaxed) == percent)
+        {
+            return;
+        }
+        boost::function<void()> h;
+        {
+            boost::mutex::scoped_lock lock(changed_lock);
+            h = changed;
+        }
+        if (h)
+        {
+            h();
+        }
+    }
+
+    void JobProgressSink::pulse()
+    {
+        // Reported by jobs that cannot estimate their progress, the heartbeat covers liveness
+    }
+
+    JobProgress JobProgressSink::get_progress()
+    {
+        int32_t c = current.load(boost::memory_order_acquire);
+        int32_t t = total.load(boost::memory_order_relaxed);
+        if (t <= 0)
+        {
+            return get_progress(-1.0);
+        }
+        return get_progress(static_cast<double>(c) / t);
+    }
+
+    JobProgress JobProgressSink::get_progress(double fraction)
+    {
+        JobProgress ret;
+        ret.elapsed_time = (now_us() - start_us.load(boost::memory_order_acquire)) * 1e-6;
+        if (!(fraction >= 0.0))
+        {
+            return ret;
+        }
+        fraction = (std::min)(fraction, 1.0);
+        ret.percent = fraction * 100.0;
+        if (fraction > 0.0)
+        {
+            ret.remaining_time = ret.elapsed_time * (1.0 - fraction) / fraction;
+        }
+        return ret;
+    }
+}
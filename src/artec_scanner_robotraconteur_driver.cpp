@@ -2,6 +2,9 @@
 #include <RobotRaconteur.h>
 #include <RobotRaconteurCompanion/StdRobDef/StdRobDefAll.h>
 #include "artec_scanner_impl.h"
+#include "artec_scanner_worker_pool.h"
+#include "artec_scanner_generator.h"
+#include "artec_scanner_thread_budget.h"
 
 #include <artec/sdk/capturing/IScanner.h>
 #include <artec/sdk/capturing/IArrayScannerId.h>
@@ -33,7 +36,33 @@ int main(int argc, char* argv[])
     desc.add_options()
         ("help", "produce help message")
         ("project-save-path", po::value<std::string>(), "set project save path")
-        ("no-scanner","Do not search for scanner. Only used to process existing scan data");
+        ("no-scanner","Do not search for scanner. Only used to process existing scan data")
+        ("worker-threads", po::value<uint32_t>()->default_value(0), 
+            "number of worker threads for capture preparation and mesh conversion, 0 for hardware concurrency")
+        ("worker-cpus", po::value<std::string>(),
+            "restrict worker threads to a CPU list such as 0-3,6")
+        ("algorithm-threads", po::value<uint32_t>()->default_value(0),
+            "threads per algorithm job when the algorithm does not set threads_count, 0 for all available")
+        ("scanning-reserved-threads", po::value<uint32_t>()->default_value(0),
+            "hardware threads algorithm jobs leave free for scanning procedures")
+        ("scanning-threads", po::value<uint32_t>()->default_value(0),
+            "threads per scanning procedure job when the settings do not set threads_count, 0 for the SDK default")
+        ("generator-heartbeat-ms", po::value<uint32_t>()->default_value(5000),
+            "longest time a generator Next call waits for progress before returning a running status")
+        ("deferred-cache-budget-mb", po::value<uint32_t>()->default_value(2048),
+            "memory budget for cached deferred capture meshes and stl bytes, 0 for unlimited")
+        ("deferred-capture-ttl-s", po::value<uint32_t>()->default_value(0),
+            "free deferred capture handles not accessed for this many seconds, 0 to keep until freed")
+        ("deferred-resident-frames", po::value<uint32_t>()->default_value(0),
+            "spill frames of least recently used deferred captures beyond this count to the project save path, 0 to keep all in memory")
+        ("algorithm-cache-entries", po::value<uint32_t>()->default_value(0),
+            "number of algorithm chain results kept for reuse by run_algorithms, 0 to disable")
+        ("algorithm-cache-budget-mb", po::value<uint32_t>()->default_value(1024),
+            "estimated memory of cached algorithm chain results, 0 for unlimited")
+        ("max-concurrent-jobs", po::value<uint32_t>()->default_value(2),
+            "algorithm runs executing at once, further runs are queued, 0 for no limit. Scanning procedures are not limited")
+        ("job-memory-budget-mb", po::value<uint32_t>()->default_value(0),
+            "estimated memory of algorithm runs executing at once, further jobs are queued, 0 for no limit");
 
     po::variables_map vm;
     po::store(po::command_line_parser(argc, argv).options(desc).allow_unregistered().run(), vm);
@@ -44,6 +73,41 @@ int main(int argc, char* argv[])
         return 1;
     }
 
+    uint32_t heartbeat_ms = vm["generator-heartbeat-ms"].as<uint32_t>();
+    if (heartbeat_ms == 0)
+    {
+        std::cerr << "generator-heartbeat-ms must be greater than zero" << std::endl;
+        return 1;
+    }
+    SetGeneratorHeartbeatPeriod(boost::posix_time::milliseconds(heartbeat_ms));
+
+    std::vector<uint32_t> worker_cpus;
+    if (vm.count("worker-cpus"))
+    {
+        try
+        {
+            worker_cpus = ParseCpuList(vm["worker-cpus"].as<std::string>());
+        }
+        catch (std::invalid_argument& e)
+        {
+            std::cerr << "Invalid worker-cpus: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    ThreadBudgetSettings thread_budget;
+    thread_budget.algorithm_threads = vm["algorithm-threads"].as<uint32_t>();
+    thread_budget.scanning_reserved_threads = vm["scanning-reserved-threads"].as<uint32_t>();
+    thread_budget.scanning_threads = vm["scanning-threads"].as<uint32_t>();
+    SetThreadBudget(thread_budget);
+
+    auto worker_pool = InitWorkerPool(vm["worker-threads"].as<uint32_t>(), worker_cpus);
+    worker_pool->set_error_handler([](const std::string& msg)
+    {
+        RR_ARTEC_LOG_ERROR("Error in worker pool task: " << msg);
+    });
+    std::cerr << "Using " << worker_pool->get_thread_count() << " worker threads" << std::endl;
+
     TRef<asdk::IScanner> scanner;
     if(vm.count("no-scanner") == 0)
     {
@@ -84,6 +148,23 @@ int main(int argc, char* argv[])
         boost::filesystem::path save_path(vm["project-save-path"].as<std::string>());
         scanner_impl->set_save_path(save_path);
     }
+    scanner_impl->set_deferred_capture_limits(
+        static_cast<size_t>(vm["deferred-cache-budget-mb"].as<uint32_t>()) * 1024 * 1024,
+        boost::chrono::seconds(vm["deferred-capture-ttl-s"].as<uint32_t>()));
+    uint32_t resident_frames = vm["deferred-resident-frames"].as<uint32_t>();
+    if (resident_frames > 0)
+    {
+        if (!vm.count("project-save-path"))
+        {
+            std::cerr << "deferred-resident-frames requires project-save-path" << std::endl;
+            return 1;
+        }
+        scanner_impl->set_deferred_frame_spill(resident_frames);
+    }
+    scanner_impl->set_algorithm_cache_limits(vm["algorithm-cache-entries"].as<uint32_t>(),
+        static_cast<uint64_t>(vm["algorithm-cache-budget-mb"].as<uint32_t>()) * 1024 * 1024);
+    scanner_impl->set_job_limits(vm["max-concurrent-jobs"].as<uint32_t>(),
+        static_cast<uint64_t>(vm["job-memory-budget-mb"].as<uint32_t>()) * 1024 * 1024);
     
     RR::RobotRaconteurNodeSetup node_setup(RR::RobotRaconteurNode::sp(),
         ROBOTRACONTEUR_SERVICE_TYPES, "experimental.artec_scanner", 64238,
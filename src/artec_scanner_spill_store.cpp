@@ -0,0 +1,351 @@
+#include "artec_scanner_spill_store.h"
+#include "artec_scanner_impl.h"
+
+#include <artec/sdk/base/IArray.h>
+#include <artec/sdk/base/IImage.h>
+#include <artec/sdk/capturing/IFrameProcessor.h>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace asdk {
+    using namespace artec::sdk::base;
+    using namespace artec::sdk::capturing;
+};
+
+namespace RR=RobotRaconteur;
+namespace bip=boost::interprocess;
+
+namespace artec_scanner_robotraconteur_driver
+{
+    static const uint32_t SPILL_RECORD_MAGIC = 0x53464441;
+
+    // Removed records below this are not worth rewriting the file for
+    static const uint64_t SPILL_COMPACT_MIN_DEAD_BYTES = 64ull * 1024 * 1024;
+
+    // Fixed size header in front of each record, followed by the points, triangles, uv
+    // coordinates and texture image bytes
+    struct SpillRecordHeader
+    {
+        uint32_t magic;
+        int32_t handle;
+        uint32_t point_count;
+        uint32_t triangle_count;
+        uint32_t uv_count;
+        int32_t image_width;
+        int32_t image_height;
+        int32_t image_pitch;
+        int32_t image_pixel_format;
+        uint32_t reserved;
+        uint64_t image_bytes;
+    };
+
+    FrameSpillStore::FrameSpillStore(const boost::filesystem::path& path)
+    {
+        this->path = path;
+        file.open(path, std::ios::binary | std::ios::out | std::ios::trunc);
+        if (!file)
+        {
+            RR_ARTEC_LOG_ERROR("Could not open frame spill store: " << path);
+            throw RR::OperationFailedException("Could not open frame spill store");
+        }
+    }
+
+    void FrameSpillStore::append(int32_t handle, asdk::IFrameMesh* frame_mesh)
+    {
+        asdk::IArrayPoint3F* points = frame_mesh->getPoints();
+        asdk::IArrayIndexTriplet* triangles = frame_mesh->getTriangles();
+        asdk::IArrayUVCoordinates* uvs = frame_mesh->getUVCoordinates();
+        asdk::IImage* img = frame_mesh->getImage();
+
+        SpillRecordHeader h = {};
+        h.magic = SPILL_RECORD_MAGIC;
+        h.handle = handle;
+        h.point_count = points ? static_cast<uint32_t>(points->getSize()) : 0;
+        h.triangle_count = triangles ? static_cast<uint32_t>(triangles->getSize()) : 0;
+        h.uv_count = uvs ? static_cast<uint32_t>(uvs->getSize()) : 0;
+        if (img)
+        {
+            h.image_width = img->getWidth();
+            h.image_height = img->getHeight();
+            h.image_pitch = img->getPitch();
+            h.image_pixel_format = static_cast<int32_t>(img->getPixelFormat());
+            h.image_bytes = static_cast<uint64_t>(h.image_pitch) * static_cast<uint64_t>(h.image_height);
+        }
+
+        const uint64_t points_bytes = h.point_count * sizeof(asdk::Point3F);
+        const uint64_t triangles_bytes = h.triangle_count * sizeof(asdk::IndexTriplet);
+        const uint64_t uvs_bytes = h.uv_count * sizeof(asdk::UVCoordinates);
+        const uint64_t size = sizeof(h) + points_bytes + triangles_bytes + uvs_bytes + h.image_bytes;
+
+        boost::unique_lock<boost::shared_mutex> lock(this_lock);
+        file.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        if (points_bytes > 0)
+        {
+            file.write(reinterpret_cast<const char*>(points->getPointer()), points_bytes);
+        }
+        if (triangles_bytes > 0)
+        {
+            file.write(reinterpret_cast<const char*>(triangles->getPointer()), triangles_bytes);
+        }
+        if (uvs_bytes > 0)
+        {
+            file.write(reinterpret_cast<const char*>(uvs->getPointer()), uvs_bytes);
+        }
+        if (h.image_bytes > 0)
+        {
+            file.write(static_cast<const char*>(img->getPointer()), h.image_bytes);
+        }
+        // Flushed so the record is visible to the file mapping
+        file.flush();
+        if (!file)
+        {
+            RR_ARTEC_LOG_ERROR("Could not write frame spill store: " << path);
+            // The next record overwrites the partial one
+            file.clear();
+            file.seekp(static_cast<std::streamoff>(file_size));
+            throw RR::OperationFailedException("Could not write frame spill store");
+        }
+
+        Record r;
+        r.offset = file_size;
+        r.size = size;
+        auto e = index.find(handle);
+        if (e != index.end())
+        {
+            live_bytes -= e->second.size;
+        }
+        index[handle] = r;
+        file_size += size;
+        live_bytes += size;
+    }
+
+    void FrameSpillStore::load(int32_t handle, asdk::IFrameMesh** frame_mesh)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(this_lock);
+        auto e = index.find(handle);
+        if (e == index.end())
+        {
+            RR_ARTEC_LOG_ERROR("Deferred capture handle " << handle << " not found in frame spill store");
+            throw RR::InvalidOperationException("Deferred capture frame not found in spill store");
+        }
+
+        bip::file_mapping mapping(path.string().c_str(), bip::read_only);
+        bip::mapped_region region(mapping, bip::read_only, e->second.offset, e->second.size);
+        const uint8_t* p = static_cast<const uint8_t*>(region.get_address());
+
+        SpillRecordHeader h;
+        std::memcpy(&h, p, sizeof(h));
+        if (h.magic != SPILL_RECORD_MAGIC || h.handle != handle)
+        {
+            RR_ARTEC_LOG_ERROR("Corrupt frame spill store record for deferred capture handle " << handle);
+            throw RR::OperationFailedException("Corrupt frame spill store record");
+        }
+        p += sizeof(h);
+
+        // The caller owns the mesh as soon as it is created
+        *frame_mesh = nullptr;
+        RR_CALL_ARTEC(asdk::createFrameMesh(frame_mesh), "Could not create frame mesh");
+        asdk::IFrameMesh* mesh = *frame_mesh;
+
+        asdk::TRef<asdk::IArrayPoint3F> points;
+        RR_CALL_ARTEC(asdk::createArrayPoint3F(&points, h.point_count), "Could not allocate frame mesh points");
+        std::memcpy(points->getPointer(), p, h.point_count * sizeof(asdk::Point3F));
+        p += h.point_count * sizeof(asdk::Point3F);
+        mesh->setPoints(points);
+
+        asdk::TRef<asdk::IArrayIndexTriplet> triangles;
+        RR_CALL_ARTEC(asdk::createArrayIndexTriplet(&triangles, h.triangle_count), "Could not allocate frame mesh triangles");
+        std::memcpy(triangles->getPointer(), p, h.triangle_count * sizeof(asdk::IndexTriplet));
+        p += h.triangle_count * sizeof(asdk::IndexTriplet);
+        mesh->setTriangles(triangles);
+
+        if (h.uv_count > 0)
+        {
+            asdk::TRef<asdk::IArrayUVCoordinates> uvs;
+            RR_CALL_ARTEC(asdk::createArrayUVCoordinates(&uvs, h.uv_count), "Could not allocate frame mesh uv coordinates");
+            std::memcpy(uvs->getPointer(), p, h.uv_count * sizeof(asdk::UVCoordinates));
+            p += h.uv_count * sizeof(asdk::UVCoordinates);
+            mesh->setUVCoordinates(uvs);
+        }
+
+        if (h.image_bytes > 0)
+        {
+            asdk::TRef<asdk::IImage> img;
+            RR_CALL_ARTEC(asdk::createImage(&img, h.image_width, h.image_height,
+                static_cast<asdk::PixelFormat>(h.image_pixel_format)), "Could not allocate frame mesh texture");
+            // The new image may use a different pitch than the spilled one
+            const size_t src_pitch = static_cast<size_t>(h.image_pitch);
+            const size_t dst_pitch = static_cast<size_t>(img->getPitch());
+            const size_t row_bytes = (std::min)(src_pitch, dst_pitch);
+            uint8_t* dst = static_cast<uint8_t*>(img->getPointer());
+            for (int32_t y = 0; y < h.image_height; y++)
+            {
+                std::memcpy(dst + y * dst_pitch, p + y * src_pitch, row_bytes);
+            }
+            mesh->setImage(img);
+        }
+    }
+
+    void FrameSpillStore::remove(int32_t handle)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(this_lock);
+        auto e = index.find(handle);
+        if (e == index.end())
+        {
+            return;
+        }
+        live_bytes -= e->second.size;
+        index.erase(e);
+        if (index.empty())
+        {
+            truncate();
+            return;
+        }
+        // Compacting only once the removed records outweigh the live ones keeps the rewrite
+        // cost proportional to the bytes removed
+        uint64_t dead_bytes = file_size - live_bytes;
+        if (dead_bytes >= SPILL_COMPACT_MIN_DEAD_BYTES && dead_bytes > live_bytes)
+        {
+            compact();
+        }
+    }
+
+    void FrameSpillStore::clear()
+    {
+        boost::unique_lock<boost::shared_mutex> lock(this_lock);
+        index.clear();
+        truncate();
+    }
+
+    void FrameSpillStore::truncate()
+    {
+        file.close();
+        file.open(path, std::ios::binary | std::ios::out | std::ios::trunc);
+        file_size = 0;
+        live_bytes = 0;
+        if (!file)
+        {
+            RR_ARTEC_LOG_ERROR("Could not reopen frame spill store: " << path);
+        }
+    }
+
+    void FrameSpillStore::compact()
+    {
+        boost::filesystem::path compact_path = path;
+        compact_path += ".compact";
+
+        // Written in file order so both files are accessed sequentially
+        std::vector<std::pair<int32_t, Record> > records(index.begin(), index.end());
+        std::sort(records.begin(), records.end(), [](const std::pair<int32_t, Record>& a,
+            const std::pair<int32_t, Record>& b) { return a.second.offset < b.second.offset; });
+
+        uint64_t new_size = 0;
+        try
+        {
+            boost::filesystem::ofstream out(compact_path, std::ios::binary | std::ios::out | std::ios::trunc);
+            bip::file_mapping mapping(path.string().c_str(), bip::read_only);
+            for (auto& r : records)
+            {
+                bip::mapped_region region(mapping, bip::read_only, r.second.offset, r.second.size);
+                out.write(static_cast<const char*>(region.get_address()), r.second.size);
+                r.second.offset = new_size;
+                new_size += r.second.size;
+            }
+            out.flush();
+            if (!out)
+            {
+                throw std::runtime_error("write failed");
+            }
+        }
+        catch (std::exception& e)
+        {
+            RR_ARTEC_LOG_WARNING("Could not compact frame spill store: " << e.what());
+            boost::system::error_code ec;
+            boost::filesystem::remove(compact_path, ec);
+            return;
+        }
+
+        file.close();
+        boost::system::error_code ec;
+        boost::filesystem::rename(compact_path, path, ec);
+        if (ec)
+        {
+            RR_ARTEC_LOG_WARNING("Could not replace frame spill store with compacted file: " << ec.message());
+            boost::filesystem::remove(compact_path, ec);
+            reopen();
+            return;
+        }
+
+        RR_ARTEC_LOG_INFO("Compacted frame spill store from " << file_size << " to " << new_size << " bytes");
+        for (auto& r : records)
+        {
+            index[r.first] = r.second;
+        }
+        file_size = new_size;
+        reopen();
+    }
+
+    void FrameSpillStore::reopen()
+    {
+        // Keeps the contents, appends continue at file_size
+        file.open(path, std::ios::binary | std::ios::in | std::ios::out);
+        if (!file)
+        {
+            RR_ARTEC_LOG_ERROR("Could not reopen frame spill store: " << path);
+            return;
+        }
+        file.seekp(static_cast<std::streamoff>(file_size));
+    }
+
+    size_t FrameSpillStore::get_record_count()
+    {
+        boost::shared_lock<boost::shared_mutex> lock(this_lock);
+        return index.size();
+    }
+
+    uint64_t FrameSpillStore::get_file_size()
+    {
+        boost::shared_lock<boost::shared_mutex> lock(this_lock);
+        return file_size;
+    }
+
+    FrameSpillStore::~FrameSpillStore()
+    {
+        file.close();
+        boost::system::error_code ec;
+        boost::filesystem::remove(path, ec);
+    }
+
+    void DeferredCaptureToFrameMesh(const RRDeferredCapturePtr& capture, boost::mutex& data_lock,
+        FrameProcessorPool* frame_processors, FrameSpillStore* spill_store, asdk::IFrameMesh** frame_mesh)
+    {
+        asdk::TRef<asdk::IFrame> frame;
+        bool spilled;
+        {
+            boost::mutex::scoped_lock lock(data_lock);
+            frame = capture->frame;
+            spilled = capture->spilled;
+        }
+
+        *frame_mesh = nullptr;
+        if (frame)
+        {
+            FrameProcessorLease processor = frame_processors->checkout();
+            RR_CALL_ARTEC(processor->reconstructAndTexturizeMesh( frame_mesh, frame ), "Error reconstructing mesh");
+            return;
+        }
+
+        if (!spilled || !spill_store)
+        {
+            RR_ARTEC_LOG_ERROR("Deferred capture handle " << capture->handle << " has no frame");
+            throw RR::InvalidOperationException("Deferred capture has no frame");
+        }
+        spill_store->load(capture->handle, frame_mesh);
+        RR_ARTEC_LOG_INFO("Deferred capture handle " << capture->handle << " paged in from frame spill store");
+    }
+}
@@ -0,0 +1,125 @@
+#include "artec_scanner_telemetry.h"
+#include "artec_scanner_util.h"
+
+#include <cstring>
+
+namespace asdk {
+    using namespace artec::sdk::base;
+    using namespace artec::sdk::scanning;
+};
+
+namespace RR=RobotRaconteur;
+namespace rr_artec = experimental::artec_scanner;
+
+namespace artec_scanner_robotraconteur_driver
+{
+    FrameTelemetryPublisher::FrameTelemetryPublisher(size_t ring_capacity)
+        : ring(ring_capacity), drain_posted(false)
+    {
+    }
+
+    void FrameTelemetryPublisher::Init(const RR::PipePtr<rr_artec::FrameTelemetryPtr>& pipe)
+    {
+        auto b = RR_MAKE_SHARED<RR::PipeBroadcaster<rr_artec::FrameTelemetryPtr> >();
+        // Small backlog so slow clients drop packets instead of falling behind the scanner
+        b->Init(pipe, 3);
+        boost::mutex::scoped_lock lock(this_lock);
+        broadcaster = b;
+    }
+
+    void RegistrationInfoToTelemetrySample(const asdk::RegistrationInfo* info, FrameTelemetrySample& sample)
+    {
+        sample.frame_number = info->frameNumber;
+        sample.scanner_index = info->scannerIndex;
+        sample.registration_error = static_cast<int32_t>(info->error);
+        sample.geometry_key_frame = info->geometryKeyFrame;
+        sample.texture_key_frame = info->textureKeyFrame;
+        std::memcpy(sample.transform, info->transformation.getData(), sizeof(sample.transform));
+    }
+
+    asdk::IFrameMesh* RegistrationInfoFrameMesh(const asdk::RegistrationInfo* info)
+    {
+        return info->mesh;
+    }
+
+    void FrameTelemetryPublisher::publish(rr_artec::FrameTelemetryEvent::FrameTelemetryEvent event,
+        const asdk::RegistrationInfo* info, int32_t scanner_index)
+    {
+        FrameTelemetrySample sample;
+        std::memset(&sample, 0, sizeof(sample));
+        sample.event = event;
+        sample.scanner_index = scanner_index;
+        sample.frame_number = -1;
+        // Identity transform when there is no registration info
+        sample.transform[0] = sample.transform[5] = sample.transform[10] = sample.transform[15] = 1.0;
+        if (info)
+        {
+            RegistrationInfoToTelemetrySample(info, sample);
+        }
+
+        ring.push(sample);
+
+        if (!drain_posted.exchange(true))
+        {
+            post_drain();
+        }
+    }
+
+    void FrameTelemetryPublisher::post_drain()
+    {
+        boost::weak_ptr<FrameTelemetryPublisher> weak_this = shared_from_this();
+        bool posted = RR::RobotRaconteurNode::TryPostToThreadPool(RR::RobotRaconteurNode::weak_sp(), [weak_this]() {
+            auto t = weak_this.lock();
+            if (!t) return;
+            t->drain();
+        }, true);
+        if (!posted)
+        {
+            // Node is shutting down, entries stay in the ring until the next publish
+            drain_posted.store(false);
+        }
+    }
+
+    void FrameTelemetryPublisher::drain()
+    {
+        // Cleared before reading so entries pushed during the drain post a new one
+        drain_posted.store(false);
+
+        boost::mutex::scoped_lock drain_lock_(drain_lock);
+
+        RR::PipeBroadcasterPtr<rr_artec::FrameTelemetryPtr> b;
+        {
+            boost::mutex::scoped_lock lock(this_lock);
+            b = broadcaster;
+        }
+
+        FrameTelemetrySample sample;
+        while (ring.pop(read_index, sample, dropped_count))
+        {
+            if (!b)
+            {
+                continue;
+            }
+
+            auto ret = RR_MAKE_SHARED<rr_artec::FrameTelemetry>();
+            ret->event = sample.event;
+            ret->sequence_number = sequence_number++;
+            ret->dropped_count = static_cast<uint32_t>(dropped_count);
+            ret->scanner_index = sample.scanner_index;
+            ret->frame_number = sample.frame_number;
+            ret->registration_error = sample.registration_error;
+            ret->geometry_key_frame = sample.geometry_key_frame;
+            ret->texture_key_frame = sample.texture_key_frame;
+            ret->frame_transform = ConvertArtecTransformToRR(sample.transform);
+
+            try
+            {
+                b->AsyncSendPacket(ret, []() {});
+            }
+            catch (std::exception& e)
+            {
+                RR_ARTEC_LOG_WARNING("Error sending frame telemetry: " << e.what());
+            }
+        }
+    }
+}
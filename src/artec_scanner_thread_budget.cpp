@@ -0,0 +1,132 @@
+#include "artec_scanner_thread_budget.h"
+
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace artec_scanner_robotraconteur_driver
+{
+    static boost::mutex thread_budget_lock;
+    static ThreadBudgetSettings thread_budget;
+
+    void SetThreadBudget(const ThreadBudgetSettings& settings)
+    {
+        boost::mutex::scoped_lock lock(thread_budget_lock);
+        thread_budget = settings;
+    }
+
+    ThreadBudgetSettings GetThreadBudget()
+    {
+        boost::mutex::scoped_lock lock(thread_budget_lock);
+        return thread_budget;
+    }
+
+    int AlgorithmJobThreadCount(uint32_t requested, uint32_t threads_in_use)
+    {
+        ThreadBudgetSettings budget = GetThreadBudget();
+        uint32_t count = requested > 0 ? requested : budget.algorithm_threads;
+        if (budget.scanning_reserved_threads == 0)
+        {
+            return static_cast<int>(count);
+        }
+
+        uint32_t hardware = (std::max)(boost::thread::hardware_concurrency(), 1u);
+        uint32_t total = hardware > budget.scanning_reserved_threads ? hardware - budget.scanning_reserved_threads : 1;
+        uint32_t available = total > threads_in_use ? total - threads_in_use : 1;
+        if (count == 0)
+        {
+            return static_cast<int>(available);
+        }
+        return static_cast<int>((std::min)(count, available));
+    }
+
+    int ScanningJobThreadCount(uint32_t requested)
+    {
+        ThreadBudgetSettings budget = GetThreadBudget();
+        return static_cast<int>(requested > 0 ? requested : budget.scanning_threads);
+    }
+
+    static uint32_t parse_cpu(const std::string& s)
+    {
+        if (s.empty() || s.size() > 4 || s.find_first_not_of("0123456789") != std::string::npos)
+        {
+            throw std::invalid_argument("Invalid CPU number: " + s);
+        }
+        return static_cast<uint32_t>(std::stoul(s));
+    }
+
+    std::vector<uint32_t> ParseCpuList(const std::string& cpus)
+    {
+        std::vector<uint32_t> ret;
+        size_t pos = 0;
+        while (pos <= cpus.size())
+        {
+            size_t end = cpus.find(',', pos);
+            if (end == std::string::npos)
+            {
+                end = cpus.size();
+            }
+            std::string item = cpus.substr(pos, end - pos);
+            size_t dash = item.find('-');
+            uint32_t first = parse_cpu(item.substr(0, dash));
+            uint32_t last = dash == std::string::npos ? first : parse_cpu(item.substr(dash + 1));
+            if (last < first)
+            {
+                throw std::invalid_argument("Invalid CPU range: " + item);
+            }
+            for (uint32_t c = first; c <= last; c++)
+            {
+                ret.push_back(c);
+            }
+            pos = end + 1;
+        }
+        std::sort(ret.begin(), ret.end());
+        ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+        return ret;
+    }
+
+    bool SetCurrentThreadAffinity(const std::vector<uint32_t>& cpus)
+    {
+        if (cpus.empty())
+        {
+            return true;
+        }
+#if defined(_WIN32)
+        DWORD_PTR mask = 0;
+        for (uint32_t c : cpus)
+        {
+            if (c < sizeof(DWORD_PTR) * 8)
+            {
+                mask |= static_cast<DWORD_PTR>(1) << c;
+            }
+        }
+        return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#elif defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (uint32_t c : cpus)
+        {
+            if (c < CPU_SETSIZE)
+            {
+                CPU_SET(c, &set);
+            }
+        }
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+        return false;
+#endif
+    }
+}
@@ -1,4 +1,8 @@
 #include "artec_scanner_util.h"
+#include "artec_scanner_convert.h"
+#include "artec_scanner_worker_pool.h"
+#include "artec_scanner_image_encode.h"
+#include "artec_scanner_compact_mesh.h"
 
 #include <artec/sdk/capturing/IScanner.h>
 #include <artec/sdk/capturing/IArrayScannerId.h>
@@ -6,16 +10,22 @@
 #include <artec/sdk/capturing/IFrame.h>
 #include <artec/sdk/base/BaseSdkDefines.h>
 #include <artec/sdk/base/Log.h>
-#include <artec/sdk/base/io/StlIO.h>
 #include <artec/sdk/base/IFrameMesh.h>
 #include <artec/sdk/base/TArrayRef.h>
 #include <artec/sdk/base/io/PngIO.h>
 #include <artec/sdk/base/ITexture.h>
+#include <artec/sdk/base/IImage.h>
+#include <artec/sdk/base/IScan.h>
+#include <artec/sdk/base/ICompositeContainer.h>
 #include <Eigen/Core>
 #include <Eigen/Dense>
 #include <Eigen/Geometry>
 #include <RobotRaconteurCompanion/Converters/EigenConverters.h>
-#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
 namespace asdk {
     using namespace artec::sdk::base;
     using namespace artec::sdk::capturing;
@@ -27,177 +37,684 @@ namespace rr_geom = com::robotraconteur::geometry;
 namespace rr_shapes = com::robotraconteur::geometry::shapes;
 namespace rr_image = com::robotraconteur::image;
 namespace RR=RobotRaconteur;
+namespace rr_artec = experimental::artec_scanner;
 
 namespace artec_scanner_robotraconteur_driver
 {
+    static_assert(sizeof(asdk::Point3F) == 3 * sizeof(float), "Unexpected Point3F layout");
+    static_assert(sizeof(asdk::IndexTriplet) == 3 * sizeof(int32_t), "Unexpected IndexTriplet layout");
+
+    bool operator==(const MeshConvertOptions& a, const MeshConvertOptions& b)
+    {
+        return a.texture_encoding == b.texture_encoding && a.jpeg_quality == b.jpeg_quality
+            && a.include_normals == b.include_normals && a.include_textures == b.include_textures
+            && a.include_uvs == b.include_uvs && a.vertex_stride == b.vertex_stride && a.units == b.units;
+    }
+
+    bool operator!=(const MeshConvertOptions& a, const MeshConvertOptions& b)
+    {
+        return !(a == b);
+    }
+
+    MeshConvertOptions ApplyMeshExportOptions(const MeshConvertOptions& base, 
+        const rr_artec::MeshExportOptionsPtr& export_options)
+    {
+        RR_NULL_CHECK(export_options);
+        if (export_options->units != rr_artec::MeshUnits::millimeters 
+            && export_options->units != rr_artec::MeshUnits::meters)
+        {
+            RR_ARTEC_LOG_ERROR("Invalid mesh export units: " << (int32_t)export_options->units);
+            throw RR::InvalidArgumentException("Invalid mesh export units");
+        }
+        if (export_options->texture_encoding < rr_artec::TextureEncoding::png 
+            || export_options->texture_encoding > rr_artec::TextureEncoding::none)
+        {
+            RR_ARTEC_LOG_ERROR("Invalid mesh export texture encoding: " << (int32_t)export_options->texture_encoding);
+            throw RR::InvalidArgumentException("Invalid mesh export texture encoding");
+        }
+        if (export_options->jpeg_quality < 0 || export_options->jpeg_quality > 100)
+        {
+            RR_ARTEC_LOG_ERROR("Invalid mesh export jpeg quality: " << export_options->jpeg_quality);
+            throw RR::InvalidArgumentException("Mesh export jpeg quality must be between 0 and 100");
+        }
+
+        MeshConvertOptions ret = base;
+        ret.include_normals = export_options->include_normals.value != 0;
+        ret.include_textures = export_options->include_textures.value != 0;
+        ret.include_uvs = export_options->include_uvs.value != 0;
+        // Zero is treated as one so a default constructed structure keeps every vertex
+        ret.vertex_stride = (std::max)(export_options->vertex_stride, 1u);
+        ret.units = export_options->units;
+        ret.texture_encoding = export_options->texture_encoding;
+        // Zero keeps the driver wide texture_jpeg_quality
+        if (export_options->jpeg_quality != 0)
+        {
+            ret.jpeg_quality = export_options->jpeg_quality;
+        }
+        return ret;
+    }
+
     template<typename T>
-    static RR::RRNamedArrayPtr<typename T> points3f_to_rr(asdk::TArrayPoint3F& points)
+    static bool try_rr_scalar(const RR::RRValuePtr& v, double& value)
     {
-        size_t points_count = static_cast<size_t>(points.size());
-        auto rr_points = RR::AllocateEmptyRRNamedArray<T>(points_count);
-        for (size_t i=0; i<points_count; i++)
+        auto a = RR_DYNAMIC_POINTER_CAST<RR::RRArray<T> >(v);
+        if (!a || a->size() != 1)
+        {
+            return false;
+        }
+        value = static_cast<double>((*a)[0]);
+        return true;
+    }
+
+    bool TryGetExtendedNumber(const RR::RRMapPtr<std::string,RR::RRValue>& extended,
+        const std::string& key, double& value)
+    {
+        if (!extended)
+        {
+            return false;
+        }
+        auto e = extended->find(key);
+        if (e == extended->end() || !e->second)
+        {
+            return false;
+        }
+        const RR::RRValuePtr& v = e->second;
+        if (try_rr_scalar<double>(v, value) || try_rr_scalar<float>(v, value)
+            || try_rr_scalar<int32_t>(v, value) || try_rr_scalar<uint32_t>(v, value)
+            || try_rr_scalar<int64_t>(v, value) || try_rr_scalar<uint64_t>(v, value)
+            || try_rr_scalar<int16_t>(v, value) || try_rr_scalar<uint16_t>(v, value)
+            || try_rr_scalar<int8_t>(v, value) || try_rr_scalar<uint8_t>(v, value))
+        {
+            return true;
+        }
+        RR_ARTEC_LOG_ERROR("Extended setting " << key << " must be a numeric scalar");
+        throw RR::InvalidArgumentException("Extended setting " + key + " must be a numeric scalar");
+    }
+
+    uint32_t GetExtendedThreadsCount(const RR::RRMapPtr<std::string,RR::RRValue>& extended)
+    {
+        double v;
+        if (!TryGetExtendedNumber(extended, "threads_count", v))
+        {
+            return 0;
+        }
+        if (!(v >= 0.0) || v > 1024.0 || v != std::floor(v))
         {
-            auto& p = points[i];
-            auto& rr_p = rr_points->at(i);
-            rr_p.s.x = p.x;
-            rr_p.s.y = p.y;
-            rr_p.s.z = p.z;            
+            RR_ARTEC_LOG_ERROR("Invalid threads_count: " << v);
+            throw RR::InvalidArgumentException("threads_count must be an integer between 0 and 1024");
         }
-        return rr_points;
+        return static_cast<uint32_t>(v);
+    }
+
+    static bool mesh_textures_requested(const MeshConvertOptions& options)
+    {
+        return options.texture_encoding != rr_artec::TextureEncoding::none
+            && (options.include_textures || options.include_uvs) && options.vertex_stride <= 1;
     }
 
-    static RR::RRNamedArrayPtr<rr_shapes::MeshTriangle> index_array_triangles_to_rr(asdk::TArrayIndexTriplet& ind_trip)
+    struct MeshTextureSource
+    {
+        asdk::IImage* image;
+        asdk::IArrayUVCoordinates* uv;
+    };
+
+    // Texture image and UV coordinates read out of the SDK objects on the calling thread.
+    // The conversion tasks on the worker pool only read the memory these point to.
+    struct MeshTextureData
     {
-        size_t count = static_cast<size_t>(ind_trip.size());
-        auto rr_tri = RR::AllocateEmptyRRNamedArray<rr_shapes::MeshTriangle>(count);
-        for (size_t i=0; i<count; i++)
+        // Only used on the calling thread, for the SDK PNG encoder
+        asdk::IImage* image = nullptr;
+        size_t width = 0;
+        size_t height = 0;
+        size_t pitch = 0;
+        asdk::PixelFormat pixel_format = asdk::PixelFormat_Mono;
+        const uint8_t* pixels = nullptr;
+        // Encoded by the SDK for TextureEncoding::png
+        RR::RRArrayPtr<uint8_t> png;
+        const float* uvs = nullptr;
+        size_t uv_count = 0;
+    };
+
+    static MeshTextureData read_mesh_texture(const MeshTextureSource& src, const MeshConvertOptions& options)
+    {
+        MeshTextureData ret;
+        if (options.include_textures)
+        {
+            asdk::IImage* img = src.image;
+            ret.width = static_cast<size_t>(img->getWidth());
+            ret.height = static_cast<size_t>(img->getHeight());
+            ret.pitch = static_cast<size_t>(img->getPitch());
+            ret.pixel_format = img->getPixelFormat();
+            ret.pixels = static_cast<const uint8_t*>(img->getPointer());
+            ret.image = img;
+        }
+        if (options.include_uvs)
         {
-            auto& t = ind_trip[i];
-            auto& rr_t = rr_tri->at(i);
-            rr_t.s.v1 = t.x;
-            rr_t.s.v2 = t.y;
-            rr_t.s.v3 = t.z;            
+            ret.uv_count = static_cast<size_t>(src.uv->getSize());
+            auto uv_coords = src.uv->getPointer();
+            static_assert(sizeof(*uv_coords) == 2 * sizeof(float), "Unexpected UV coordinates layout");
+            ret.uvs = ret.uv_count > 0 ? &uv_coords[0].u : nullptr;
         }
-        return rr_tri;
+        return ret;
     }
 
-    static rr_image::CompressedImagePtr convert_texture(asdk::IImage* img)
+    // Must run on the calling thread since it calls into the SDK
+    static void encode_png_texture(MeshTextureData& data)
     {
         TRef<asdk::IBlob> img_blob;
-        auto ec = artec::sdk::base::io::savePngImageToBlob(&img_blob, img);
+        auto ec = artec::sdk::base::io::savePngImageToBlob(&img_blob, data.image);
         if (ec != asdk::ErrorCode::ErrorCode_OK)
         {
             throw RR::OperationFailedException("Could not convert image to PNG");
         }
-
-        auto compressed_image_bytes = RR::AttachRRArrayCopy<uint8_t>(static_cast<uint8_t*>(img_blob->getPointer()), 
+        data.png = RR::AttachRRArrayCopy<uint8_t>(static_cast<uint8_t*>(img_blob->getPointer()), 
             img_blob->getSize());
+    }
 
-        auto compressed_image_info = rr_image::ImageInfoPtr(new rr_image::ImageInfo());
-        compressed_image_info->height = img->getHeight();
-        compressed_image_info->width = img->getWidth();
-        compressed_image_info->step = img->getPitch();
-        compressed_image_info->encoding = rr_image::ImageEncoding::compressed;
+    // Copy an Artec image into tightly packed 8-bit RGB
+    static void image_to_rgb8(const MeshTextureData& img, uint8_t* rgb)
+    {
+        size_t width = img.width;
+        size_t height = img.height;
+        size_t pitch = img.pitch;
+        const uint8_t* src = img.pixels;
 
-        auto image = rr_image::CompressedImagePtr(new rr_image::CompressedImage());
-        image->data = compressed_image_bytes;
-        image->image_info = compressed_image_info;
+        size_t bpp;
+        size_t r_off;
+        size_t g_off;
+        size_t b_off;
+        switch (img.pixel_format)
+        {
+            case asdk::PixelFormat_Mono:
+                bpp = 1; r_off = 0; g_off = 0; b_off = 0;
+                break;
+            case asdk::PixelFormat_BGR:
+                bpp = 3; r_off = 2; g_off = 1; b_off = 0;
+                break;
+            case asdk::PixelFormat_BGRX:
+                bpp = 4; r_off = 2; g_off = 1; b_off = 0;
+                break;
+            case asdk::PixelFormat_RGB:
+                bpp = 3; r_off = 0; g_off = 1; b_off = 2;
+                break;
+            case asdk::PixelFormat_RGBX:
+                bpp = 4; r_off = 0; g_off = 1; b_off = 2;
+                break;
+            default:
+                RR_ARTEC_LOG_ERROR("Unsupported texture pixel format: " << (int)img.pixel_format);
+                throw RR::OperationFailedException("Unsupported texture pixel format");
+        }
 
-        return image;
+        for (size_t y = 0; y < height; y++)
+        {
+            const uint8_t* s = src + y * pitch;
+            uint8_t* d = rgb + y * width * 3;
+            for (size_t x = 0; x < width; x++)
+            {
+                d[0] = s[r_off];
+                d[1] = s[g_off];
+                d[2] = s[b_off];
+                s += bpp;
+                d += 3;
+            }
+        }
     }
 
-    RR::RRNamedArrayPtr<rr_geom::Vector2> convert_uv_coords(asdk::IArrayUVCoordinates* uv)
+    static RR::RRArrayPtr<uint8_t> encode_texture(const MeshTextureData& img, const MeshConvertOptions& options)
     {
-        auto rr_uv = RR::AllocateEmptyRRNamedArray<rr_geom::Vector2>((size_t)uv->getSize());
-        auto uv_coords = uv->getPointer();
-        for (size_t i=0; i<rr_uv->size(); i++)
+        size_t width = img.width;
+        size_t height = img.height;
+
+        if (options.texture_encoding == rr_artec::TextureEncoding::raw)
         {
-            auto& rr_p = rr_uv->at(i);
-            auto& p = uv_coords[i];
-            rr_p.s.x = p.u;
-            rr_p.s.y = p.v;
+            auto rgb = RR::AllocateRRArray<uint8_t>(width * height * 3);
+            image_to_rgb8(img, rgb->data());
+            return rgb;
         }
 
-        return rr_uv;
+        if (options.texture_encoding == rr_artec::TextureEncoding::png)
+        {
+            return img.png;
+        }
+
+        std::vector<uint8_t> rgb(width * height * 3);
+        image_to_rgb8(img, rgb.data());
+        std::vector<uint8_t> encoded;
+        switch (options.texture_encoding)
+        {
+            case rr_artec::TextureEncoding::png_fast:
+                EncodePngFast(rgb.data(), width, height, encoded);
+                break;
+            case rr_artec::TextureEncoding::jpeg:
+                EncodeJpeg(rgb.data(), width, height, options.jpeg_quality, encoded);
+                break;
+            default:
+                throw RR::InvalidArgumentException("Invalid texture encoding");
+        }
+        return RR::AttachRRArrayCopy<uint8_t>(encoded.data(), encoded.size());
     }
 
-    static RR::RRListPtr<rr_shapes::MeshTexture> get_frame_mesh_texture_map(asdk::IFrameMesh* mesh)
+    static rr_image::CompressedImagePtr convert_texture(const MeshTextureData& img, const MeshConvertOptions& options)
     {
-        asdk::IImage* img = mesh->getImage();
-        asdk::IArrayUVCoordinates* uv = mesh->getUVCoordinates();
-        if (img == nullptr || uv == nullptr)
+        auto compressed_image_bytes = encode_texture(img, options);
+
+        auto compressed_image_info = rr_image::ImageInfoPtr(new rr_image::ImageInfo());
+        compressed_image_info->height = static_cast<uint32_t>(img.height);
+        compressed_image_info->width = static_cast<uint32_t>(img.width);
+        if (options.texture_encoding == rr_artec::TextureEncoding::raw)
         {
-            return nullptr;
+            compressed_image_info->step = static_cast<uint32_t>(img.width * 3);
+            compressed_image_info->encoding = rr_image::ImageEncoding::rgb888;
+        }
+        else
+        {
+            compressed_image_info->step = static_cast<uint32_t>(img.pitch);
+            compressed_image_info->encoding = rr_image::ImageEncoding::compressed;
         }
-        
-        auto image = convert_texture(img);
-        auto rr_uv = convert_uv_coords(uv);        
 
+        auto image = rr_image::CompressedImagePtr(new rr_image::CompressedImage());
+        image->data = compressed_image_bytes;
+        image->image_info = compressed_image_info;
+
+        return image;
+    }
+
+    static rr_shapes::MeshTexturePtr convert_mesh_texture(const MeshTextureData& src, const MeshConvertOptions& options)
+    {
         auto rr_tex = rr_shapes::MeshTexturePtr(new rr_shapes::MeshTexture());
-        rr_tex->image = image;
-        rr_tex->uvs = rr_uv;
+        if (options.include_textures)
+        {
+            rr_tex->image = convert_texture(src, options);
+        }
+        if (options.include_uvs)
+        {
+            rr_tex->uvs = ConvertPackedArrayToRR<rr_geom::Vector2>(src.uvs, src.uv_count);
+        }
+        else
+        {
+            rr_tex->uvs = RR::AllocateEmptyRRNamedArray<rr_geom::Vector2>(0);
+        }
+        return rr_tex;
+    }
 
+    static RR::RRListPtr<rr_shapes::MeshTexture> textures_to_rr_list(const std::vector<rr_shapes::MeshTexturePtr>& textures)
+    {
         auto ret = RR::AllocateEmptyRRList<rr_shapes::MeshTexture>();
-        ret->push_back(rr_tex);
+        for (auto& t : textures)
+        {
+            ret->push_back(t);
+        }
         return ret;
     }
 
-    static void fill_untextured_mesh(const rr_shapes::MeshPtr& ret, artec::sdk::base::IMesh* mesh)
+    // Meshes with fewer vertices than this are converted serially on the calling thread
+    static const size_t PARALLEL_MESH_THRESHOLD = 100000;
+
+    static void fill_mesh(const rr_shapes::MeshPtr& ret, artec::sdk::base::IMesh* mesh,
+        const std::vector<MeshTextureSource>& textures, std::vector<rr_shapes::MeshTexturePtr>& rr_textures,
+        const MeshConvertOptions& options)
     {   
+        const size_t stride = (std::max)(options.vertex_stride, 1u);
+        // Artec meshes are in millimeters
+        const double scale = options.units == rr_artec::MeshUnits::meters ? 0.001 : 1.0;
+
+        // All Artec SDK calls, including the array size and pointer accessors, are made here on
+        // the calling thread. The tasks only read the plain memory behind the returned pointers,
+        // which stays valid while the mesh is alive.
         asdk::TArrayPoint3F points = mesh->getPoints();
-        ret->vertices = points3f_to_rr<rr_geom::Point>(points);
-        asdk::TArrayIndexTriplet triangles = mesh->getTriangles();
-        ret->triangles = index_array_triangles_to_rr(triangles);
-        mesh->calculate( asdk::CM_Normals );
-        asdk::TArrayPoint3F points_normals  = mesh->getPointsNormals();
-        ret->normals = points3f_to_rr<rr_geom::Vector3>(points_normals);
+        const size_t points_count = static_cast<size_t>(points.size());
+        const float* points_p = points_count > 0 ? &points[0].x : nullptr;
+        asdk::TArrayIndexTriplet triangles;
+        size_t triangles_count = 0;
+        const int32_t* triangles_p = nullptr;
+        if (stride == 1)
+        {
+            triangles = mesh->getTriangles();
+            triangles_count = static_cast<size_t>(triangles.size());
+            triangles_p = triangles_count > 0 ? reinterpret_cast<const int32_t*>(&triangles[0].x) : nullptr;
+        }
+        asdk::TArrayPoint3F points_normals;
+        const float* normals_p = nullptr;
+        size_t normals_count = 0;
+        if (options.include_normals)
+        {
+            mesh->calculate( asdk::CM_Normals );
+            points_normals = mesh->getPointsNormals();
+            normals_count = static_cast<size_t>(points_normals.size());
+            normals_p = normals_count > 0 ? &points_normals[0].x : nullptr;
+        }
+        std::vector<MeshTextureData> texture_data;
+        for (auto& t : textures)
+        {
+            texture_data.push_back(read_mesh_texture(t, options));
+        }
         ret->colors = RR::AllocateEmptyRRNamedArray<com::robotraconteur::color::ColorRGB>(0);
+
+        rr_textures.resize(textures.size());
+
+        std::vector<boost::function<void()> > tasks;
+        tasks.push_back([&ret, points_p, points_count, stride, scale]() 
+        {
+            ret->vertices = ConvertStridedArrayToRR<rr_geom::Point>(points_p, points_count, stride, scale);
+        });
+        if (stride == 1)
+        {
+            tasks.push_back([&ret, triangles_p, triangles_count]()
+            {
+                ret->triangles = ConvertPackedArrayToRR<rr_shapes::MeshTriangle>(triangles_p, triangles_count);
+            });
+        }
+        else
+        {
+            ret->triangles = RR::AllocateEmptyRRNamedArray<rr_shapes::MeshTriangle>(0);
+        }
+        if (options.include_normals)
+        {
+            tasks.push_back([&ret, normals_p, normals_count, stride]() 
+            {
+                ret->normals = ConvertStridedArrayToRR<rr_geom::Vector3>(normals_p, normals_count, stride, 1.0);
+            });
+        }
+        else
+        {
+            ret->normals = RR::AllocateEmptyRRNamedArray<rr_geom::Vector3>(0);
+        }
+        // The SDK PNG encoder has to run on the calling thread, it runs while the pool converts
+        // the geometry and the other textures
+        const bool sdk_png = options.include_textures && options.texture_encoding == rr_artec::TextureEncoding::png;
+        auto caller_task = [&texture_data, &rr_textures, &options, sdk_png]()
+        {
+            if (!sdk_png)
+            {
+                return;
+            }
+            for (size_t i=0; i<texture_data.size(); i++)
+            {
+                encode_png_texture(texture_data[i]);
+                rr_textures[i] = convert_mesh_texture(texture_data[i], options);
+            }
+        };
+        if (!sdk_png)
+        {
+            for (size_t i=0; i<texture_data.size(); i++)
+            {
+                tasks.push_back([&texture_data, &rr_textures, &options, i]() 
+                {
+                    rr_textures[i] = convert_mesh_texture(texture_data[i], options); 
+                });
+            }
+        }
+
+        if (points_count < PARALLEL_MESH_THRESHOLD)
+        {
+            caller_task();
+            for (auto& t : tasks)
+            {
+                t();
+            }
+            return;
+        }
+
+        // Textures are encoded concurrently with the geometry, large geometry arrays
+        // are further split into chunks by the conversion kernels
+        GetWorkerPool()->parallel_invoke(tasks, caller_task);
     }
 
-    
+    com::robotraconteur::geometry::shapes::MeshPtr ConvertArtecFrameMeshToRR(artec::sdk::base::IFrameMesh* mesh, 
+        const MeshConvertOptions& options)
+    {
+        auto ret = rr_shapes::MeshPtr(new rr_shapes::Mesh());
+
+        std::vector<MeshTextureSource> textures;
+        if (mesh_textures_requested(options))
+        {
+            asdk::IImage* img = mesh->getImage();
+            asdk::IArrayUVCoordinates* uv = mesh->getUVCoordinates();
+            if (img != nullptr && uv != nullptr)
+            {
+                MeshTextureSource t = { img, uv };
+                textures.push_back(t);
+            }
+        }
+
+        std::vector<rr_shapes::MeshTexturePtr> rr_textures;
+        fill_mesh(ret, mesh, textures, rr_textures, options);
 
-    com::robotraconteur::geometry::shapes::MeshPtr ConvertArtecFrameMeshToRR(artec::sdk::base::IFrameMesh* mesh)
+        if (!rr_textures.empty())
+        {
+            ret->textures = textures_to_rr_list(rr_textures);
+        }
+
+        return ret;
+    }
+
+    com::robotraconteur::geometry::shapes::MeshPtr ConvertArtecCompositeMeshToRR(artec::sdk::base::ICompositeMesh* mesh,
+        const MeshConvertOptions& options)
     {
         auto ret = rr_shapes::MeshPtr(new rr_shapes::Mesh());
-        
-        fill_untextured_mesh(ret, mesh);
 
-        ret->textures = get_frame_mesh_texture_map(mesh);
+        std::vector<MeshTextureSource> textures;
+        if (mesh_textures_requested(options))
+        {
+            auto c = mesh->getTexturesCount();
+            for (int i=0; i<c; i++)
+            {
+                auto tex = mesh->getTexture(i);
+                MeshTextureSource t = { tex->getImage(), tex->getUVCoordinates() };
+                textures.push_back(t);
+            }
+        }
+
+        std::vector<rr_shapes::MeshTexturePtr> rr_textures;
+        fill_mesh(ret, mesh, textures, rr_textures, options);
+
+        ret->textures = textures_to_rr_list(rr_textures);
 
         return ret;
     }
 
-    static RR::RRListPtr<rr_shapes::MeshTexture> get_composite_mesh_texture_map(asdk::ICompositeMesh* mesh)
+    // Binary STL layout: 80 byte header, uint32 facet count, then per facet the
+    // normal and three vertices (12 little-endian floats) and a uint16 attribute
+    static const size_t STL_HEADER_SIZE = 80;
+    static const size_t STL_FACET_SIZE = 50;
+    // Facets are processed in blocks so the normal computation runs over
+    // contiguous buffers the compiler can vectorize
+    static const size_t STL_FACET_BLOCK = 256;
+
+    RobotRaconteur::RRArrayPtr<uint8_t> ConvertArtecMeshToStlBytes(artec::sdk::base::IMesh* mesh)
+    {
+        asdk::TArrayPoint3F points = mesh->getPoints();
+        asdk::TArrayIndexTriplet triangles = mesh->getTriangles();
+        size_t points_count = static_cast<size_t>(points.size());
+        size_t triangle_count = static_cast<size_t>(triangles.size());
+        return ConvertTrianglesToStlBytes(points_count > 0 ? &points[0].x : nullptr, points_count,
+            triangle_count > 0 ? reinterpret_cast<const int32_t*>(&triangles[0].x) : nullptr, triangle_count);
+    }
+
+    RobotRaconteur::RRArrayPtr<uint8_t> ConvertTrianglesToStlBytes(const float* points, size_t points_count,
+        const int32_t* triangles, size_t triangle_count)
     {
-        auto c = mesh->getTexturesCount();
-        auto ret = RR::AllocateEmptyRRList<rr_shapes::MeshTexture>();
-        for (int i=0; i<c; i++)
+        if (triangle_count > std::numeric_limits<uint32_t>::max())
+        {
+            RR_ARTEC_LOG_ERROR("Mesh has too many triangles for stl: " << triangle_count);
+            throw RR::OperationFailedException("Mesh has too many triangles for stl");
+        }
+
+        auto ret = RR::AllocateRRArray<uint8_t>(STL_HEADER_SIZE + 4 + STL_FACET_SIZE * triangle_count);
+        uint8_t* out = ret->data();
+        memset(out, 0, STL_HEADER_SIZE);
+        const char stl_header[] = "artec_scanner_robotraconteur_driver binary stl";
+        memcpy(out, stl_header, sizeof(stl_header) - 1);
+        uint32_t stl_triangle_count = static_cast<uint32_t>(triangle_count);
+        memcpy(out + STL_HEADER_SIZE, &stl_triangle_count, 4);
+        out += STL_HEADER_SIZE + 4;
+
+        if (triangle_count == 0)
         {
-            auto tex = mesh->getTexture(i);
-            auto img = convert_texture(tex->getImage());
-            auto uv = convert_uv_coords(tex->getUVCoordinates());
-            auto m = rr_shapes::MeshTexturePtr(new rr_shapes::MeshTexture());
-            m->image = img;
-            m->uvs = uv;
-            ret->push_back(m);
+            return ret;
+        }
+
+        const asdk::Point3F* p = reinterpret_cast<const asdk::Point3F*>(points);
+        const asdk::IndexTriplet* t = reinterpret_cast<const asdk::IndexTriplet*>(triangles);
+
+        float v[9][STL_FACET_BLOCK];
+        float n[3][STL_FACET_BLOCK];
+
+        for (size_t block_begin = 0; block_begin < triangle_count; block_begin += STL_FACET_BLOCK)
+        {
+            size_t block_size = (std::min)(STL_FACET_BLOCK, triangle_count - block_begin);
+
+            // Gather facet vertices
+            for (size_t i = 0; i < block_size; i++)
+            {
+                const asdk::IndexTriplet& tri = t[block_begin + i];
+                if (static_cast<size_t>(tri.x) >= points_count || static_cast<size_t>(tri.y) >= points_count
+                    || static_cast<size_t>(tri.z) >= points_count)
+                {
+                    RR_ARTEC_LOG_ERROR("Invalid vertex index in mesh triangle " << (block_begin + i));
+                    throw RR::OperationFailedException("Invalid vertex index in mesh triangle");
+                }
+                const asdk::Point3F& a = p[tri.x];
+                const asdk::Point3F& b = p[tri.y];
+                const asdk::Point3F& c = p[tri.z];
+                v[0][i] = a.x; v[1][i] = a.y; v[2][i] = a.z;
+                v[3][i] = b.x; v[4][i] = b.y; v[5][i] = b.z;
+                v[6][i] = c.x; v[7][i] = c.y; v[8][i] = c.z;
+            }
+
+            // Face normals, branch free so the loop vectorizes
+            for (size_t i = 0; i < block_size; i++)
+            {
+                float e1x = v[3][i] - v[0][i];
+                float e1y = v[4][i] - v[1][i];
+                float e1z = v[5][i] - v[2][i];
+                float e2x = v[6][i] - v[0][i];
+                float e2y = v[7][i] - v[1][i];
+                float e2z = v[8][i] - v[2][i];
+                float nx = e1y * e2z - e1z * e2y;
+                float ny = e1z * e2x - e1x * e2z;
+                float nz = e1x * e2y - e1y * e2x;
+                float len = std::sqrt(nx * nx + ny * ny + nz * nz);
+                float inv_len = len > 0.0f ? 1.0f / len : 0.0f;
+                n[0][i] = nx * inv_len;
+                n[1][i] = ny * inv_len;
+                n[2][i] = nz * inv_len;
+            }
+
+            // Write facet records
+            for (size_t i = 0; i < block_size; i++)
+            {
+                float facet[12] = {
+                    n[0][i], n[1][i], n[2][i],
+                    v[0][i], v[1][i], v[2][i],
+                    v[3][i], v[4][i], v[5][i],
+                    v[6][i], v[7][i], v[8][i]
+                };
+                memcpy(out, facet, sizeof(facet));
+                out[48] = 0;
+                out[49] = 0;
+                out += STL_FACET_SIZE;
+            }
         }
 
         return ret;
     }
 
-    com::robotraconteur::geometry::shapes::MeshPtr ConvertArtecCompositeMeshToRR(artec::sdk::base::ICompositeMesh* mesh)
+    RobotRaconteur::RRArrayPtr<uint8_t> ConvertArtecMeshToCompactBytes(artec::sdk::base::IMesh* mesh,
+        const MeshConvertOptions& options, bool deflate)
     {
-        auto ret = rr_shapes::MeshPtr(new rr_shapes::Mesh());
-        
-        fill_untextured_mesh(ret, mesh);
+        // Artec meshes are in millimeters
+        const double scale = options.units == rr_artec::MeshUnits::meters ? 0.001 : 1.0;
 
-        ret->textures = get_composite_mesh_texture_map(mesh);
+        asdk::TArrayPoint3F points = mesh->getPoints();
+        asdk::TArrayIndexTriplet triangles = mesh->getTriangles();
+        asdk::TArrayPoint3F points_normals;
+        if (options.include_normals)
+        {
+            mesh->calculate( asdk::CM_Normals );
+            points_normals = mesh->getPointsNormals();
+        }
+        size_t points_count = static_cast<size_t>(points.size());
+        size_t triangle_count = static_cast<size_t>(triangles.size());
+
+        std::vector<uint8_t> out;
+        try
+        {
+            EncodeCompactMesh(points_count > 0 ? &points[0].x : nullptr, points_count,
+                options.include_normals && points_count > 0 ? &points_normals[0].x : nullptr,
+                triangle_count > 0 ? reinterpret_cast<const int32_t*>(&triangles[0].x) : nullptr, triangle_count,
+                scale, deflate, out);
+        }
+        catch (std::invalid_argument& e)
+        {
+            RR_ARTEC_LOG_ERROR("Error encoding compact mesh: " << e.what());
+            throw RR::OperationFailedException(e.what());
+        }
+        return RR::AttachRRArrayCopy(out.data(), out.size());
+    }
 
+    static uint64_t mesh_bytes(asdk::IMesh* mesh)
+    {
+        uint64_t ret = 0;
+        asdk::IArrayPoint3F* points = mesh->getPoints();
+        asdk::IArrayIndexTriplet* triangles = mesh->getTriangles();
+        if (points)
+        {
+            ret += static_cast<uint64_t>(points->getSize()) * sizeof(asdk::Point3F);
+        }
+        if (triangles)
+        {
+            ret += static_cast<uint64_t>(triangles->getSize()) * sizeof(asdk::IndexTriplet);
+        }
         return ret;
     }
 
-    RobotRaconteur::RRArrayPtr<uint8_t> ConvertArtecMeshToStlBytes(artec::sdk::base::IMesh* mesh)
+    uint64_t EstimateModelBytes(asdk::IModel* model)
     {
-        boost::filesystem::path temp = boost::filesystem::unique_path();
-        RR_CALL_ARTEC(asdk::io::saveStlMeshToFileBinary(temp.c_str(), mesh), "Could not save mesh to stl");
-        std::ifstream file(temp.string(), std::ios::binary | std::ios::ate);
-        std::streamsize size = file.tellg();
-        file.seekg(0, std::ios::beg);
-        auto ret = RR::AllocateRRArray<uint8_t>(size);
-        if (!file.read((char*)ret->data(), size))
-        {
-            RR_ARTEC_LOG_ERROR("Could not read temporary mesh stl file: " << temp);
-            throw RR::OperationFailedException("Could not read temporary mesh stl file");
-        }
-        file.close();
-        boost::system::error_code ec;
-        boost::filesystem::remove(temp, ec);
+        uint64_t ret = 0;
+        for (int i = 0; i < model->getSize(); i++)
+        {
+            asdk::IScan* scan = model->getElement(i);
+            if (!scan) continue;
+            for (int j = 0; j < scan->getSize(); j++)
+            {
+                asdk::IFrameMesh* frame_mesh = scan->getElement(j);
+                if (!frame_mesh) continue;
+                ret += mesh_bytes(frame_mesh);
+                asdk::IArrayUVCoordinates* uvs = frame_mesh->getUVCoordinates();
+                if (uvs)
+                {
+                    ret += static_cast<uint64_t>(uvs->getSize()) * sizeof(asdk::UVCoordinates);
+                }
+                asdk::IImage* img = frame_mesh->getImage();
+                if (img)
+                {
+                    ret += static_cast<uint64_t>(img->getPitch()) * static_cast<uint64_t>(img->getHeight());
+                }
+            }
+        }
+
+        asdk::ICompositeContainer* container = model->getCompositeContainer();
+        if (container)
+        {
+            for (int i = 0; i < container->getSize(); i++)
+            {
+                asdk::ICompositeMesh* mesh = container->getElement(i);
+                if (!mesh) continue;
+                ret += mesh_bytes(mesh);
+            }
+        }
         return ret;
-    }   
+    }
 
     com::robotraconteur::geometry::Transform ConvertArtecTransformToRR(const artec::sdk::base::Matrix4x4D& transform)
     {
-        Eigen::Matrix4d e_mat = Eigen::Map<const Eigen::Matrix4d>(transform.getData(), 4, 4);
+        return ConvertArtecTransformToRR(transform.getData());
+    }
+
+    com::robotraconteur::geometry::Transform ConvertArtecTransformToRR(const double* transform_data)
+    {
+        Eigen::Matrix4d e_mat = Eigen::Map<const Eigen::Matrix4d>(transform_data, 4, 4);
         // Convert mm to m
         e_mat(0,3) *= 0.001;
         e_mat(1,3) *= 0.001;
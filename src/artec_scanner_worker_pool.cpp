@@ -0,0 +1,331 @@
+#include "artec_scanner_worker_pool.h"
+#include "artec_scanner_thread_budget.h"
+
+#include <boost/atomic.hpp>
+#include <boost/make_shared.hpp>
+#include <algorithm>
+#include <exception>
+
+namespace artec_scanner_robotraconteur_driver
+{
+    WorkerPool::WorkerPool(size_t thread_count, const std::vector<uint32_t>& cpus)
+    {
+        this->thread_count = thread_count;
+        for (size_t i = 0; i < thread_count; i++)
+        {
+            threads.create_thread([this, cpus]()
+            {
+                SetCurrentThreadAffinity(cpus);
+                worker_thread();
+            });
+        }
+    }
+
+    size_t WorkerPool::get_thread_count() const
+    {
+        return thread_count;
+    }
+
+    void WorkerPool::set_error_handler(boost::function<void(const std::string&)> handler)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        error_handler = handler;
+    }
+
+    void WorkerPool::worker_thread()
+    {
+        while (true)
+        {
+            boost::function<void()> fn;
+            {
+                boost::mutex::scoped_lock lock(this_lock);
+                while (work.empty() && ready_queues.empty() && !stopped)
+                {
+                    work_cv.wait(lock);
+                }
+                if (!work.empty())
+                {
+                    fn.swap(work.front());
+                    work.pop_front();
+                }
+                else if (!ready_queues.empty())
+                {
+                    WorkerQueuePtr q = ready_queues.front();
+                    ready_queues.pop_front();
+                    fn.swap(q->pending.front());
+                    q->pending.pop_front();
+                    if (!q->pending.empty())
+                    {
+                        ready_queues.push_back(q);
+                    }
+                    else
+                    {
+                        q->scheduled = false;
+                    }
+                }
+                else
+                {
+                    return;
+                }
+            }
+
+            try
+            {
+                fn();
+            }
+            catch (std::exception& e)
+            {
+                boost::function<void(const std::string&)> handler;
+                {
+                    boost::mutex::scoped_lock lock(this_lock);
+                    handler = error_handler;
+                }
+                if (handler)
+                {
+                    handler(e.what());
+                }
+            }
+        }
+    }
+
+    void WorkerPool::post(boost::function<void()> fn)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        work.push_back(std::move(fn));
+        work_cv.notify_one();
+    }
+
+    WorkerQueuePtr WorkerPool::create_queue(size_t max_pending)
+    {
+        return boost::make_shared<WorkerQueue>(shared_from_this(), (std::max)(max_pending, (size_t)1));
+    }
+
+    WorkerQueue::WorkerQueue(boost::shared_ptr<WorkerPool> pool, size_t max_pending)
+    {
+        this->pool = pool;
+        this->max_pending = max_pending;
+    }
+
+    bool WorkerQueue::try_post(boost::function<void()> fn)
+    {
+        boost::mutex::scoped_lock lock(pool->this_lock);
+        if (pending.size() >= max_pending)
+        {
+            return false;
+        }
+        pending.push_back(std::move(fn));
+        if (!scheduled)
+        {
+            scheduled = true;
+            // The ready list holds a reference until the queue is drained
+            pool->ready_queues.push_back(shared_from_this());
+        }
+        pool->work_cv.notify_one();
+        return true;
+    }
+
+    size_t WorkerQueue::get_pending_count()
+    {
+        boost::mutex::scoped_lock lock(pool->this_lock);
+        return pending.size();
+    }
+
+    struct ParallelForState
+    {
+        boost::atomic<size_t> next_chunk;
+        size_t count = 0;
+        size_t chunk_size = 0;
+        size_t chunk_count = 0;
+        boost::function<void(size_t, size_t)> fn;
+
+        boost::mutex done_lock;
+        boost::condition_variable done_cv;
+        size_t done_chunks = 0;
+        std::exception_ptr error;
+
+        ParallelForState() : next_chunk(0) {}
+    };
+
+    static void parallel_for_run_chunks(const boost::shared_ptr<ParallelForState>& state)
+    {
+        while (true)
+        {
+            size_t c = state->next_chunk.fetch_add(1);
+            if (c >= state->chunk_count)
+            {
+                return;
+            }
+
+            size_t begin = c * state->chunk_size;
+            size_t end = (std::min)(state->count, begin + state->chunk_size);
+            std::exception_ptr err;
+            try
+            {
+                state->fn(begin, end);
+            }
+            catch (...)
+            {
+                err = std::current_exception();
+            }
+
+            boost::mutex::scoped_lock lock(state->done_lock);
+            if (err && !state->error)
+            {
+                state->error = err;
+            }
+            state->done_chunks++;
+            if (state->done_chunks == state->chunk_count)
+            {
+                state->done_cv.notify_all();
+            }
+        }
+    }
+
+    // Work on the remaining chunks on the calling thread and wait for the helpers to finish theirs
+    static void parallel_for_join(const boost::shared_ptr<ParallelForState>& state)
+    {
+        parallel_for_run_chunks(state);
+
+        boost::mutex::scoped_lock lock(state->done_lock);
+        while (state->done_chunks < state->chunk_count)
+        {
+            state->done_cv.wait(lock);
+        }
+    }
+
+    void WorkerPool::parallel_for(size_t count, size_t chunk_size, boost::function<void(size_t, size_t)> fn)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+        if (chunk_size == 0)
+        {
+            chunk_size = 1;
+        }
+        size_t chunk_count = (count + chunk_size - 1) / chunk_size;
+        if (chunk_count == 1 || thread_count == 0)
+        {
+            fn(0, count);
+            return;
+        }
+
+        auto state = boost::make_shared<ParallelForState>();
+        state->count = count;
+        state->chunk_size = chunk_size;
+        state->chunk_count = chunk_count;
+        state->fn = std::move(fn);
+
+        // Helpers that start after all chunks are claimed exit immediately
+        size_t helper_count = (std::min)(chunk_count - 1, thread_count);
+        for (size_t i = 0; i < helper_count; i++)
+        {
+            post([state]() { parallel_for_run_chunks(state); });
+        }
+
+        parallel_for_join(state);
+        if (state->error)
+        {
+            std::rethrow_exception(state->error);
+        }
+    }
+
+    void WorkerPool::parallel_invoke(const std::vector<boost::function<void()> >& tasks)
+    {
+        parallel_for(tasks.size(), 1, [&tasks](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                tasks[i]();
+            }
+        });
+    }
+
+    void WorkerPool::parallel_invoke(const std::vector<boost::function<void()> >& tasks,
+        const boost::function<void()>& caller_task)
+    {
+        if (tasks.empty() || thread_count == 0)
+        {
+            caller_task();
+            parallel_invoke(tasks);
+            return;
+        }
+
+        auto state = boost::make_shared<ParallelForState>();
+        state->count = tasks.size();
+        state->chunk_size = 1;
+        state->chunk_count = tasks.size();
+        state->fn = [&tasks](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                tasks[i]();
+            }
+        };
+
+        // The calling thread is busy with caller_task, so every task may get a helper
+        size_t helper_count = (std::min)(state->chunk_count, thread_count);
+        for (size_t i = 0; i < helper_count; i++)
+        {
+            post([state]() { parallel_for_run_chunks(state); });
+        }
+
+        std::exception_ptr caller_error;
+        try
+        {
+            caller_task();
+        }
+        catch (...)
+        {
+            caller_error = std::current_exception();
+        }
+
+        // The tasks may reference the caller's stack, always wait for them
+        parallel_for_join(state);
+        if (caller_error)
+        {
+            std::rethrow_exception(caller_error);
+        }
+        if (state->error)
+        {
+            std::rethrow_exception(state->error);
+        }
+    }
+
+    void WorkerPool::shutdown()
+    {
+        {
+            boost::mutex::scoped_lock lock(this_lock);
+            stopped = true;
+            work_cv.notify_all();
+        }
+        threads.join_all();
+    }
+
+    WorkerPool::~WorkerPool()
+    {
+        shutdown();
+    }
+
+    static boost::mutex worker_pool_lock;
+    static WorkerPoolPtr worker_pool;
+
+    WorkerPoolPtr InitWorkerPool(size_t thread_count, const std::vector<uint32_t>& cpus)
+    {
+        boost::mutex::scoped_lock lock(worker_pool_lock);
+        if (!worker_pool)
+        {
+            if (thread_count == 0)
+            {
+                thread_count = (std::max)(boost::thread::hardware_concurrency(), 1u);
+            }
+            worker_pool = boost::make_shared<WorkerPool>(thread_count, cpus);
+        }
+        return worker_pool;
+    }
+
+    WorkerPoolPtr GetWorkerPool()
+    {
+        return InitWorkerPool(0, std::vector<uint32_t>());
+    }
+}
@@ -7,6 +7,9 @@
 #include <artec/sdk/capturing/IFrameProcessor.h>
 #include <artec/sdk/capturing/IFrame.h>
 
+#include <algorithm>
+#include <limits>
+
 namespace asdk {
     using namespace artec::sdk::base;
     using namespace artec::sdk::capturing;
@@ -23,18 +26,250 @@ namespace rr_artec = experimental::artec_scanner;
 
 namespace artec_scanner_robotraconteur_driver
 {
+    DeferredCapturePrepareWorker::DeferredCapturePrepareWorker(boost::shared_ptr<ArtecScannerImpl> parent, 
+        std::vector<RRDeferredCapturePtr>&& input_data, bool mesh, bool stl)
+        : data_lock(parent->this_lock), next_input(0), completed_count(0), failed_count(0), 
+        cancel_requested(false), active_task_count(0), claim_limit(std::numeric_limits<size_t>::max())
+    {
+        this->frame_processors = parent->frame_processors;
+        this->deferred_cache = parent->deferred_cache;
+        this->spill_store = parent->spill_store;
+        this->mesh_options = parent->get_mesh_convert_options();
+        this->input_data = std::move(input_data);
+        this->mesh = mesh;
+        this->stl = stl;
+    }
+
+    bool DeferredCapturePrepareWorker::start(capture_handler_type capture_handler, boost::function<void()> done_handler)
+    {
+        // Captures are prepared on the shared worker pool, one task per pool thread. Workers
+        // claim captures with an atomic index so status polling on the generator lock does
+        // not contend with the workers.
+        auto pool = GetWorkerPool();
+        size_t task_count = (std::min)(pool->get_thread_count(), input_data.size());
+        if (task_count == 0)
+        {
+            return false;
+        }
+        this->capture_handler = capture_handler;
+        this->done_handler = done_handler;
+        work_queue = pool->create_queue(task_count);
+        auto this_ = shared_from_this();
+        active_task_count.store(task_count);
+        for (size_t i = 0; i < task_count; i++)
+        {
+            if (!work_queue->try_post([this_]() { this_->prepare_next(); }))
+            {
+                prepare_task_done();
+            }
+        }
+        return true;
+    }
+
+    void DeferredCapturePrepareWorker::cancel()
+    {
+        cancel_requested.store(true, boost::memory_order_release);
+        // Parked tasks see the cancel and finish, so done_handler is still called
+        repost_parked_tasks();
+    }
+
+    void DeferredCapturePrepareWorker::set_claim_limit(size_t limit)
+    {
+        {
+            boost::mutex::scoped_lock lock(park_lock);
+            claim_limit.store(limit, boost::memory_order_release);
+        }
+        repost_parked_tasks();
+    }
+
+    void DeferredCapturePrepareWorker::repost_parked_tasks()
+    {
+        size_t n;
+        {
+            boost::mutex::scoped_lock lock(park_lock);
+            n = parked_task_count;
+            parked_task_count = 0;
+        }
+        auto this_ = shared_from_this();
+        for (size_t i = 0; i < n; i++)
+        {
+            // The queue holds one slot per task, so there is always room for a parked task
+            if (!work_queue->try_post([this_]() { this_->prepare_next(); }))
+            {
+                prepare_task_done();
+            }
+        }
+    }
+
+    bool DeferredCapturePrepareWorker::claim_input(size_t& index)
+    {
+        size_t i = next_input.load(boost::memory_order_relaxed);
+        while (true)
+        {
+            if (i >= input_data.size() || i >= claim_limit.load(boost::memory_order_acquire))
+            {
+                return false;
+            }
+            if (next_input.compare_exchange_weak(i, i + 1, boost::memory_order_relaxed))
+            {
+                index = i;
+                return true;
+            }
+        }
+    }
+
+    bool DeferredCapturePrepareWorker::park_task()
+    {
+        boost::mutex::scoped_lock lock(park_lock);
+        if (next_input.load(boost::memory_order_relaxed) < claim_limit.load(boost::memory_order_relaxed)
+            || cancel_requested.load(boost::memory_order_acquire))
+        {
+            return false;
+        }
+        parked_task_count++;
+        return true;
+    }
+
+    int32_t DeferredCapturePrepareWorker::get_completed_count()
+    {
+        return completed_count.load(boost::memory_order_relaxed);
+    }
+
+    int32_t DeferredCapturePrepareWorker::get_failed_count()
+    {
+        return failed_count.load(boost::memory_order_relaxed);
+    }
+
+    size_t DeferredCapturePrepareWorker::get_input_count()
+    {
+        return input_data.size();
+    }
+
+    void DeferredCapturePrepareWorker::prepare_next()
+    {
+        if (!cancel_requested.load(boost::memory_order_acquire))
+        {
+            size_t i;
+            if (claim_input(i))
+            {
+                rr_shapes::MeshPtr rr_mesh;
+                RR::RRArrayPtr<uint8_t> stl_bytes;
+                bool success = prepare_capture(input_data[i], rr_mesh, stl_bytes);
+                if (capture_handler)
+                {
+                    capture_handler(input_data[i], rr_mesh, stl_bytes, success);
+                }
+            }
+        }
+
+        // Post again instead of looping so the pool round robin interleaves other generators
+        if (!cancel_requested.load(boost::memory_order_acquire) 
+            && next_input.load(boost::memory_order_relaxed) < input_data.size())
+        {
+            if (park_task())
+            {
+                return;
+            }
+            auto this_ = shared_from_this();
+            if (work_queue->try_post([this_]() { this_->prepare_next(); }))
+            {
+                return;
+            }
+        }
+
+        prepare_task_done();
+    }
+
+    void DeferredCapturePrepareWorker::prepare_task_done()
+    {
+        if (active_task_count.fetch_sub(1, boost::memory_order_acq_rel) != 1)
+        {
+            return;
+        }
+
+        auto h = done_handler;
+        // Release the generator references held by the handlers
+        capture_handler.clear();
+        done_handler.clear();
+        if (h)
+        {
+            h();
+        }
+    }
+
+    bool DeferredCapturePrepareWorker::prepare_capture(const RRDeferredCapturePtr& work, 
+        rr_shapes::MeshPtr& rr_mesh, RR::RRArrayPtr<uint8_t>& stl_bytes)
+    {
+        {
+            boost::mutex::scoped_lock work_lock(data_lock);
+            bool mesh_cached = work->mesh && work->mesh_options == mesh_options;
+            if ((!mesh || mesh_cached) && (!stl || work->mesh_stl_bytes))
+            {
+                if (mesh)
+                {
+                    rr_mesh = work->mesh;
+                }
+                if (stl)
+                {
+                    stl_bytes = work->mesh_stl_bytes;
+                }
+                completed_count.fetch_add(1, boost::memory_order_relaxed);
+                return true;
+            }
+        }
+
+        try
+        {
+            asdk::TRef<asdk::IFrameMesh> frame_mesh;
+            DeferredCaptureToFrameMesh(work, data_lock, frame_processors.get(), spill_store.get(), &frame_mesh);
+            
+            if (mesh)
+            {
+                rr_mesh = ConvertArtecFrameMeshToRR(frame_mesh, mesh_options);
+            }
+
+            if (stl)
+            {
+                stl_bytes = ConvertArtecMeshToStlBytes(frame_mesh);
+            }
+
+            {
+                boost::mutex::scoped_lock work_lock(data_lock);
+                if (stl)
+                {
+                    deferred_cache->store_stl(work, stl_bytes);
+                }
+                if (mesh)
+                {
+                    deferred_cache->store_mesh(work, rr_mesh, mesh_options);
+                }
+            }
+            completed_count.fetch_add(1, boost::memory_order_relaxed);
+
+            RR_ARTEC_LOG_INFO("Completed preparing deferred capture handle " << work->handle);
+            return true;
+        }
+        catch (RR::RobotRaconteurException& exp)
+        {
+            RR_ARTEC_LOG_ERROR("Error preparing deferred frame handle " << work->handle << ": " << exp.what());
+            failed_count.fetch_add(1, boost::memory_order_relaxed);
+        }
+        catch (std::exception& exp)
+        {
+            RR_ARTEC_LOG_ERROR("Error preparing deferred frame handle " << work->handle << ": " << exp.what());
+            failed_count.fetch_add(1, boost::memory_order_relaxed);
+        }
+        return false;
+    }
+
     DeferredCapturePrepare::DeferredCapturePrepare(boost::shared_ptr<ArtecScannerImpl> parent)
-        : data_lock(parent->this_lock)
     {
-        this->scanner = parent->scanner;
         this->parent=parent;
     }
 
-    void DeferredCapturePrepare::Init(std::list<boost::shared_ptr<RRDeferredCapture> >&& input_data, bool mesh, bool stl)
+    void DeferredCapturePrepare::Init(std::vector<boost::shared_ptr<RRDeferredCapture> >&& input_data, bool mesh, bool stl)
     {
-        this->input_data = std::move(input_data);
-        this->mesh = mesh;
-        this->stl = stl;
+        worker = RR_MAKE_SHARED<DeferredCapturePrepareWorker>(GetParent(), std::move(input_data), mesh, stl);
     }
 
     boost::shared_ptr<ArtecScannerImpl> DeferredCapturePrepare::GetParent()
@@ -47,99 +282,14 @@ namespace artec_scanner_robotraconteur_driver
         return p;
     }
 
-    
-    void DeferredCapturePrepare::prepare()
+    void DeferredCapturePrepare::prepare_done()
     {
-        auto this_ = shared_from_this();
-        active_thread_count = boost::thread::hardware_concurrency();
-        for( unsigned i = 0; i < boost::thread::hardware_concurrency(); i++ )
+        boost::mutex::scoped_lock lock(this_lock);
+        prepare_completed = true;
+        auto h = take_next_handler();
+        if (h)
         {
-            thread_pool.create_thread( [this_]
-            {
-                // Initialize a frame processor 
-                TRef<asdk::IFrameProcessor> processor;
-                if( this_->scanner->createFrameProcessor( &processor ) != asdk::ErrorCode_OK )
-                {
-                    return;
-                }
-                while(true)
-                {
-                    RRDeferredCapturePtr work;
-                    {
-                        boost::mutex::scoped_lock lock(this_->this_lock);
-                        auto e = this_->input_data.begin();
-                        if (e == this_->input_data.end() || this_->closed || this_->aborted)
-                        {
-                            this_->active_thread_count--;
-                            if (this_->active_thread_count == 0)
-                            {
-                                this_->prepare_completed = true;
-                                if (this_->next_handler)
-                                {
-                                    this_->complete_gen(this_->next_handler);
-                                }
-                            }
-                            return;
-                        }
-                        work = *e;
-                        this_->input_data.erase(e);
-                    }
-
-                    if ((!this_->mesh || work->mesh) && (!this_->stl || work->mesh_stl_bytes))
-                    {
-                        continue;
-                    }
-
-                    try
-                    {
-                        
-                        TRef<asdk::IFrameProcessor> processor;
-                        if ( this_->scanner->createFrameProcessor( &processor ) != asdk::ErrorCode_OK )
-                        {
-                            return;
-                        }
-                        asdk::TRef<asdk::IFrameMesh> frame_mesh;
-                        RR_CALL_ARTEC(processor->reconstructAndTexturizeMesh(&frame_mesh, work->frame ), "Error reconstructing mesh");
-                        
-                        rr_shapes::MeshPtr rr_mesh;
-                        if (this_->mesh)
-                        {
-                            rr_mesh = ConvertArtecFrameMeshToRR(frame_mesh);
-                        }
-
-                        RR::RRArrayPtr<uint8_t> stl_bytes;
-                        if (this_->stl)
-                        {
-                            stl_bytes = ConvertArtecMeshToStlBytes(frame_mesh);
-                        }
-
-                        {
-                            boost::mutex::scoped_lock work_lock(this_->data_lock);
-                            if (this_->stl)
-                            {
-                                work->mesh_stl_bytes = stl_bytes;
-                            }
-                            if (this_->mesh)
-                            {
-                                work->mesh = rr_mesh;
-                            }
-                        }
-                        this_->completed_count.fetch_add(1, boost::memory_order_relaxed);
-
-                        RR_ARTEC_LOG_INFO("Completed preparing deferred capture handle " << work->handle);
-                    }
-                    catch (RR::RobotRaconteurException& exp)
-                    {
-                        RR_ARTEC_LOG_ERROR("Error preparing deferred frame handle " << work->handle << ": " << exp.what());
-                        this_->failed_count.fetch_add(1, boost::memory_order_relaxed);
-                    }
-                    catch (std::exception& exp)
-                    {
-                        RR_ARTEC_LOG_ERROR("Error preparing deferred frame handle " << work->handle << ": " << exp.what());
-                        this_->failed_count.fetch_add(1, boost::memory_order_relaxed);
-                    }
-                }
-            });
+            complete_gen(h);
         }
     }
 
@@ -158,11 +308,27 @@ namespace artec_scanner_robotraconteur_driver
 
         if (!started)
         {
-            prepare();
+            started = true;
+            RR_WEAK_PTR<DeferredCapturePrepare> weak_this = shared_from_this();
+            bool has_work = worker->start(
+                [weak_this](const RRDeferredCapturePtr&, const rr_shapes::MeshPtr&, const RR::RRArrayPtr<uint8_t>&, bool) {
+                    auto t = weak_this.lock();
+                    if (!t) return;
+                    t->notify_progress();
+                },
+                [weak_this]() {
+                    auto t = weak_this.lock();
+                    if (!t) return;
+                    t->prepare_done();
+                });
+            if (!has_work)
+            {
+                prepare_completed = true;
+            }
             auto ret = rr_artec::DeferredCapturePrepareStatusPtr(new rr_artec::DeferredCapturePrepareStatus());
             ret->action_status = rr_action::ActionStatusCode::running;
-            ret->completed_count = completed_count;
-            ret->failed_count = failed_count;
+            ret->completed_count = worker->get_completed_count();
+            ret->failed_count = worker->get_failed_count();
             RR_ARTEC_LOG_INFO("Started prepare deferred captures")
             lock.unlock();
             handler(ret, nullptr);
@@ -180,16 +346,7 @@ namespace artec_scanner_robotraconteur_driver
             return;
         }
 
-        next_handler = handler;
-
-        RR_WEAK_PTR<DeferredCapturePrepare> weak_this = shared_from_this();
-        next_timer = RR::RobotRaconteurNode::s()->CreateTimer(boost::posix_time::seconds(5), 
-            [weak_this](const RR::TimerEvent& evt) {
-                auto t = weak_this.lock();
-                if (!t) return;
-                t->next_timer_handler(evt);
-        }, true);
-        next_timer->Start();
+        wait_progress(lock, handler);
     }
 
     void DeferredCapturePrepare::AsyncClose(boost::function<void(const RobotRaconteur::RobotRaconteurExceptionPtr& err)> handler,
@@ -197,6 +354,7 @@ namespace artec_scanner_robotraconteur_driver
     {
         boost::mutex::scoped_lock lock(this_lock);
         closed = true;
+        worker->cancel();
         lock.unlock();
         handler(nullptr);
     }
@@ -206,6 +364,7 @@ namespace artec_scanner_robotraconteur_driver
     {
         boost::mutex::scoped_lock lock(this_lock);
         aborted = true;
+        worker->cancel();
         lock.unlock();
         handler(nullptr);
     }
@@ -219,25 +378,166 @@ namespace artec_scanner_robotraconteur_driver
 
         auto ret = rr_artec::DeferredCapturePrepareStatusPtr(new rr_artec::DeferredCapturePrepareStatus());
         ret->action_status = rr_action::ActionStatusCode::complete;
-        ret->completed_count = completed_count;
-        ret->failed_count = failed_count;
+        ret->completed_count = worker->get_completed_count();
+        ret->failed_count = worker->get_failed_count();
         handler(ret,nullptr);
     }
 
-    void DeferredCapturePrepare::next_timer_handler(const RobotRaconteur::TimerEvent& evt)
+    rr_artec::DeferredCapturePrepareStatusPtr DeferredCapturePrepare::progress_status()
+    {
+        auto ret = rr_artec::DeferredCapturePrepareStatusPtr(new rr_artec::DeferredCapturePrepareStatus());
+        ret->action_status = rr_action::ActionStatusCode::running;
+        ret->completed_count = worker->get_completed_count();
+        ret->failed_count = worker->get_failed_count();
+        return ret;
+    }
+
+    DeferredCapturePrepareStream::DeferredCapturePrepareStream(boost::shared_ptr<ArtecScannerImpl> parent)
+    {
+        this->parent=parent;
+    }
+
+    void DeferredCapturePrepareStream::Init(std::vector<boost::shared_ptr<RRDeferredCapture> >&& input_data, bool mesh, bool stl)
+    {
+        auto p = parent.lock();
+        if (!p) {
+            RR_ARTEC_LOG_ERROR("ArtecScannerImpl parent has been released");
+            throw RR::InvalidOperationException("ArtecScannerImpl parent has been released");
+        }
+        worker = RR_MAKE_SHARED<DeferredCapturePrepareWorker>(p, std::move(input_data), mesh, stl);
+    }
+
+    void DeferredCapturePrepareStream::capture_prepared(const RRDeferredCapturePtr& work, const rr_shapes::MeshPtr& rr_mesh, 
+        const RR::RRArrayPtr<uint8_t>& stl_bytes, bool success)
+    {
+        auto ret = rr_artec::DeferredCaptureResultPtr(new rr_artec::DeferredCaptureResult());
+        ret->deferred_capture_handle = work->handle;
+        ret->success = RR::rr_bool(success ? 1 : 0);
+        ret->mesh = rr_mesh;
+        ret->stl = stl_bytes ? stl_bytes : RR::AllocateEmptyRRArray<uint8_t>(0);
+        ret->completed_count = worker->get_completed_count();
+        ret->failed_count = worker->get_failed_count();
+        ret->total_count = static_cast<uint32_t>(worker->get_input_count());
+
+        boost::mutex::scoped_lock lock(this_lock);
+        if (next_handler)
+        {
+            auto h = next_handler;
+            next_handler.clear();
+            result_delivered();
+            lock.unlock();
+            h(ret, nullptr);
+            return;
+        }
+        results.push_back(ret);
+    }
+
+    void DeferredCapturePrepareStream::result_delivered()
+    {
+        delivered_count++;
+        worker->set_claim_limit(delivered_count + DEFERRED_PREPARE_STREAM_WINDOW);
+    }
+
+    void DeferredCapturePrepareStream::prepare_done()
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        prepare_completed = true;
+        RR_ARTEC_LOG_INFO("Completed streaming prepare deferred captures");
+        if (next_handler && results.empty())
+        {
+            auto h = next_handler;
+            next_handler.clear();
+            lock.unlock();
+            h(nullptr, RR_MAKE_SHARED<RR::StopIterationException>(""));
+        }
+    }
+
+    void DeferredCapturePrepareStream::AsyncNext(boost::function<void(const experimental::artec_scanner::DeferredCaptureResultPtr&,
+        const RobotRaconteur::RobotRaconteurExceptionPtr&)> handler, int32_t timeout)
     {
         boost::mutex::scoped_lock lock(this_lock);
+        if (aborted)
+        {
+            throw RR::OperationAbortedException("Deferred capture prepare was aborted");
+        }
+
+        if (!started)
+        {
+            if (closed)
+            {
+                throw RR::StopIterationException("");
+            }
+            started = true;
+            RR_WEAK_PTR<DeferredCapturePrepareStream> weak_this = shared_from_this();
+            worker->set_claim_limit(DEFERRED_PREPARE_STREAM_WINDOW);
+            bool has_work = worker->start(
+                [weak_this](const RRDeferredCapturePtr& work, const rr_shapes::MeshPtr& rr_mesh, 
+                    const RR::RRArrayPtr<uint8_t>& stl_bytes, bool success) {
+                    auto t = weak_this.lock();
+                    if (!t) return;
+                    t->capture_prepared(work, rr_mesh, stl_bytes, success);
+                },
+                [weak_this]() {
+                    auto t = weak_this.lock();
+                    if (!t) return;
+                    t->prepare_done();
+                });
+            if (!has_work)
+            {
+                prepare_completed = true;
+            }
+            RR_ARTEC_LOG_INFO("Started streaming prepare deferred captures");
+        }
+
+        if (next_handler)
+        {
+            throw RR::InvalidOperationException("Next call already in progress");
+        }
+
+        if (!results.empty())
+        {
+            auto ret = results.front();
+            results.pop_front();
+            result_delivered();
+            lock.unlock();
+            handler(ret, nullptr);
+            return;
+        }
+
+        if (prepare_completed)
+        {
+            throw RR::StopIterationException("");
+        }
+
+        // Completed by capture_prepared or prepare_done
+        next_handler = handler;
+    }
+
+    void DeferredCapturePrepareStream::AsyncClose(boost::function<void(const RobotRaconteur::RobotRaconteurExceptionPtr& err)> handler,
+                    int32_t timeout)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        closed = true;
+        worker->cancel();
+        lock.unlock();
+        handler(nullptr);
+    }
+
+    void DeferredCapturePrepareStream::AsyncAbort(boost::function<void(const RobotRaconteur::RobotRaconteurExceptionPtr& err)> handler,
+                    int32_t timeout)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        aborted = true;
+        results.clear();
+        worker->cancel();
         auto h = next_handler;
         next_handler.clear();
+        lock.unlock();
         if (h)
         {
-            auto ret = rr_artec::DeferredCapturePrepareStatusPtr(new rr_artec::DeferredCapturePrepareStatus());
-            ret->action_status = rr_action::ActionStatusCode::running;
-            ret->completed_count = completed_count;
-            ret->failed_count = failed_count;
-            h(ret, nullptr);
-            return;
+            h(nullptr, RR_MAKE_SHARED<RR::OperationAbortedException>("Deferred capture prepare was aborted"));
         }
+        handler(nullptr);
     }
 
 }
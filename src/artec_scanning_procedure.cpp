@@ -1,6 +1,7 @@
 #include "artec_scanning_procedure.h"
 #include "artec_scanner_impl.h"
 #include "artec_scanner_util.h"
+#include "artec_scanner_thread_budget.h"
 
 #include <artec/sdk/capturing/IScanner.h>
 #include <artec/sdk/capturing/IArrayScannerId.h>
@@ -44,6 +45,7 @@ namespace artec_scanner_robotraconteur_driver
     }
     
     ScanningProcedure::ScanningProcedure(boost::shared_ptr<ArtecScannerImpl> parent)
+        : frame_count(0)
     {
         this->parent = parent;
     }
@@ -62,6 +64,8 @@ namespace artec_scanner_robotraconteur_driver
         desc.captureTexture = (asdk::CaptureTextureMethod)settings->capture_texture;
         desc.captureTextureFrequency = settings->capture_texture_frequency;
         desc.saveEmptySurfaces = settings->save_empty_surfaces.value != 0;
+        preview_settings = GetScanPreviewSettings(settings->extended);
+        max_frame_count = settings->max_frame_count;
 
         RR_CALL_ARTEC(asdk::createScanningProcedure(&this->scanning_procedure, GetParent()->scanner, &desc), 
             "Error creating scanning procedure");
@@ -73,8 +77,9 @@ namespace artec_scanner_robotraconteur_driver
         workset.in = input_container;
         workset.out = model->model;
         workset.cancellation = ct_source->getToken();
-        workset.progress = nullptr;
-        workset.threadsCount = 0;        
+        progress_sink = boost::make_shared<JobProgressSink>();
+        workset.progress = progress_sink.get();
+        workset.threadsCount = ScanningJobThreadCount(GetExtendedThreadsCount(settings->extended));
     }
 
     void ScanningProcedure::AsyncNext(boost::function<void(const experimental::artec_scanner::ScanningProcedureStatusPtr&,
@@ -85,25 +90,26 @@ namespace artec_scanner_robotraconteur_driver
         {
             throw RR::OperationAbortedException("Scanning Procedure operation was aborted");
         }
-        if ((closed && !started) || completed)
+        if ((closed && !launched) || completed)
         {
             throw RR::StopIterationException("");
         }
 
         if (!started)
         {
-            job_observer = RR_MAKE_SHARED<ScanningProcedureJobObserver>(shared_from_this());
-            auto launch_res = asdk::launchJob(scanning_procedure, &workset, job_observer.get());
-            if (launch_res != asdk::ErrorCode_OK)
+            // Scanning does not wait for algorithm jobs, the scheduler only tracks it as running
+            ticket = GetParent()->job_scheduler->admit_unlimited();
+            try
+            {
+                launch_job();
+            }
+            catch (std::exception&)
             {
-                job_observer.reset();
+                ticket.reset();
+                throw;
             }
-            RR_CALL_ARTEC(launch_res, "Error launching scanning procedure");
             started = true;
-            auto ret = rr_artec::ScanningProcedureStatusPtr(new rr_artec::ScanningProcedureStatus());
-            ret->action_status = rr_action::ActionStatusCode::running;
-            ret->model_handle = 0;
-            RR_ARTEC_LOG_INFO("Started scanning procedure")
+            auto ret = progress_status();
             lock.unlock();
             handler(ret, nullptr);
             return;
@@ -120,18 +126,27 @@ namespace artec_scanner_robotraconteur_driver
             return;
         }
 
-        next_handler = handler;
+        wait_progress(lock, handler);
+    }
 
-        RR_WEAK_PTR<ScanningProcedure> weak_this = shared_from_this();
-        next_timer = RR::RobotRaconteurNode::s()->CreateTimer(boost::posix_time::seconds(5), 
-            [weak_this](const RR::TimerEvent& evt) {
-                auto t = weak_this.lock();
-                if (!t) return;
-                t->next_timer_handler(evt);
-        }, true);
-        next_timer->Start();
+    void ScanningProcedure::launch_job()
+    {
+        job_observer = RR_MAKE_SHARED<ScanningProcedureJobObserver>(shared_from_this());
+        if (preview_settings.rate > 0.0)
+        {
+            GetParent()->scan_preview_publisher->begin_scan();
+        }
+        progress_sink->restart();
+        auto launch_res = asdk::launchJob(scanning_procedure, &workset, job_observer.get());
+        if (launch_res != asdk::ErrorCode_OK)
+        {
+            job_observer.reset();
+        }
+        RR_CALL_ARTEC(launch_res, "Error launching scanning procedure");
+        launched = true;
+        RR_ARTEC_LOG_INFO("Started scanning procedure")
     }
-        
+
 
     void ScanningProcedure::AsyncClose(boost::function<void(const RobotRaconteur::RobotRaconteurExceptionPtr& err)> handler,
                     int32_t timeout)
@@ -144,12 +159,16 @@ namespace artec_scanner_robotraconteur_driver
             return;
         }
         closed = true;
-        if (started)
+        if (launched)
         {
             RR_ARTEC_LOG_INFO("Stopping scanner procedure from Close");
             RR_CALL_ARTEC(scanning_procedure->setState(asdk::ScanningState::ScanningState_Stop), 
                 "Error stopping scanning procedure");
         }
+        else
+        {
+            ticket.reset();
+        }
         lock.unlock();
         handler(nullptr);
     }
@@ -165,12 +184,16 @@ namespace artec_scanner_robotraconteur_driver
             return;
         }
         aborted = true;
-        if (started)
+        if (launched)
         {
             RR_ARTEC_LOG_INFO("Stopping scanner procedure from Abort");
             RR_CALL_ARTEC(scanning_procedure->setState(asdk::ScanningState::ScanningState_Stop), 
                 "Error stopping scanner");
         }
+        else
+        {
+            ticket.reset();
+        }
         lock.unlock();
         handler(nullptr);
     }
@@ -182,21 +205,21 @@ namespace artec_scanner_robotraconteur_driver
         boost::mutex::scoped_lock lock(this_lock);
         artec_job_complete = true;
         artec_job_status = result;
-        auto h = next_handler;
-        next_handler.clear();
+        ticket.reset();
+        auto h = take_next_handler();
         if (h)
         {
-            try
-            {
-                next_timer->Stop();
-            }
-            catch (std::exception&) {}
-
             complete_gen(h);
             return;
         }
     }
 
+    void ScanningProcedure::frame_scanned()
+    {
+        frame_count.fetch_add(1, boost::memory_order_relaxed);
+        notify_progress();
+    }
+
     void ScanningProcedure::complete_gen(boost::function<void(const experimental::artec_scanner::ScanningProcedureStatusPtr&,
                 const RobotRaconteur::RobotRaconteurExceptionPtr&)> handler)
     {
@@ -216,38 +239,80 @@ namespace artec_scanner_robotraconteur_driver
         auto ret = rr_artec::ScanningProcedureStatusPtr(new rr_artec::ScanningProcedureStatus());
         ret->action_status = rr_action::ActionStatusCode::complete;
         ret->model_handle = handle;
+        ret->frame_count = frame_count.load(boost::memory_order_relaxed);
+        fill_progress(ret);
+        ret->queue_position = 0;
+        ret->percent_complete = 100.0;
+        ret->remaining_time = 0.0;
         handler(ret,nullptr);
     }
 
-    void ScanningProcedure::next_timer_handler(const RR::TimerEvent& evt)
+    rr_artec::ScanningProcedureStatusPtr ScanningProcedure::progress_status()
     {
-        boost::mutex::scoped_lock lock(this_lock);
-        auto h = next_handler;
-        next_handler.clear();
-        if (h)
+        auto ret = rr_artec::ScanningProcedureStatusPtr(new rr_artec::ScanningProcedureStatus());
+        ret->action_status = launched ? rr_action::ActionStatusCode::running : rr_action::ActionStatusCode::pending;
+        ret->model_handle = 0;
+        ret->frame_count = frame_count.load(boost::memory_order_relaxed);
+        fill_progress(ret);
+        ret->queue_position = (!launched && ticket) ? ticket->get_queue_position() : 0;
+        return ret;
+    }
+
+    void ScanningProcedure::fill_progress(const rr_artec::ScanningProcedureStatusPtr& status)
+    {
+        JobProgress p = progress_sink->get_progress();
+        if (p.percent < 0.0 && max_frame_count > 0)
         {
-            auto ret = rr_artec::ScanningProcedureStatusPtr(new rr_artec::ScanningProcedureStatus());
-            ret->action_status = rr_action::ActionStatusCode::running;
-            ret->model_handle = 0;
-            h(ret, nullptr);
-            return;
+            // The procedure ends at max_frame_count frames, use the frame count when the job
+            // does not report progress
+            p = progress_sink->get_progress(static_cast<double>(status->frame_count) / max_frame_count);
         }
+        status->percent_complete = p.percent;
+        status->elapsed_time = launched ? p.elapsed_time : 0.0;
+        status->remaining_time = p.remaining_time;
     }
 
 
-    void ScanningProcedureObserver::onFrameScanned(const artec::sdk::scanning::RegistrationInfo* frameInfo)
+    void ScanningProcedure::publish_telemetry(rr_artec::FrameTelemetryEvent::FrameTelemetryEvent event,
+        const asdk::RegistrationInfo* frame_info, int32_t scanner_index)
     {
+        auto p = parent.lock();
+        if (!p) return;
+        p->frame_telemetry_publisher->publish(event, frame_info, scanner_index);
+    }
 
+    void ScanningProcedure::publish_preview(const asdk::RegistrationInfo* frame_info)
+    {
+        if (preview_settings.rate <= 0.0)
+        {
+            return;
+        }
+        auto p = parent.lock();
+        if (!p) return;
+        p->scan_preview_publisher->submit_frame(preview_settings, frame_info, frame_count.load(boost::memory_order_relaxed));
+    }
+
+    void ScanningProcedureObserver::onFrameScanned(const artec::sdk::scanning::RegistrationInfo* frameInfo)
+    {
+        auto p = parent.lock();
+        if (!p) return;
+        p->publish_telemetry(rr_artec::FrameTelemetryEvent::frame_scanned, frameInfo, 0);
+        p->frame_scanned();
+        p->publish_preview(frameInfo);
     }
         
     void ScanningProcedureObserver::onFrameCaptured(const artec::sdk::scanning::RegistrationInfo* frameInfo)
     {
-
+        auto p = parent.lock();
+        if (!p) return;
+        p->publish_telemetry(rr_artec::FrameTelemetryEvent::frame_captured, frameInfo, 0);
     }
 
     void ScanningProcedureObserver::onScanningFinished (int scannerIndex)
     {
-
+        auto p = parent.lock();
+        if (!p) return;
+        p->publish_telemetry(rr_artec::FrameTelemetryEvent::scanning_finished, nullptr, scannerIndex);
     }
 
     ScanningProcedureObserver::ScanningProcedureObserver(boost::shared_ptr<ScanningProcedure> parent)
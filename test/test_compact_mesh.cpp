@@ -0,0 +1,220 @@
+#define BOOST_TEST_MODULE artec_scanner_compact_mesh
+#include <boost/test/included/unit_test.hpp>
+
+#include "artec_scanner_compact_mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+using namespace artec_scanner_robotraconteur_driver;
+
+struct TestMesh
+{
+    std::vector<float> points;
+    std::vector<float> normals;
+    std::vector<int32_t> triangles;
+};
+
+// Sphere sampled on a latitude/longitude grid, normals point outwards. Triangles are
+// shuffled so the index deltas need multi-byte varints in both directions.
+static TestMesh make_test_mesh(size_t rows, size_t cols, float radius)
+{
+    TestMesh m;
+    for (size_t r = 0; r < rows; r++)
+    {
+        double theta = 3.141592653589793 * (r + 0.5) / rows;
+        for (size_t c = 0; c < cols; c++)
+        {
+            double phi = 2.0 * 3.141592653589793 * c / cols;
+            float n[3] = { static_cast<float>(std::sin(theta) * std::cos(phi)),
+                static_cast<float>(std::sin(theta) * std::sin(phi)), static_cast<float>(std::cos(theta)) };
+            for (int k = 0; k < 3; k++)
+            {
+                m.normals.push_back(n[k]);
+                m.points.push_back(n[k] * radius + 10.0f * k);
+            }
+        }
+    }
+    std::vector<int32_t> quads;
+    for (size_t r = 0; r + 1 < rows; r++)
+    {
+        for (size_t c = 0; c < cols; c++)
+        {
+            quads.push_back(static_cast<int32_t>(r * cols + c));
+        }
+    }
+    uint32_t seed = 4321;
+    for (size_t i = quads.size(); i > 1; i--)
+    {
+        seed = seed * 1103515245 + 12345;
+        std::swap(quads[i - 1], quads[(seed >> 8) % i]);
+    }
+    for (int32_t q : quads)
+    {
+        const int32_t n = static_cast<int32_t>(cols);
+        int32_t r = q / n;
+        int32_t c = q % n;
+        int32_t c1 = (c + 1) % n;
+        int32_t a = r * n + c;
+        int32_t b = r * n + c1;
+        int32_t d = (r + 1) * n + c;
+        int32_t e = (r + 1) * n + c1;
+        int32_t t[6] = { a, d, b, b, d, e };
+        m.triangles.insert(m.triangles.end(), t, t + 6);
+    }
+    return m;
+}
+
+static void check_round_trip(const TestMesh& m, bool with_normals, bool deflate, double scale)
+{
+    const size_t vertex_count = m.points.size() / 3;
+    const size_t triangle_count = m.triangles.size() / 3;
+    std::vector<uint8_t> encoded;
+    EncodeCompactMesh(m.points.data(), vertex_count, with_normals ? m.normals.data() : nullptr,
+        m.triangles.data(), triangle_count, scale, deflate, encoded);
+
+    CompactMesh decoded;
+    DecodeCompactMesh(encoded.data(), encoded.size(), decoded);
+
+    BOOST_REQUIRE_EQUAL(decoded.vertices.size(), vertex_count * 3);
+    double lo[3];
+    double hi[3];
+    for (int k = 0; k < 3; k++)
+    {
+        lo[k] = hi[k] = m.points[k];
+    }
+    for (size_t i = 0; i < vertex_count; i++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            lo[k] = (std::min)(lo[k], static_cast<double>(m.points[i * 3 + k]));
+            hi[k] = (std::max)(hi[k], static_cast<double>(m.points[i * 3 + k]));
+        }
+    }
+    for (int k = 0; k < 3; k++)
+    {
+        // Half a quantization step, plus float rounding of the decoded value
+        double step = (hi[k] - lo[k]) * scale / 65535.0;
+        double tolerance = step / 2 + 1e-6 * (std::fabs(hi[k]) + std::fabs(lo[k])) * scale;
+        double max_error = 0.0;
+        for (size_t i = 0; i < vertex_count; i++)
+        {
+            double expected = m.points[i * 3 + k] * scale;
+            max_error = (std::max)(max_error, std::fabs(decoded.vertices[i * 3 + k] - expected));
+        }
+        BOOST_CHECK_LE(max_error, tolerance);
+    }
+
+    if (with_normals)
+    {
+        BOOST_REQUIRE_EQUAL(decoded.normals.size(), vertex_count * 3);
+        double max_angle = 0.0;
+        for (size_t i = 0; i < vertex_count; i++)
+        {
+            const double a[3] = { m.normals[i * 3], m.normals[i * 3 + 1], m.normals[i * 3 + 2] };
+            const double b[3] = { decoded.normals[i * 3], decoded.normals[i * 3 + 1], decoded.normals[i * 3 + 2] };
+            double len = std::sqrt(b[0] * b[0] + b[1] * b[1] + b[2] * b[2]);
+            BOOST_CHECK_CLOSE(len, 1.0, 1e-3);
+            double cross[3] = { a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+            double sin_angle = std::sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]);
+            max_angle = (std::max)(max_angle, std::atan2(sin_angle, a[0] * b[0] + a[1] * b[1] + a[2] * b[2]));
+        }
+        // 16 bit octahedral normals are accurate to well under 0.01 degrees
+        BOOST_CHECK_LT(max_angle, 0.01 * 3.141592653589793 / 180.0);
+    }
+    else
+    {
+        BOOST_CHECK(decoded.normals.empty());
+    }
+
+    BOOST_REQUIRE_EQUAL(decoded.triangles.size(), m.triangles.size());
+    for (size_t i = 0; i < m.triangles.size(); i++)
+    {
+        BOOST_REQUIRE_EQUAL(decoded.triangles[i], static_cast<uint32_t>(m.triangles[i]));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(compact_mesh_round_trip)
+{
+    TestMesh small = make_test_mesh(7, 9, 25.0f);
+    // Large enough to span several worker pool chunks and deflate bands
+    TestMesh large = make_test_mesh(300, 400, 150.0f);
+    for (bool deflate : { false, true })
+    {
+        for (bool with_normals : { false, true })
+        {
+            check_round_trip(small, with_normals, deflate, 1.0);
+            check_round_trip(large, with_normals, deflate, 0.001);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(compact_mesh_empty_round_trip)
+{
+    for (bool deflate : { false, true })
+    {
+        std::vector<uint8_t> encoded;
+        EncodeCompactMesh(nullptr, 0, nullptr, nullptr, 0, 1.0, deflate, encoded);
+        CompactMesh decoded;
+        DecodeCompactMesh(encoded.data(), encoded.size(), decoded);
+        BOOST_CHECK(decoded.vertices.empty());
+        BOOST_CHECK(decoded.normals.empty());
+        BOOST_CHECK(decoded.triangles.empty());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(compact_mesh_encoder_rejects_invalid_index)
+{
+    TestMesh m = make_test_mesh(4, 4, 1.0f);
+    m.triangles[5] = static_cast<int32_t>(m.points.size() / 3);
+    std::vector<uint8_t> encoded;
+    BOOST_CHECK_THROW(EncodeCompactMesh(m.points.data(), m.points.size() / 3, nullptr,
+        m.triangles.data(), m.triangles.size() / 3, 1.0, false, encoded), std::invalid_argument);
+}
+
+static void set_le32(std::vector<uint8_t>& data, size_t offset, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        data[offset + i] = static_cast<uint8_t>(v >> (8 * i));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(compact_mesh_decoder_rejects_malformed_input)
+{
+    TestMesh m = make_test_mesh(20, 20, 5.0f);
+    for (bool deflate : { false, true })
+    {
+        std::vector<uint8_t> encoded;
+        EncodeCompactMesh(m.points.data(), m.points.size() / 3, m.normals.data(),
+            m.triangles.data(), m.triangles.size() / 3, 1.0, deflate, encoded);
+        CompactMesh decoded;
+
+        BOOST_CHECK_THROW(DecodeCompactMesh(encoded.data(), 63, decoded), std::invalid_argument);
+        BOOST_CHECK_THROW(DecodeCompactMesh(encoded.data(), encoded.size() - 1, decoded), std::invalid_argument);
+
+        std::vector<uint8_t> bad = encoded;
+        bad[0] = 'X';
+        BOOST_CHECK_THROW(DecodeCompactMesh(bad.data(), bad.size(), decoded), std::invalid_argument);
+
+        bad = encoded;
+        bad[4] = 2;
+        BOOST_CHECK_THROW(DecodeCompactMesh(bad.data(), bad.size(), decoded), std::invalid_argument);
+
+        // Header counts far beyond the payload must fail before anything is allocated
+        bad = encoded;
+        set_le32(bad, 8, 0xFFFFFFFF);
+        BOOST_CHECK_THROW(DecodeCompactMesh(bad.data(), bad.size(), decoded), std::invalid_argument);
+        bad = encoded;
+        set_le32(bad, 12, 0xFFFFFFFF);
+        BOOST_CHECK_THROW(DecodeCompactMesh(bad.data(), bad.size(), decoded), std::invalid_argument);
+
+        // One more triangle than encoded runs out of index bytes
+        bad = encoded;
+        set_le32(bad, 12, static_cast<uint32_t>(m.triangles.size() / 3 + 1));
+        BOOST_CHECK_THROW(DecodeCompactMesh(bad.data(), bad.size(), decoded), std::invalid_argument);
+    }
+}
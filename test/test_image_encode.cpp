@@ -0,0 +1,182 @@
+#define BOOST_TEST_MODULE artec_scanner_image_encode
+#include <boost/test/included/unit_test.hpp>
+
+#include "artec_scanner_image_encode.h"
+
+#include <zlib.h>
+#include <png.h>
+#include <cstdio>
+#include <jpeglib.h>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace artec_scanner_robotraconteur_driver;
+
+// Smooth gradients with a noisy band, exercises both long matches and literals
+static std::vector<uint8_t> make_test_image(size_t width, size_t height)
+{
+    std::vector<uint8_t> rgb(width * height * 3);
+    uint32_t seed = 12345;
+    for (size_t y = 0; y < height; y++)
+    {
+        for (size_t x = 0; x < width; x++)
+        {
+            uint8_t* p = &rgb[(y * width + x) * 3];
+            p[0] = static_cast<uint8_t>(x * 255 / (width > 1 ? width - 1 : 1));
+            p[1] = static_cast<uint8_t>(y * 255 / (height > 1 ? height - 1 : 1));
+            p[2] = static_cast<uint8_t>((x + y) / 2);
+            if (y % 16 == 3)
+            {
+                seed = seed * 1103515245 + 12345;
+                p[2] = static_cast<uint8_t>(seed >> 16);
+            }
+        }
+    }
+    return rgb;
+}
+
+static std::vector<uint8_t> decode_png(const std::vector<uint8_t>& data, size_t& width, size_t& height)
+{
+    png_image image;
+    memset(&image, 0, sizeof(image));
+    image.version = PNG_IMAGE_VERSION;
+    BOOST_REQUIRE_MESSAGE(png_image_begin_read_from_memory(&image, data.data(), data.size()), image.message);
+    image.format = PNG_FORMAT_RGB;
+    std::vector<uint8_t> rgb(PNG_IMAGE_SIZE(image));
+    BOOST_REQUIRE_MESSAGE(png_image_finish_read(&image, nullptr, rgb.data(), 0, nullptr), image.message);
+    width = image.width;
+    height = image.height;
+    return rgb;
+}
+
+static std::vector<uint8_t> decode_jpeg(const std::vector<uint8_t>& data, size_t& width, size_t& height)
+{
+    jpeg_decompress_struct cinfo;
+    jpeg_error_mgr err;
+    cinfo.err = jpeg_std_error(&err);
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, const_cast<unsigned char*>(data.data()), static_cast<unsigned long>(data.size()));
+    BOOST_REQUIRE_EQUAL(jpeg_read_header(&cinfo, TRUE), JPEG_HEADER_OK);
+    cinfo.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&cinfo);
+    width = cinfo.output_width;
+    height = cinfo.output_height;
+    BOOST_REQUIRE_EQUAL(cinfo.output_components, 3);
+    std::vector<uint8_t> rgb(width * height * 3);
+    while (cinfo.output_scanline < cinfo.output_height)
+    {
+        JSAMPROW row = &rgb[cinfo.output_scanline * width * 3];
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return rgb;
+}
+
+static std::vector<uint8_t> inflate_raw(const std::vector<uint8_t>& data)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    BOOST_REQUIRE_EQUAL(inflateInit2(&zs, -15), Z_OK);
+    zs.next_in = const_cast<Bytef*>(data.data());
+    zs.avail_in = static_cast<uInt>(data.size());
+    std::vector<uint8_t> out;
+    uint8_t buf[65536];
+    int res = Z_OK;
+    while (res == Z_OK)
+    {
+        zs.next_out = buf;
+        zs.avail_out = sizeof(buf);
+        res = inflate(&zs, Z_NO_FLUSH);
+        out.insert(out.end(), buf, buf + (sizeof(buf) - zs.avail_out));
+    }
+    inflateEnd(&zs);
+    BOOST_REQUIRE_EQUAL(res, Z_STREAM_END);
+    BOOST_CHECK_EQUAL(zs.avail_in, 0u);
+    return out;
+}
+
+BOOST_AUTO_TEST_CASE(png_fast_matches_libpng_decode)
+{
+    // Single pixel, sizes that do not divide into bands, and an image spanning many bands
+    const size_t sizes[][2] = { { 1, 1 }, { 37, 23 }, { 1000, 613 }, { 4099, 70 } };
+    for (auto& s : sizes)
+    {
+        auto rgb = make_test_image(s[0], s[1]);
+        std::vector<uint8_t> encoded;
+        EncodePngFast(rgb.data(), s[0], s[1], encoded);
+
+        size_t width = 0;
+        size_t height = 0;
+        auto decoded = decode_png(encoded, width, height);
+        BOOST_CHECK_EQUAL(width, s[0]);
+        BOOST_CHECK_EQUAL(height, s[1]);
+        BOOST_CHECK(decoded == rgb);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(jpeg_matches_libjpeg_decode)
+{
+    const size_t w = 517;
+    const size_t h = 301;
+    auto rgb = make_test_image(w, h);
+    // The noise rows are not representative of textures, compare the 8x8 block rows
+    // that do not contain them
+    for (int quality : { 50, 90, 100 })
+    {
+        std::vector<uint8_t> encoded;
+        EncodeJpeg(rgb.data(), w, h, quality, encoded);
+
+        size_t width = 0;
+        size_t height = 0;
+        auto decoded = decode_jpeg(encoded, width, height);
+        BOOST_REQUIRE_EQUAL(width, w);
+        BOOST_REQUIRE_EQUAL(height, h);
+
+        double err = 0.0;
+        size_t n = 0;
+        for (size_t y = 0; y < h; y++)
+        {
+            if (y % 16 < 8)
+            {
+                continue;
+            }
+            for (size_t i = 0; i < w * 3; i++)
+            {
+                err += std::abs(static_cast<int>(decoded[y * w * 3 + i]) - static_cast<int>(rgb[y * w * 3 + i]));
+                n++;
+            }
+        }
+        BOOST_CHECK_LT(err / n, quality >= 90 ? 1.0 : 3.0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(deflate_fast_round_trip)
+{
+    // Several bands of mixed compressible and random data, and the empty stream
+    for (size_t size : { static_cast<size_t>(0), static_cast<size_t>(1000), static_cast<size_t>(262144 * 3 + 17) })
+    {
+        std::vector<uint8_t> data(size);
+        uint32_t seed = 99;
+        for (size_t i = 0; i < size; i++)
+        {
+            seed = seed * 1103515245 + 12345;
+            data[i] = (i / 4096) % 2 ? static_cast<uint8_t>(seed >> 16) : static_cast<uint8_t>(i % 7);
+        }
+        std::vector<uint8_t> out = { 0xAB };
+        DeflateFast(data.data(), data.size(), out);
+        BOOST_CHECK_EQUAL(out[0], 0xAB);
+        auto inflated = inflate_raw(std::vector<uint8_t>(out.begin() + 1, out.end()));
+        BOOST_CHECK(inflated == data);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(encoders_reject_empty_images)
+{
+    std::vector<uint8_t> out;
+    uint8_t px[3] = { 0, 0, 0 };
+    BOOST_CHECK_THROW(EncodePngFast(px, 0, 1, out), std::invalid_argument);
+    BOOST_CHECK_THROW(EncodeJpeg(px, 1, 0, 90, out), std::invalid_argument);
+}
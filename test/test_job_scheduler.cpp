@@ -0,0 +1,220 @@
+#define BOOST_TEST_MODULE artec_scanner_job_scheduler
+#include <boost/test/included/unit_test.hpp>
+
+#include "artec_scanner_job_scheduler.h"
+#include "artec_scanner_thread_budget.h"
+
+#include <boost/make_shared.hpp>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace artec_scanner_robotraconteur_driver;
+
+// Start functions of queued jobs run on the worker pool, record the order they were called in
+class StartLog
+{
+    protected:
+        boost::mutex this_lock;
+        boost::condition_variable cv;
+        std::vector<std::string> started;
+
+    public:
+        boost::function<void()> start(const std::string& name)
+        {
+            return [this, name]()
+            {
+                boost::mutex::scoped_lock lock(this_lock);
+                started.push_back(name);
+                cv.notify_all();
+            };
+        }
+
+        // Wait until count jobs have started, returns the start order
+        std::vector<std::string> wait(size_t count)
+        {
+            boost::mutex::scoped_lock lock(this_lock);
+            auto deadline = boost::chrono::steady_clock::now() + boost::chrono::seconds(10);
+            while (started.size() < count)
+            {
+                if (cv.wait_until(lock, deadline) == boost::cv_status::timeout)
+                {
+                    break;
+                }
+            }
+            return started;
+        }
+
+        // Give posted start functions a chance to run before checking that they did not
+        std::vector<std::string> settle()
+        {
+            boost::this_thread::sleep_for(boost::chrono::milliseconds(50));
+            boost::mutex::scoped_lock lock(this_lock);
+            return started;
+        }
+};
+
+static JobTicketPtr submit(const JobSchedulerPtr& s, StartLog& log, const std::string& name, int32_t priority,
+    uint64_t memory_estimate, bool& admitted)
+{
+    return s->submit(priority, memory_estimate, log.start(name), admitted);
+}
+
+BOOST_AUTO_TEST_CASE(job_scheduler_admits_in_priority_order)
+{
+    auto s = boost::make_shared<JobScheduler>(1, 0);
+    StartLog log;
+    bool admitted = false;
+
+    auto a = submit(s, log, "a", 0, 0, admitted);
+    BOOST_CHECK(admitted);
+    BOOST_CHECK_EQUAL(a->get_queue_position(), 0);
+
+    auto b = submit(s, log, "b", 0, 0, admitted);
+    BOOST_CHECK(!admitted);
+    auto c = submit(s, log, "c", 5, 0, admitted);
+    BOOST_CHECK(!admitted);
+    auto d = submit(s, log, "d", 5, 0, admitted);
+    BOOST_CHECK(!admitted);
+    auto e = submit(s, log, "e", -1, 0, admitted);
+    BOOST_CHECK(!admitted);
+
+    // Higher priority first, first come first served within a priority
+    BOOST_CHECK_EQUAL(c->get_queue_position(), 1);
+    BOOST_CHECK_EQUAL(d->get_queue_position(), 2);
+    BOOST_CHECK_EQUAL(b->get_queue_position(), 3);
+    BOOST_CHECK_EQUAL(e->get_queue_position(), 4);
+
+    // Dropping a queued ticket removes it from the queue without starting it
+    d.reset();
+    BOOST_CHECK_EQUAL(b->get_queue_position(), 2);
+    BOOST_CHECK(log.settle().empty());
+
+    a.reset();
+    BOOST_REQUIRE_EQUAL(log.wait(1).size(), 1u);
+    BOOST_CHECK_EQUAL(c->get_queue_position(), 0);
+    BOOST_CHECK_EQUAL(log.settle().size(), 1u);
+
+    c.reset();
+    BOOST_REQUIRE_EQUAL(log.wait(2).size(), 2u);
+    b.reset();
+    std::vector<std::string> order = log.wait(3);
+    std::vector<std::string> expected = { "c", "b", "e" };
+    BOOST_CHECK_EQUAL_COLLECTIONS(order.begin(), order.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(job_scheduler_admits_only_the_head_of_the_queue)
+{
+    auto s = boost::make_shared<JobScheduler>(0, 100);
+    StartLog log;
+    bool admitted = false;
+
+    auto a = submit(s, log, "a", 0, 60, admitted);
+    BOOST_CHECK(admitted);
+    auto b = submit(s, log, "b", 0, 80, admitted);
+    BOOST_CHECK(!admitted);
+    // Fits next to a, but must not overtake the larger job at the head
+    auto c = submit(s, log, "c", 0, 10, admitted);
+    BOOST_CHECK(!admitted);
+    BOOST_CHECK_EQUAL(c->get_queue_position(), 2);
+    BOOST_CHECK(log.settle().empty());
+
+    // b and c fit together once a is done. Both are posted to the pool at once, so their
+    // start functions may run in either order.
+    a.reset();
+    std::vector<std::string> order = log.wait(2);
+    std::sort(order.begin(), order.end());
+    std::vector<std::string> expected = { "b", "c" };
+    BOOST_CHECK_EQUAL_COLLECTIONS(order.begin(), order.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(job_scheduler_memory_budget)
+{
+    auto s = boost::make_shared<JobScheduler>(0, 100);
+    StartLog log;
+    bool admitted = false;
+
+    // A job larger than the budget runs once nothing else does
+    auto big = submit(s, log, "big", 0, 500, admitted);
+    BOOST_CHECK(admitted);
+    auto a = submit(s, log, "a", 0, 10, admitted);
+    BOOST_CHECK(!admitted);
+    big.reset();
+    BOOST_REQUIRE_EQUAL(log.wait(1).size(), 1u);
+
+    auto b = submit(s, log, "b", 0, 90, admitted);
+    BOOST_CHECK(admitted);
+    auto big2 = submit(s, log, "big2", 0, 500, admitted);
+    BOOST_CHECK(!admitted);
+    a.reset();
+    BOOST_CHECK_EQUAL(log.settle().size(), 1u);
+    b.reset();
+    std::vector<std::string> order = log.wait(2);
+    std::vector<std::string> expected = { "a", "big2" };
+    BOOST_CHECK_EQUAL_COLLECTIONS(order.begin(), order.end(), expected.begin(), expected.end());
+
+    // Raising the limits admits queued jobs
+    auto c = submit(s, log, "c", 0, 10, admitted);
+    BOOST_CHECK(!admitted);
+    s->set_limits(0, 1000);
+    BOOST_CHECK_EQUAL(log.wait(3).size(), 3u);
+}
+
+BOOST_AUTO_TEST_CASE(job_scheduler_unlimited_tickets_do_not_count)
+{
+    auto s = boost::make_shared<JobScheduler>(1, 100);
+    StartLog log;
+    bool admitted = false;
+
+    auto u1 = s->admit_unlimited();
+    auto u2 = s->admit_unlimited();
+    BOOST_CHECK_EQUAL(u1->get_queue_position(), 0);
+
+    auto a = submit(s, log, "a", 0, 100, admitted);
+    BOOST_CHECK(admitted);
+    // The limits still apply to the limited jobs
+    auto b = submit(s, log, "b", 0, 0, admitted);
+    BOOST_CHECK(!admitted);
+
+    u1.reset();
+    u2.reset();
+    BOOST_CHECK(log.settle().empty());
+    a.reset();
+    BOOST_CHECK_EQUAL(log.wait(1).size(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(job_scheduler_shares_algorithm_threads)
+{
+    ThreadBudgetSettings budget;
+    uint32_t hardware = (std::max)(boost::thread::hardware_concurrency(), 1u);
+    // Leave four threads to the algorithm jobs
+    budget.scanning_reserved_threads = hardware > 4 ? hardware - 4 : 0;
+    SetThreadBudget(budget);
+    if (budget.scanning_reserved_threads == 0)
+    {
+        SetThreadBudget(ThreadBudgetSettings());
+        BOOST_TEST_MESSAGE("Not enough hardware threads to test the algorithm thread budget");
+        return;
+    }
+
+    auto s = boost::make_shared<JobScheduler>(0, 0);
+    bool admitted = false;
+    auto a = s->submit(0, 0, []() {}, admitted);
+    auto b = s->submit(0, 0, []() {}, admitted);
+
+    BOOST_CHECK_EQUAL(a->acquire_algorithm_threads(3), 3);
+    // One left for b, every job gets at least one thread
+    BOOST_CHECK_EQUAL(b->acquire_algorithm_threads(0), 1);
+    BOOST_CHECK_EQUAL(b->acquire_algorithm_threads(2), 1);
+    b->release_algorithm_threads(1);
+    b->release_algorithm_threads(1);
+    a->release_algorithm_threads(1);
+    BOOST_CHECK_EQUAL(b->acquire_algorithm_threads(0), 2);
+
+    // Destroying a ticket returns its threads
+    a.reset();
+    auto c = s->submit(0, 0, []() {}, admitted);
+    BOOST_CHECK_EQUAL(c->acquire_algorithm_threads(0), 2);
+
+    SetThreadBudget(ThreadBudgetSettings());
+}
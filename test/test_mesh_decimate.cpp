@@ -0,0 +1,147 @@
+#define BOOST_TEST_MODULE artec_scanner_mesh_decimate
+#include <boost/test/included/unit_test.hpp>
+
+#include "artec_scanner_mesh_decimate.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+using namespace artec_scanner_robotraconteur_driver;
+
+struct TestMesh
+{
+    std::vector<float> points;
+    std::vector<int32_t> triangles;
+
+    size_t vertex_count() const { return points.size() / 3; }
+    size_t triangle_count() const { return triangles.size() / 3; }
+};
+
+// Closed sphere in millimeters from a latitude/longitude grid with pole vertices
+static TestMesh make_sphere(size_t rows, size_t cols, float radius)
+{
+    TestMesh m;
+    const double pi = 3.141592653589793;
+    const float north[3] = { 0.0f, 0.0f, radius };
+    m.points.assign(north, north + 3);
+    for (size_t r = 1; r < rows; r++)
+    {
+        double theta = pi * r / rows;
+        for (size_t c = 0; c < cols; c++)
+        {
+            double phi = 2.0 * pi * c / cols;
+            m.points.push_back(static_cast<float>(radius * std::sin(theta) * std::cos(phi)));
+            m.points.push_back(static_cast<float>(radius * std::sin(theta) * std::sin(phi)));
+            m.points.push_back(static_cast<float>(radius * std::cos(theta)));
+        }
+    }
+    m.points.insert(m.points.end(), { 0.0f, 0.0f, -radius });
+
+    const int32_t n = static_cast<int32_t>(cols);
+    const int32_t south = static_cast<int32_t>(m.vertex_count() - 1);
+    auto ring = [n](size_t r, int32_t c) { return static_cast<int32_t>(1 + (r - 1) * n + (c % n)); };
+    for (int32_t c = 0; c < n; c++)
+    {
+        m.triangles.insert(m.triangles.end(), { 0, ring(1, c), ring(1, c + 1) });
+        m.triangles.insert(m.triangles.end(), { south, ring(rows - 1, c + 1), ring(rows - 1, c) });
+    }
+    for (size_t r = 1; r + 1 < rows; r++)
+    {
+        for (int32_t c = 0; c < n; c++)
+        {
+            m.triangles.insert(m.triangles.end(), { ring(r, c), ring(r + 1, c), ring(r, c + 1) });
+            m.triangles.insert(m.triangles.end(), { ring(r, c + 1), ring(r + 1, c), ring(r + 1, c + 1) });
+        }
+    }
+    return m;
+}
+
+static void check_valid_lod(const LodMesh& lod, float radius)
+{
+    const size_t vertex_count = lod.points.size() / 3;
+    BOOST_REQUIRE_EQUAL(lod.points.size() % 3, 0u);
+    BOOST_REQUIRE_EQUAL(lod.triangles.size() % 3, 0u);
+
+    std::vector<bool> used(vertex_count, false);
+    std::set<std::array<int32_t, 3> > seen;
+    for (size_t i = 0; i < lod.triangles.size(); i += 3)
+    {
+        std::array<int32_t, 3> t = {{ lod.triangles[i], lod.triangles[i + 1], lod.triangles[i + 2] }};
+        for (int32_t v : t)
+        {
+            BOOST_REQUIRE(v >= 0 && static_cast<size_t>(v) < vertex_count);
+            used[v] = true;
+        }
+        BOOST_CHECK(t[0] != t[1] && t[1] != t[2] && t[0] != t[2]);
+        std::rotate(t.begin(), std::min_element(t.begin(), t.end()), t.end());
+        BOOST_CHECK(seen.insert(t).second);
+    }
+    // Every output vertex belongs to a triangle
+    BOOST_CHECK(std::find(used.begin(), used.end(), false) == used.end());
+
+    // Cluster means lie inside the sphere and not far below its surface
+    for (size_t i = 0; i < vertex_count; i++)
+    {
+        const float* p = &lod.points[i * 3];
+        double r = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+        BOOST_CHECK_LE(r, radius * 1.0001);
+        BOOST_CHECK_GE(r, radius * 0.7);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(cluster_decimate_reduces_to_target)
+{
+    const float radius = 100.0f;
+    TestMesh m = make_sphere(200, 300, radius);
+    for (size_t target : { 20000u, 5000u, 500u, 50u })
+    {
+        LodMesh lod;
+        ClusterDecimateMesh(m.points.data(), m.vertex_count(), m.triangles.data(), m.triangle_count(), target, lod);
+        const size_t count = lod.triangles.size() / 3;
+        BOOST_TEST_MESSAGE("target " << target << " gave " << count << " triangles");
+        BOOST_CHECK_LE(count, target);
+        // The grid search lands close to the target rather than far below it
+        BOOST_CHECK_GE(count, target / 4);
+        check_valid_lod(lod, radius);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(cluster_decimate_copies_meshes_within_target)
+{
+    TestMesh m = make_sphere(10, 12, 5.0f);
+    LodMesh lod;
+    ClusterDecimateMesh(m.points.data(), m.vertex_count(), m.triangles.data(), m.triangle_count(),
+        m.triangle_count(), lod);
+    BOOST_CHECK(lod.points == m.points);
+    BOOST_CHECK(lod.triangles == m.triangles);
+}
+
+BOOST_AUTO_TEST_CASE(cluster_decimate_empty_results)
+{
+    TestMesh m = make_sphere(10, 12, 5.0f);
+    LodMesh lod;
+    lod.points.push_back(1.0f);
+    ClusterDecimateMesh(m.points.data(), m.vertex_count(), m.triangles.data(), m.triangle_count(), 0, lod);
+    BOOST_CHECK(lod.points.empty());
+    BOOST_CHECK(lod.triangles.empty());
+
+    ClusterDecimateMesh(nullptr, 0, nullptr, 0, 100, lod);
+    BOOST_CHECK(lod.points.empty());
+    BOOST_CHECK(lod.triangles.empty());
+}
+
+BOOST_AUTO_TEST_CASE(cluster_decimate_rejects_invalid_index)
+{
+    TestMesh m = make_sphere(10, 12, 5.0f);
+    LodMesh lod;
+    m.triangles[7] = static_cast<int32_t>(m.vertex_count());
+    BOOST_CHECK_THROW(ClusterDecimateMesh(m.points.data(), m.vertex_count(), m.triangles.data(),
+        m.triangle_count(), 10, lod), std::invalid_argument);
+    m.triangles[7] = -1;
+    BOOST_CHECK_THROW(ClusterDecimateMesh(m.points.data(), m.vertex_count(), m.triangles.data(),
+        m.triangle_count(), 10, lod), std::invalid_argument);
+}
@@ -0,0 +1,132 @@
+#define BOOST_TEST_MODULE artec_scanner_overwrite_ring
+#include <boost/test/included/unit_test.hpp>
+
+#include "artec_scanner_overwrite_ring.h"
+
+#include <boost/thread.hpp>
+#include <vector>
+
+using namespace artec_scanner_robotraconteur_driver;
+
+struct RingEntry
+{
+    uint32_t producer;
+    uint32_t sequence;
+    // Derived from the other fields to detect torn reads
+    uint64_t check;
+};
+
+static uint64_t entry_check(uint32_t producer, uint32_t sequence)
+{
+    return (static_cast<uint64_t>(producer) * 0x9E3779B97F4A7C15ull) ^ (sequence * 0xC2B2AE3D27D4EB4Full);
+}
+
+static RingEntry make_entry(uint32_t producer, uint32_t sequence)
+{
+    RingEntry e = { producer, sequence, entry_check(producer, sequence) };
+    return e;
+}
+
+BOOST_AUTO_TEST_CASE(overwrite_ring_capacity_is_a_power_of_two)
+{
+    BOOST_CHECK_EQUAL(OverwriteRing<int>(1).capacity(), 1u);
+    BOOST_CHECK_EQUAL(OverwriteRing<int>(3).capacity(), 4u);
+    BOOST_CHECK_EQUAL(OverwriteRing<int>(8).capacity(), 8u);
+    BOOST_CHECK_EQUAL(OverwriteRing<int>(1000).capacity(), 1024u);
+}
+
+BOOST_AUTO_TEST_CASE(overwrite_ring_pops_in_order)
+{
+    OverwriteRing<int> ring(8);
+    uint64_t read_index = 0;
+    uint64_t dropped = 0;
+    int value = -1;
+    BOOST_CHECK(!ring.pop(read_index, value, dropped));
+
+    for (int i = 0; i < 5; i++)
+    {
+        ring.push(i);
+    }
+    for (int i = 0; i < 5; i++)
+    {
+        BOOST_REQUIRE(ring.pop(read_index, value, dropped));
+        BOOST_CHECK_EQUAL(value, i);
+    }
+    BOOST_CHECK(!ring.pop(read_index, value, dropped));
+    BOOST_CHECK_EQUAL(read_index, 5u);
+    BOOST_CHECK_EQUAL(dropped, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(overwrite_ring_counts_overwritten_entries)
+{
+    OverwriteRing<int> ring(4);
+    for (int i = 0; i < 10; i++)
+    {
+        ring.push(i);
+    }
+    uint64_t read_index = 0;
+    uint64_t dropped = 0;
+    int value = -1;
+    // Only the latest capacity() entries are left
+    for (int i = 6; i < 10; i++)
+    {
+        BOOST_REQUIRE(ring.pop(read_index, value, dropped));
+        BOOST_CHECK_EQUAL(value, i);
+    }
+    BOOST_CHECK(!ring.pop(read_index, value, dropped));
+    BOOST_CHECK_EQUAL(dropped, 6u);
+
+    ring.push(10);
+    BOOST_REQUIRE(ring.pop(read_index, value, dropped));
+    BOOST_CHECK_EQUAL(value, 10);
+    BOOST_CHECK_EQUAL(dropped, 6u);
+}
+
+BOOST_AUTO_TEST_CASE(overwrite_ring_concurrent_producers)
+{
+    const uint32_t producer_count = 4;
+    const uint32_t per_producer = 200000;
+    // Small enough that the consumer falls behind and entries are overwritten
+    OverwriteRing<RingEntry> ring(64);
+
+    boost::thread_group producers;
+    for (uint32_t p = 0; p < producer_count; p++)
+    {
+        producers.create_thread([&ring, p, per_producer]()
+        {
+            for (uint32_t i = 0; i < per_producer; i++)
+            {
+                ring.push(make_entry(p, i));
+            }
+        });
+    }
+
+    std::vector<int64_t> last_sequence(producer_count, -1);
+    uint64_t read_index = 0;
+    uint64_t dropped = 0;
+    uint64_t received = 0;
+    const uint64_t total = static_cast<uint64_t>(producer_count) * per_producer;
+    bool ok = true;
+    while (received + dropped < total)
+    {
+        RingEntry e;
+        if (!ring.pop(read_index, e, dropped))
+        {
+            boost::this_thread::yield();
+            continue;
+        }
+        received++;
+        if (e.producer >= producer_count || e.check != entry_check(e.producer, e.sequence)
+            || static_cast<int64_t>(e.sequence) <= last_sequence[e.producer])
+        {
+            ok = false;
+            break;
+        }
+        last_sequence[e.producer] = e.sequence;
+    }
+    producers.join_all();
+
+    BOOST_CHECK(ok);
+    BOOST_CHECK_EQUAL(received + dropped, total);
+    BOOST_CHECK_GT(received, 0u);
+}
@@ -0,0 +1,104 @@
+#define BOOST_TEST_MODULE artec_scanner_thread_budget
+#include <boost/test/included/unit_test.hpp>
+
+#include "artec_scanner_thread_budget.h"
+
+#include <boost/thread.hpp>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace artec_scanner_robotraconteur_driver;
+
+// Restores the default budget when a test case ends
+struct ThreadBudgetFixture
+{
+    ~ThreadBudgetFixture()
+    {
+        SetThreadBudget(ThreadBudgetSettings());
+    }
+};
+
+BOOST_FIXTURE_TEST_CASE(algorithm_threads_without_reserve, ThreadBudgetFixture)
+{
+    BOOST_CHECK_EQUAL(AlgorithmJobThreadCount(0, 0), 0);
+    BOOST_CHECK_EQUAL(AlgorithmJobThreadCount(6, 1000), 6);
+
+    ThreadBudgetSettings budget;
+    budget.algorithm_threads = 3;
+    SetThreadBudget(budget);
+    BOOST_CHECK_EQUAL(AlgorithmJobThreadCount(0, 0), 3);
+    // Requests override the driver setting, threads in use do not matter without a reserve
+    BOOST_CHECK_EQUAL(AlgorithmJobThreadCount(5, 1000), 5);
+}
+
+BOOST_FIXTURE_TEST_CASE(algorithm_threads_with_reserve, ThreadBudgetFixture)
+{
+    uint32_t hardware = (std::max)(boost::thread::hardware_concurrency(), 1u);
+
+    // A reserve of all hardware threads still leaves one thread per job
+    ThreadBudgetSettings budget;
+    budget.scanning_reserved_threads = hardware + 4;
+    SetThreadBudget(budget);
+    BOOST_CHECK_EQUAL(AlgorithmJobThreadCount(0, 0), 1);
+    BOOST_CHECK_EQUAL(AlgorithmJobThreadCount(8, 0), 1);
+    BOOST_CHECK_EQUAL(AlgorithmJobThreadCount(8, 50), 1);
+
+    if (hardware < 4)
+    {
+        BOOST_TEST_MESSAGE("Not enough hardware threads to test a partial reserve");
+        return;
+    }
+    const int total = static_cast<int>(hardware) - 2;
+    budget.scanning_reserved_threads = 2;
+    SetThreadBudget(budget);
+    BOOST_CHECK_EQUAL(AlgorithmJobThreadCount(0, 0), total);
+    BOOST_CHECK_EQUAL(AlgorithmJobThreadCount(1, 0), 1);
+    BOOST_CHECK_EQUAL(AlgorithmJobThreadCount(1000, 0), total);
+    BOOST_CHECK_EQUAL(AlgorithmJobThreadCount(0, 1), total - 1);
+    BOOST_CHECK_EQUAL(AlgorithmJobThreadCount(0, total), 1);
+    BOOST_CHECK_EQUAL(AlgorithmJobThreadCount(0, total + 10), 1);
+
+    // The driver setting is capped the same way
+    budget.algorithm_threads = 1000;
+    SetThreadBudget(budget);
+    BOOST_CHECK_EQUAL(AlgorithmJobThreadCount(0, 1), total - 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(scanning_threads, ThreadBudgetFixture)
+{
+    BOOST_CHECK_EQUAL(ScanningJobThreadCount(0), 0);
+    ThreadBudgetSettings budget;
+    budget.scanning_threads = 2;
+    // The reserve only limits algorithm jobs
+    budget.scanning_reserved_threads = 1000;
+    SetThreadBudget(budget);
+    BOOST_CHECK_EQUAL(ScanningJobThreadCount(0), 2);
+    BOOST_CHECK_EQUAL(ScanningJobThreadCount(7), 7);
+}
+
+static void check_cpu_list(const std::string& s, const std::vector<uint32_t>& expected)
+{
+    std::vector<uint32_t> cpus = ParseCpuList(s);
+    BOOST_CHECK_EQUAL_COLLECTIONS(cpus.begin(), cpus.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(parse_cpu_list)
+{
+    check_cpu_list("0", { 0 });
+    check_cpu_list("0-3,6", { 0, 1, 2, 3, 6 });
+    // Sorted with duplicates removed
+    check_cpu_list("7,2-3,3,1-2", { 1, 2, 3, 7 });
+    check_cpu_list("4-4", { 4 });
+    check_cpu_list("9999", { 9999 });
+}
+
+BOOST_AUTO_TEST_CASE(parse_cpu_list_rejects_malformed_input)
+{
+    const char* bad[] = { "", ",", "1,", ",1", "1,,2", "a", "1a", "-1", "1-", "-", "3-1", "1-2-3", " 1",
+        "10000", "1.5" };
+    for (const char* s : bad)
+    {
+        BOOST_CHECK_THROW(ParseCpuList(s), std::invalid_argument);
+    }
+}